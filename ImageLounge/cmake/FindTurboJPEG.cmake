@@ -0,0 +1,17 @@
+# TURBOJPEG_FOUND - system has the libjpeg-turbo library
+# TURBOJPEG_INCLUDE_DIRECTORY - the libjpeg-turbo include directory
+# TURBOJPEG_LIBRARIES - The libraries needed to use libjpeg-turbo
+
+
+if(TURBOJPEG_INCLUDE_DIRECTORY AND TURBOJPEG_LIBRARIES)
+	set(TURBOJPEG_FOUND TRUE)
+else()
+	find_path(TURBOJPEG_INCLUDE_DIRECTORY NAMES turbojpeg.h)
+	
+	find_library(TURBOJPEG_LIBRARIES NAMES turbojpeg turbojpeg-static)
+	
+	include(FindPackageHandleStandardArgs)
+	find_package_handle_standard_args(TURBOJPEG DEFAULT_MSG TURBOJPEG_INCLUDE_DIRECTORY TURBOJPEG_LIBRARIES)
+	
+	mark_as_advanced(TURBOJPEG_INCLUDE_DIRECTORY TURBOJPEG_LIBRARIES)
+endif(TURBOJPEG_INCLUDE_DIRECTORY AND TURBOJPEG_LIBRARIES)
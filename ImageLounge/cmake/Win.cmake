@@ -216,6 +216,20 @@ if(ENABLE_QUAZIP)
 	endif(QUAZIP_FOUND)
 endif(ENABLE_QUAZIP)
 
+#search for libjpeg-turbo
+unset(TURBOJPEG_FOUND CACHE)
+
+if(ENABLE_TURBOJPEG)
+	SET(CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH} ${CMAKE_CURRENT_SOURCE_DIR}/cmake)
+
+	find_package(TurboJPEG)
+	if(TURBOJPEG_FOUND)
+		add_definitions(-DWITH_TURBOJPEG)
+	else()
+		message(FATAL_ERROR "libjpeg-turbo not found. It's mandatory when used with ENABLE_TURBOJPEG enabled.")
+	endif(TURBOJPEG_FOUND)
+endif(ENABLE_TURBOJPEG)
+
 #add libqpsd
 add_subdirectory(${CMAKE_CURRENT_SOURCE_DIR}/3rdparty/libqpsd)
 set(LIBQPSD_LIBRARY "qpsd")
@@ -457,6 +457,15 @@ void DkSettings::load(QSettings& settings, bool defaults) {
 	resources_p.filterDuplicats = settings.value("filterDuplicates", resources_p.filterDuplicats).toBool();
 	resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();	
 	resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
+	resources_p.thumbCacheSize = settings.value("thumbCacheSize", resources_p.thumbCacheSize).toInt();
+	resources_p.decodeForDisplay = settings.value("decodeForDisplay", resources_p.decodeForDisplay).toBool();
+	resources_p.batchIoThreads = settings.value("batchIoThreads", resources_p.batchIoThreads).toInt();
+	resources_p.batchDecodeThreads = settings.value("batchDecodeThreads", resources_p.batchDecodeThreads).toInt();
+	resources_p.batchProcessThreads = settings.value("batchProcessThreads", resources_p.batchProcessThreads).toInt();
+	resources_p.batchEncodeThreads = settings.value("batchEncodeThreads", resources_p.batchEncodeThreads).toInt();
+	resources_p.batchQueueSize = settings.value("batchQueueSize", resources_p.batchQueueSize).toInt();
+	resources_p.batchJournal = settings.value("batchJournal", resources_p.batchJournal).toBool();
+	resources_p.batchStripHeight = settings.value("batchStripHeight", resources_p.batchStripHeight).toInt();
 
 	if (sync_p.switchModifier) {
 		global_p.altMod = Qt::ControlModifier;
@@ -732,6 +741,24 @@ void DkSettings::save(QSettings& settings, bool force) {
 		settings.setValue("preferredExtension", resources_p.preferredExtension);
 	if (force ||resources_p.gammaCorrection != resources_d.gammaCorrection)
 		settings.setValue("gammaCorrection", resources_p.gammaCorrection);
+	if (force ||resources_p.thumbCacheSize != resources_d.thumbCacheSize)
+		settings.setValue("thumbCacheSize", resources_p.thumbCacheSize);
+	if (force ||resources_p.decodeForDisplay != resources_d.decodeForDisplay)
+		settings.setValue("decodeForDisplay", resources_p.decodeForDisplay);
+	if (force ||resources_p.batchIoThreads != resources_d.batchIoThreads)
+		settings.setValue("batchIoThreads", resources_p.batchIoThreads);
+	if (force ||resources_p.batchDecodeThreads != resources_d.batchDecodeThreads)
+		settings.setValue("batchDecodeThreads", resources_p.batchDecodeThreads);
+	if (force ||resources_p.batchProcessThreads != resources_d.batchProcessThreads)
+		settings.setValue("batchProcessThreads", resources_p.batchProcessThreads);
+	if (force ||resources_p.batchEncodeThreads != resources_d.batchEncodeThreads)
+		settings.setValue("batchEncodeThreads", resources_p.batchEncodeThreads);
+	if (force ||resources_p.batchQueueSize != resources_d.batchQueueSize)
+		settings.setValue("batchQueueSize", resources_p.batchQueueSize);
+	if (force ||resources_p.batchJournal != resources_d.batchJournal)
+		settings.setValue("batchJournal", resources_p.batchJournal);
+	if (force ||resources_p.batchStripHeight != resources_d.batchStripHeight)
+		settings.setValue("batchStripHeight", resources_p.batchStripHeight);
 	settings.endGroup();
 
 	// keep loaded settings in mind
@@ -865,9 +892,16 @@ void DkSettings::setToDefaultSettings() {
 	resources_p.loadRawThumb = raw_thumb_always;
 	resources_p.filterDuplicats = false;
 	resources_p.preferredExtension = "*.jpg";
-	resources_p.numThumbsLoading = 0;
-	resources_p.maxThumbsLoading = 5;
+	resources_p.thumbCacheSize = 256;	// MB - 0 disables the thumbnail cache
 	resources_p.gammaCorrection = true;
+	resources_p.decodeForDisplay = true;	// decode large images at screen resolution first
+	resources_p.batchIoThreads = 1;			// threads per batch stage - 0 picks a default
+	resources_p.batchDecodeThreads = 0;
+	resources_p.batchProcessThreads = 0;
+	resources_p.batchEncodeThreads = 0;
+	resources_p.batchQueueSize = 0;			// images queued between two batch stages - 0 picks a default
+	resources_p.batchJournal = true;		// resume batches by skipping items that are up to date
+	resources_p.batchStripHeight = 256;		// rows per strip if batch plugins process strips
 	resources_p.waitForLastImg = true;
 
 	qDebug() << "ok... default settings are set";
@@ -93,6 +93,7 @@ public:
 		sort_date_created,
 		sort_date_modified,
 		sort_random,
+		sort_date_taken,
 		sort_end,
 	};
 
@@ -273,9 +274,16 @@ public:
 		bool filterDuplicats;
 		int loadRawThumb;
 		QString preferredExtension;
-		int numThumbsLoading;
-		int maxThumbsLoading;
+		int thumbCacheSize;
 		bool gammaCorrection;
+		bool decodeForDisplay;
+		int batchIoThreads;
+		int batchDecodeThreads;
+		int batchProcessThreads;
+		int batchEncodeThreads;
+		int batchQueueSize;
+		bool batchJournal;
+		int batchStripHeight;
 	};
 
 	//enums for checkboxes - divide in camera data and description
@@ -0,0 +1,268 @@
+/*******************************************************************************************************
+ DkTaskScheduler.cpp
+ Created on:	17.10.2016
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] http://www.nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+#include "DkTaskScheduler.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QRunnable>
+#include <QThreadPool>
+#include <QDebug>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+// DkTaskScheduler::Runner --------------------------------------------------------------------
+class DkTaskScheduler::Runner : public QRunnable {
+
+public:
+	Runner(DkTaskScheduler* scheduler, Priority priority, const Task& task) {
+		mScheduler = scheduler;
+		mPriority = priority;
+		mTask = task;
+	}
+
+	void run() override {
+		mTask.run();
+		mScheduler->taskFinished(mPriority);
+	}
+
+protected:
+	DkTaskScheduler* mScheduler;
+	Priority mPriority;
+	Task mTask;
+};
+
+// DkTaskScheduler --------------------------------------------------------------------
+DkTaskScheduler::DkTaskScheduler() {
+
+	for (int idx = 0; idx < priority_end; idx++) {
+		mNumRunning[idx] = 0;
+		mMaxRunning[idx] = 0;
+	}
+}
+
+DkTaskScheduler& DkTaskScheduler::instance() {
+
+	static DkTaskScheduler inst;
+	return inst;
+}
+
+/**
+ * Moves all queued tasks of an owner to another priority class.
+ * Call this if e.g. the prefetched image becomes the visible one.
+ * @param owner the tasks' owner
+ * @param priority the new priority class
+ **/
+void DkTaskScheduler::setPriority(const void* owner, Priority priority) {
+
+	{
+		QMutexLocker locker(&mMutex);
+
+		for (int idx = 0; idx < priority_end; idx++) {
+
+			if (idx == priority)
+				continue;
+
+			for (int tIdx = mQueues[idx].size()-1; tIdx >= 0; tIdx--) {
+
+				if (mQueues[idx][tIdx].owner == owner) {
+					mQueues[priority].prepend(mQueues[idx][tIdx]);
+					mQueues[idx].removeAt(tIdx);
+				}
+			}
+		}
+	}
+
+	dispatch();
+}
+
+/**
+ * Drops all queued tasks of an owner.
+ * Tasks that are running already are not interrupted.
+ * The futures of dropped tasks are canceled & finished.
+ * @param owner the tasks' owner
+ **/
+void DkTaskScheduler::cancel(const void* owner) {
+
+	QMutexLocker locker(&mMutex);
+
+	for (int idx = 0; idx < priority_end; idx++) {
+
+		for (int tIdx = mQueues[idx].size()-1; tIdx >= 0; tIdx--) {
+
+			if (mQueues[idx][tIdx].owner == owner) {
+				mQueues[idx][tIdx].drop();
+				mQueues[idx].removeAt(tIdx);
+			}
+		}
+	}
+}
+
+/**
+ * Limits the number of threads a priority class may use.
+ * @param priority the priority class
+ * @param maxRunning the maximal number of running tasks - <= 0 picks a default
+ **/
+void DkTaskScheduler::setMaxRunning(Priority priority, int maxRunning) {
+
+	{
+		QMutexLocker locker(&mMutex);
+		mMaxRunning[priority] = maxRunning;
+	}
+
+	dispatch();
+}
+
+int DkTaskScheduler::maxRunning(Priority priority) const {
+
+	QMutexLocker locker(&mMutex);
+	return maxRunningIntern(priority);
+}
+
+/**
+ * Returns the number of tasks that are running or queued.
+ * @param priority the priority class
+ * @return int the number of pending tasks
+ **/
+int DkTaskScheduler::numPending(Priority priority) const {
+
+	QMutexLocker locker(&mMutex);
+	return mNumRunning[priority] + mQueues[priority].size();
+}
+
+/**
+ * Returns true if new tasks of this class would have to wait.
+ * Callers that can create tasks lazily (e.g. thumbnails while painting)
+ * should not queue more - otherwise the queue fills with stale requests.
+ * @param priority the priority class
+ * @return bool true if the class is saturated
+ **/
+bool DkTaskScheduler::isBusy(Priority priority) const {
+
+	QMutexLocker locker(&mMutex);
+	return mNumRunning[priority] + mQueues[priority].size() >= maxRunningIntern(priority);
+}
+
+void DkTaskScheduler::enqueue(Priority priority, const Task& task) {
+
+	{
+		QMutexLocker locker(&mMutex);
+		mQueues[priority].enqueue(task);
+	}
+
+	dispatch();
+}
+
+void DkTaskScheduler::dispatch() {
+
+	QMutexLocker locker(&mMutex);
+
+	// forget about tasks that are canceled
+	for (int idx = 0; idx < priority_end; idx++) {
+
+		for (int tIdx = mQueues[idx].size()-1; tIdx >= 0; tIdx--) {
+
+			if (mQueues[idx][tIdx].isCanceled()) {
+				mQueues[idx][tIdx].drop();
+				mQueues[idx].removeAt(tIdx);
+			}
+		}
+	}
+
+	// fairness: every waiting class gets a thread before any class gets a second one
+	for (int idx = 0; idx < priority_end; idx++) {
+
+		Priority p = (Priority)idx;
+
+		if (!mQueues[p].isEmpty() && mNumRunning[p] == 0 && canStart(p))
+			start(p);
+	}
+
+	for (int idx = 0; idx < priority_end; idx++) {
+
+		Priority p = (Priority)idx;
+
+		while (!mQueues[p].isEmpty() && canStart(p))
+			start(p);
+	}
+}
+
+void DkTaskScheduler::taskFinished(Priority priority) {
+
+	{
+		QMutexLocker locker(&mMutex);
+		mNumRunning[priority]--;
+	}
+
+	dispatch();
+}
+
+void DkTaskScheduler::start(Priority priority) {
+
+	mNumRunning[priority]++;
+	QThreadPool::globalInstance()->start(new Runner(this, priority, mQueues[priority].dequeue()), priority_end - priority);
+}
+
+bool DkTaskScheduler::canStart(Priority priority) const {
+
+	int numThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+	int numRunning = 0;
+	for (int idx = 0; idx < priority_end; idx++)
+		numRunning += mNumRunning[idx];
+
+	if (numRunning >= numThreads || mNumRunning[priority] >= maxRunningIntern(priority))
+		return false;
+
+	// keep one thread for the visible image
+	if (priority != priority_visible && numThreads > 1 && numRunning - mNumRunning[priority_visible] >= numThreads-1)
+		return false;
+
+	return true;
+}
+
+int DkTaskScheduler::maxRunningIntern(Priority priority) const {
+
+	if (mMaxRunning[priority] > 0)
+		return mMaxRunning[priority];
+
+	int numThreads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+
+	switch (priority) {
+	case priority_next:		return qMax(1, numThreads/2);
+	case priority_thumbs:	return qMax(1, numThreads-1);
+	case priority_prefetch: return qMax(1, numThreads/4);
+	case priority_batch:	return qMax(1, numThreads/2);
+	default:				return numThreads;
+	}
+}
+
+}
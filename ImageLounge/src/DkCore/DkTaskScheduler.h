@@ -0,0 +1,152 @@
+/*******************************************************************************************************
+ DkTaskScheduler.h
+ Created on:	17.10.2016
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] http://www.nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+
+#include <functional>
+#pragma warning(pop)		// no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+/**
+ * Schedules the loader's background work on the global thread pool.
+ * Tasks are queued per priority class and each class has a concurrency cap.
+ * One thread is kept for the visible image, so a thumbnail storm cannot delay it.
+ * Classes that have queued tasks but none running are served first (in order
+ * of their priority) - so prefetching and background jobs make progress too.
+ * Queued tasks are dropped without running if their future is canceled.
+ * All functions are thread-safe.
+ **/
+class DllCoreExport DkTaskScheduler {
+
+public:
+	enum Priority {
+		priority_visible = 0,	// the image the user is looking at
+		priority_next,			// the image that is (most likely) shown next
+		priority_thumbs,		// visible thumbnails
+		priority_prefetch,		// file buffers of cached images
+		priority_batch,			// background jobs (e.g. saving thumbnails)
+
+		priority_end
+	};
+
+	static DkTaskScheduler& instance();
+
+	/**
+	 * Queues a function.
+	 * @param priority the task's priority class
+	 * @param owner the object the task works for (needed for setPriority() and cancel())
+	 * @param fn the function
+	 * @return QFuture<T> the function's future
+	 **/
+	template <typename T>
+	QFuture<T> run(Priority priority, const void* owner, std::function<T()> fn) {
+
+		QSharedPointer<QFutureInterface<T> > fi(new QFutureInterface<T>());
+		fi->reportStarted();
+
+		Task task;
+		task.owner = owner;
+		task.run = [fi, fn]() {
+			if (!fi->isCanceled())
+				compute(*fi, fn);
+			fi->reportFinished();
+		};
+		task.isCanceled = [fi]() { return fi->isCanceled(); };
+		task.drop = [fi]() {
+			fi->reportCanceled();
+			fi->reportFinished();
+		};
+
+		enqueue(priority, task);
+
+		return fi->future();
+	}
+
+	void setPriority(const void* owner, Priority priority);
+	void cancel(const void* owner);
+
+	void setMaxRunning(Priority priority, int maxRunning);
+	int maxRunning(Priority priority) const;
+	int numPending(Priority priority) const;
+	bool isBusy(Priority priority) const;
+
+protected:
+	DkTaskScheduler();
+	DkTaskScheduler(DkTaskScheduler const&);		// hide
+	void operator=(DkTaskScheduler const&);		// hide
+
+	struct Task {
+		const void* owner = 0;
+		std::function<void()> run;
+		std::function<bool()> isCanceled;
+		std::function<void()> drop;
+	};
+
+	class Runner;
+
+	template <typename T>
+	static void compute(QFutureInterface<T>& fi, const std::function<T()>& fn) { fi.reportResult(fn()); }
+	static void compute(QFutureInterface<void>&, const std::function<void()>& fn) { fn(); }
+
+	void enqueue(Priority priority, const Task& task);
+	void dispatch();
+	void taskFinished(Priority priority);
+
+	// the mutex must be locked for these
+	void start(Priority priority);
+	bool canStart(Priority priority) const;
+	int maxRunningIntern(Priority priority) const;
+
+	mutable QMutex mMutex;
+	QQueue<Task> mQueues[priority_end];
+	int mNumRunning[priority_end];
+	int mMaxRunning[priority_end];	// <= 0 picks a default based on the pool's threads
+};
+
+};
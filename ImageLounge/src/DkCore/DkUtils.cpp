@@ -62,6 +62,10 @@
 #ifdef Q_OS_WIN
 #include "shlwapi.h"
 #pragma comment (lib, "shlwapi.lib")
+#include <io.h>
+#else
+#include <unistd.h>
+#include <cstdio>
 #endif
 
 #if QT_VERSION >= 0x050500 && !defined(QT_NO_DEBUG_OUTPUT)
@@ -837,6 +841,42 @@ bool DkUtils::moveToTrash(const QString& filePath) {
 	return false;	// should never be hit
 }
 
+/**
+ * Writes the file's buffers to the disk (fsync).
+ * @param file an opened file
+ * @return bool true if the data is on the disk
+ **/ 
+bool DkUtils::flushToDisk(QFile& file) {
+
+	if (!file.isOpen() || !file.flush())
+		return false;
+
+#ifdef Q_OS_WIN
+	return FlushFileBuffers((HANDLE)_get_osfhandle(file.handle())) != 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+/**
+ * Renames a file and atomically replaces an existing destination.
+ * Note: QFile::rename never overwrites.
+ * @param srcPath the file to be renamed
+ * @param dstPath the new path (it is replaced if it exists)
+ * @return bool true on success
+ **/ 
+bool DkUtils::renameOverwrite(const QString& srcPath, const QString& dstPath) {
+
+#ifdef Q_OS_WIN
+	std::wstring src = qStringToStdWString(QDir::toNativeSeparators(srcPath));
+	std::wstring dst = qStringToStdWString(QDir::toNativeSeparators(dstPath));
+
+	return MoveFileExW(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return ::rename(QFile::encodeName(srcPath).constData(), QFile::encodeName(dstPath).constData()) == 0;
+#endif
+}
+
 QString DkUtils::readableByte(float bytes) {
 
 	if (bytes >= 1024*1024*1024) {
@@ -1030,6 +1070,115 @@ int DkFileNameConverter::getIntAttribute(const QString& tag, int idx) const {
 	return attr;
 }
 
+// DkNaturalSortKey --------------------------------------------------------------------
+DkNaturalSortKey::DkNaturalSortKey(const QString& str) {
+
+	mStr = str;
+	mFolded = str.toCaseFolded();
+
+	const QChar* s = mFolded.constData();
+	int len = mFolded.length();
+
+	for (int idx = 0; idx < len;) {
+
+		Chunk c;
+		c.start = idx;
+		c.number = s[idx] >= '0' && s[idx] <= '9';
+
+		while (idx < len && (s[idx] >= '0' && s[idx] <= '9') == c.number)
+			idx++;
+
+		c.length = idx - c.start;
+		c.digits = 0;
+
+		// leading zeros do not change the value
+		if (c.number) {
+			int fIdx = c.start;
+			while (fIdx < idx-1 && s[fIdx] == '0')
+				fIdx++;
+			c.digits = idx - fIdx;
+		}
+
+		mChunks.append(c);
+	}
+}
+
+int DkNaturalSortKey::compareChars(const QChar* s1, const QChar* s2, int length) {
+
+	for (int idx = 0; idx < length; idx++) {
+		if (s1[idx] != s2[idx])
+			return s1[idx].unicode() < s2[idx].unicode() ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Compares two keys.
+ * @param o the other key
+ * @return int < 0 if this key is sorted before o, 0 if both are equal, > 0 otherwise
+ **/ 
+int DkNaturalSortKey::compare(const DkNaturalSortKey& o) const {
+
+	const QChar* s1 = mFolded.constData();
+	const QChar* s2 = o.mFolded.constData();
+	int zeroDiff = 0;	// img01 vs img1 - only relevant if everything else is equal
+
+	int numChunks = qMin(mChunks.size(), o.mChunks.size());
+
+	for (int idx = 0; idx < numChunks; idx++) {
+
+		const Chunk& c1 = mChunks[idx];
+		const Chunk& c2 = o.mChunks[idx];
+
+		if (c1.number && c2.number) {
+
+			// more significant digits -> larger number (works for any length)
+			if (c1.digits != c2.digits)
+				return c1.digits < c2.digits ? -1 : 1;
+
+			int r = compareChars(s1 + c1.start + c1.length - c1.digits, s2 + c2.start + c2.length - c2.digits, c1.digits);
+			if (r)
+				return r;
+
+			if (!zeroDiff && c1.length != c2.length)
+				zeroDiff = c1.length < c2.length ? -1 : 1;
+		}
+		else {
+
+			// text vs number is decided by the first character
+			int l = qMin(c1.length, c2.length);
+			int r = compareChars(s1 + c1.start, s2 + c2.start, l);
+			if (r)
+				return r;
+
+			// the shorter chunk is followed by a digit or the end of the string
+			if (c1.length != c2.length) {
+				ushort n1 = c1.start + l < mFolded.length() ? s1[c1.start + l].unicode() : 0;
+				ushort n2 = c2.start + l < o.mFolded.length() ? s2[c2.start + l].unicode() : 0;
+				return n1 < n2 ? -1 : 1;
+			}
+		}
+	}
+
+	if (mChunks.size() != o.mChunks.size())
+		return mChunks.size() < o.mChunks.size() ? -1 : 1;
+
+	if (zeroDiff)
+		return zeroDiff;
+
+	// equal if we ignore the case
+	return QString::compare(mStr, o.mStr);
+}
+
+bool DkNaturalSortKey::operator<(const DkNaturalSortKey& o) const {
+	return compare(o) < 0;
+}
+
+bool DkNaturalSortKey::isEmpty() const {
+	return mStr.isEmpty();
+}
+
 // TreeItem --------------------------------------------------------------------
 TreeItem::TreeItem(const QVector<QVariant> &data, TreeItem *parent) {
 	parentItem = parent;
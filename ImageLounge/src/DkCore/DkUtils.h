@@ -33,6 +33,7 @@
 #include <QFileInfo>
 #include <QVector>
 #include <QDebug>
+#include <QFile>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// dll interface missing
@@ -183,6 +184,8 @@ public:
 	static QString readableByte(float bytes);
 	static QStringList filterStringList(const QString& query, const QStringList& list);
 	static bool moveToTrash(const QString& filePath);
+	static bool flushToDisk(QFile& file);
+	static bool renameOverwrite(const QString& srcPath, const QString& dstPath);
 
 #ifdef WITH_OPENCV
 	/**
@@ -459,6 +462,37 @@ protected:
 	int mCIdx;
 };
 
+/**
+ * Precomputed key for natural (logical) string sorting.
+ * The string is split into text and number chunks once, so
+ * comparing two keys neither allocates nor parses numbers.
+ * It sorts like naturalCompare (case insensitive):
+ * img1.png < img2.png < img10.png
+ **/
+class DllCoreExport DkNaturalSortKey {
+
+public:
+	DkNaturalSortKey(const QString& str = QString());
+
+	int compare(const DkNaturalSortKey& o) const;
+	bool operator<(const DkNaturalSortKey& o) const;
+	bool isEmpty() const;
+
+protected:
+	struct Chunk {
+		int start;
+		int length;
+		int digits;		// significant digits (numbers only)
+		bool number;
+	};
+
+	static int compareChars(const QChar* s1, const QChar* s2, int length);
+
+	QString mStr;
+	QString mFolded;
+	QVector<Chunk> mChunks;
+};
+
 // from: http://qt-project.org/doc/qt-4.8/itemviews-simpletreemodel.html
 class DllCoreExport TreeItem {
 
@@ -786,7 +786,7 @@ void DkCentralWidget::showViewPort(bool show /* = true */) {
 	if (show) {
 		switchWidget(mWidgets[viewport_widget]);
 		if (getCurrentImage())
-			mViewport->setImage(getCurrentImage()->image());
+			mViewport->updateImage(getCurrentImage());
 	}
 	else 
 		mViewport->deactivate();
@@ -797,7 +797,7 @@ void DkCentralWidget::showRecentFiles(bool show) {
 
 	// TODO: fix the missing recent files (e.g. after the thumbnails are loaded once)
 	if (show && currentViewMode() != DkTabInfo::tab_preferences) {
-		mRecentFilesWidget->setCustomStyle(!mViewport->getImage().isNull() || (getThumbScrollWidget() && getThumbScrollWidget()->isVisible()));
+		mRecentFilesWidget->setCustomStyle(mViewport->hasImage() || (getThumbScrollWidget() && getThumbScrollWidget()->isVisible()));
 		mRecentFilesWidget->raise();
 		mRecentFilesWidget->show();
 	}
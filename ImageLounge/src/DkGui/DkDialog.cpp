@@ -35,6 +35,7 @@
 #include "DkBasicWidgets.h"
 #include "DkThumbs.h"
 #include "DkUtils.h"
+#include "DkMetaData.h"
 #include "DkActionManager.h"
 #include "DkPluginManager.h"
 
@@ -653,7 +654,7 @@ void DkSearchDialog::on_searchBar_textChanged(const QString& text) {
 	if (text == mCurrentSearch)
 		return;
 	
-	mResultList = DkUtils::filterStringList(text, mFileList);
+	mResultList = DkMetaDataIndex::instance().filter(mPath, text, mFileList);
 	qDebug() << "searching [" << text << "] - converted to individual keywords [" << text.split(" ") << "] takes: " << dt;
 	mCurrentSearch = text;
 
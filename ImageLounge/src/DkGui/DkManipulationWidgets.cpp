@@ -515,14 +515,14 @@ cv::Mat DkImageManipulationWidget::applyLutToImage(cv::Mat inImg, cv::Mat inLUT,
 	}
 	else tempImg = inImg.clone();
 
-	std::vector<cv::Mat> imgCh;
-	split(tempImg, imgCh);
+	if (tempImg.depth() == CV_32F) {
 
-	unsigned short *ptrLutR = inLUT.ptr<unsigned short>(0);
-	unsigned short *ptrLutG = inLUT.ptr<unsigned short>(1);
-	unsigned short *ptrLutB = inLUT.ptr<unsigned short>(2);
+		std::vector<cv::Mat> imgCh;
+		split(tempImg, imgCh);
 
-	if (tempImg.depth() == CV_32F) {
+		unsigned short *ptrLutR = inLUT.ptr<unsigned short>(0);
+		unsigned short *ptrLutG = inLUT.ptr<unsigned short>(1);
+		unsigned short *ptrLutB = inLUT.ptr<unsigned short>(2);
 
 		if (tempImg.channels() < 3) {
 
@@ -564,43 +564,24 @@ cv::Mat DkImageManipulationWidget::applyLutToImage(cv::Mat inImg, cv::Mat inLUT,
 	}
 	else if (tempImg.depth() == CV_8U) {
 
-		if (tempImg.channels() < 3) {
+		// reduce the 16 bit LUT to 8 bit tables and map the interleaved channels in place
+		QVector<QVector<uchar> > luts;
 
-			for (int row = 0; row < tempImg.rows; row++)
-			{
-				unsigned char *ptrR = imgCh[0].ptr<unsigned char>(row);
+		for (int cIdx = 0; cIdx < qMin(tempImg.channels(), 3); cIdx++) {
 
-				for (int col = 0; col < tempImg.cols; col++) 
-					ptrR[col] = (unsigned char) qRound(ptrLutR[qRound((ptrR[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
+			const unsigned short* ptrLut = inLUT.ptr<unsigned short>(cIdx);
+			float range = (isMatHsv && cIdx == 0) ? 180.0f : 255.0f;	// 8 bit hue is stored as 0..180
+			QVector<uchar> lut(256);
 
+			for (int idx = 0; idx < lut.size(); idx++) {
+				float val = qMin((float)idx, range);
+				lut[idx] = (uchar)qRound(ptrLut[qRound(val / range * (inLUT.cols-1))] / 65535.0f * range);
 			}
-		}
-		else {
-
-			for (int row = 0; row < tempImg.rows; row++)
-			{
-				unsigned char *ptrR = imgCh[0].ptr<unsigned char>(row);
-				unsigned char *ptrG = imgCh[1].ptr<unsigned char>(row);
-				unsigned char *ptrB = imgCh[2].ptr<unsigned char>(row);
 
-				for (int col = 0; col < tempImg.cols; col++)
-				{
-					if(isMatHsv) {
-
-						ptrR[col] = (unsigned char) qRound(ptrLutR[qRound((ptrR[col] / 180.0f) * (inLUT.cols-1))] / 65535.0f * 180.0f);
-						ptrG[col] = (unsigned char) qRound(ptrLutG[qRound((ptrG[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
-						ptrB[col] = (unsigned char) qRound(ptrLutB[qRound((ptrB[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
-					}
-					else {
-
-						ptrR[col] = (unsigned char) qRound(ptrLutR[qRound((ptrR[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
-						ptrG[col] = (unsigned char) qRound(ptrLutG[qRound((ptrG[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
-						ptrB[col] = (unsigned char) qRound(ptrLutB[qRound((ptrB[col] / 255.0f) * (inLUT.cols-1))] / 257.0f);
-					}
-				}
-			}
-			merge(imgCh, tempImg);
+			luts << lut;
 		}
+
+		DkImage::applyLut(tempImg, luts);
 	}
 	
 	if(isMatHsv) {
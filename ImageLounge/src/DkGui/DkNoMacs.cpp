@@ -400,6 +400,7 @@ void DkNoMacs::createActions() {
 	connect(am.action(DkActionManager::menu_sort_date_created), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_date_modified), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_random), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+	connect(am.action(DkActionManager::menu_sort_date_taken), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_ascending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_descending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 
@@ -702,7 +703,7 @@ void DkNoMacs::moveEvent(QMoveEvent *event) {
 
 void DkNoMacs::mouseDoubleClickEvent(QMouseEvent* event) {
 
-	if (event->button() != Qt::LeftButton || (viewport() && viewport()->getImage().isNull()))
+	if (event->button() != Qt::LeftButton || (viewport() && !viewport()->hasImage()))
 		return;
 
 	if (isFullScreen())
@@ -809,7 +810,7 @@ void DkNoMacs::flipImageHorizontal() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 	img = img.mirrored(true, false);
 
 	if (img.isNull())
@@ -827,7 +828,7 @@ void DkNoMacs::flipImageVertical() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 	img = img.mirrored(false, true);
 
 	if (img.isNull())
@@ -846,7 +847,7 @@ void DkNoMacs::invertImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 	img.invertPixels();
 
 	if (img.isNull())
@@ -865,7 +866,7 @@ void DkNoMacs::convert2gray() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 
 #ifdef WITH_OPENCV
 
@@ -909,7 +910,7 @@ void DkNoMacs::normalizeImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 	
 	bool normalized = DkImage::normImage(img);
 
@@ -928,7 +929,7 @@ void DkNoMacs::autoAdjustImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
-	QImage img = vp->getImage();
+	QImage img = vp->getFullImage();
 
 	bool normalized = DkImage::autoAdjustImage(img);
 
@@ -943,7 +944,7 @@ void DkNoMacs::unsharpMask() {
 	viewport()->getController()->applyPluginChanges(true);
 
 	DkUnsharpDialog* unsharpDialog = new DkUnsharpDialog(this);
-	unsharpDialog->setImage(viewport()->getImage());
+	unsharpDialog->setImage(viewport()->getFullImage());
 	int answer = unsharpDialog->exec();
 	if (answer == QDialog::Accepted) {
 		QImage editedImage = unsharpDialog->getImage();
@@ -961,7 +962,7 @@ void DkNoMacs::tinyPlanet() {
 	viewport()->getController()->applyPluginChanges(true);
 
 	DkTinyPlanetDialog* tinyPlanetDialog = new DkTinyPlanetDialog(this);
-	tinyPlanetDialog->setImage(viewport()->getImage());
+	tinyPlanetDialog->setImage(viewport()->getFullImage());
 	
 	int answer = tinyPlanetDialog->exec();
 
@@ -1631,6 +1632,8 @@ void DkNoMacs::changeSorting(bool change) {
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_date_modified;
 		else if (senderName == "menu_sort_random")
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_random;
+		else if (senderName == "menu_sort_date_taken")
+			DkSettingsManager::param().global().sortMode = DkSettings::sort_date_taken;
 		else if (senderName == "menu_sort_ascending")
 			DkSettingsManager::param().global().sortDir = DkSettings::sort_ascending;
 		else if (senderName == "menu_sort_descending")
@@ -1716,19 +1719,19 @@ void DkNoMacs::saveFileAs(bool silent) {
 
 	// TODO: move to current image loader
 	if (getTabWidget()->getCurrentImageLoader())
-		getTabWidget()->getCurrentImageLoader()->saveUserFileAs(getTabWidget()->getViewPort()->getImage(), silent);
+		getTabWidget()->getCurrentImageLoader()->saveUserFileAs(getTabWidget()->getViewPort()->getFullImage(), silent);
 }
 
 void DkNoMacs::saveFileWeb() {
 
 	// TODO: move to current image loader
 	if (getTabWidget()->getCurrentImageLoader())
-		getTabWidget()->getCurrentImageLoader()->saveFileWeb(getTabWidget()->getViewPort()->getImage());
+		getTabWidget()->getCurrentImageLoader()->saveFileWeb(getTabWidget()->getViewPort()->getFullImage());
 }
 
 void DkNoMacs::resizeImage() {
 
-	if (!viewport() || viewport()->getImage().isNull())
+	if (!viewport() || !viewport()->hasImage())
 		return;
 
 	viewport()->getController()->applyPluginChanges(true);
@@ -1745,10 +1748,10 @@ void DkNoMacs::resizeImage() {
 		mResizeDialog->setExifDpi((float)res.x());
 	}
 
-	qDebug() << "resize image: " << viewport()->getImage().size();
+	qDebug() << "resize image: " << viewport()->getImageSize();
 
 
-	mResizeDialog->setImage(viewport()->getImage());
+	mResizeDialog->setImage(viewport()->getFullImage());
 
 	if (!mResizeDialog->exec())
 		return;
@@ -1777,7 +1780,7 @@ void DkNoMacs::resizeImage() {
 
 void DkNoMacs::deleteFile() {
 
-	if (!viewport() || viewport()->getImage().isNull() || !getTabWidget()->getCurrentImageLoader())
+	if (!viewport() || !viewport()->hasImage() || !getTabWidget()->getCurrentImageLoader())
 		return;
 	
 	viewport()->getController()->applyPluginChanges(true);
@@ -1844,7 +1847,7 @@ void DkNoMacs::computeMosaic() {
 
 void DkNoMacs::openImgManipulationDialog() {
 
-	if (!viewport() || viewport()->getImage().isNull())
+	if (!viewport() || !viewport()->hasImage())
 		return;
 
 	if (!mImgManipulationDialog)
@@ -1852,7 +1855,7 @@ void DkNoMacs::openImgManipulationDialog() {
 	else 
 		mImgManipulationDialog->resetValues();
 
-	QImage tmpImg = viewport()->getImage();
+	QImage tmpImg = viewport()->getFullImage();
 	mImgManipulationDialog->setImage(&tmpImg);
 
 	bool ok = mImgManipulationDialog->exec() != 0;
@@ -1861,7 +1864,7 @@ void DkNoMacs::openImgManipulationDialog() {
 
 #ifdef WITH_OPENCV
 
-		QImage mImg = DkImage::mat2QImage(DkImageManipulationWidget::manipulateImage(DkImage::qImage2Mat(viewport()->getImage())));
+		QImage mImg = DkImage::mat2QImage(DkImageManipulationWidget::manipulateImage(DkImage::qImage2Mat(viewport()->getFullImage())));
 
 		if (!mImg.isNull())
 			viewport()->setEditedImage(mImg, tr("Adjusted"));
@@ -1875,7 +1878,7 @@ void DkNoMacs::setWallpaper() {
 
 	// based on code from: http://qtwiki.org/Set_windows_background_using_QT
 
-	QImage img = viewport()->getImage();
+	QImage img = viewport()->getFullImage();
 
 	QImage dImg = img;
 
@@ -1911,7 +1914,7 @@ void DkNoMacs::printDialog() {
 		res = imgC->getMetaData()->getResolution();
 
 	//QPrintPreviewDialog* previewDialog = new QPrintPreviewDialog();
-	QImage img = viewport()->getImage();
+	QImage img = viewport()->getFullImage();
 	if (!mPrintPreviewDialog)
 		mPrintPreviewDialog = new DkPrintPreviewDialog(img, (float)res.x(), 0, this);
 	else
@@ -2301,7 +2304,7 @@ void DkNoMacs::setWindowTitle(QSharedPointer<DkImageContainerT> imgC) {
 		return;
 	}
 
-	setWindowTitle(imgC->filePath(), imgC->image().size(), imgC->isEdited(), imgC->getTitleAttribute());
+	setWindowTitle(imgC->filePath(), imgC->fullSize(), imgC->isEdited(), imgC->getTitleAttribute());
 }
 
 void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool edited, const QString& attr) {
@@ -2329,7 +2332,7 @@ void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool e
 	if (!size.isEmpty())
 		attributes.sprintf(" - %i x %i", size.width(), size.height());
 	if (size.isEmpty() && viewport())
-		attributes.sprintf(" - %i x %i", viewport()->getImage().width(), viewport()->getImage().height());
+		attributes.sprintf(" - %i x %i", viewport()->getImageSize().width(), viewport()->getImageSize().height());
 	if (DkSettingsManager::param().app().privateMode) 
 		attributes.append(tr(" [Private Mode]"));
 
@@ -33,6 +33,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "DkUtils.h"
 #include "DkBasicWidgets.h"
 #include "DkSettingsWidget.h"
+#include "DkThumbs.h"
 
 #pragma warning(push, 0)	// no warnings from includes
 #include <QVBoxLayout>
@@ -935,6 +936,27 @@ void DkFilePreference::createLayout() {
 	historyGroup->addWidget(historyBox);
 	historyGroup->addWidget(hLabel);
 
+	// thumbnail cache size
+	QSpinBox* thumbCacheBox = new QSpinBox(this);
+	thumbCacheBox->setObjectName("thumbCacheBox");
+	thumbCacheBox->setMinimum(0);
+	thumbCacheBox->setMaximum(10240);
+	thumbCacheBox->setSuffix(" MB");
+	thumbCacheBox->setMaximumWidth(200);
+	thumbCacheBox->setValue(DkSettingsManager::param().resources().thumbCacheSize);
+
+	QLabel* tcLabel = new QLabel(tr("Thumbnails are stored on disk so that folders are shown instantly. Set to 0 to disable. [%1-%2 MB]")
+		.arg(thumbCacheBox->minimum()).arg(thumbCacheBox->maximum()), this);
+
+	QPushButton* clearThumbCache = new QPushButton(tr("Clear Thumbnail Cache"), this);
+	clearThumbCache->setObjectName("clearThumbCache");
+	clearThumbCache->setMaximumWidth(200);
+
+	DkGroupWidget* thumbCacheGroup = new DkGroupWidget(tr("Thumbnail Cache Size"), this);
+	thumbCacheGroup->addWidget(thumbCacheBox);
+	thumbCacheGroup->addWidget(tcLabel);
+	thumbCacheGroup->addWidget(clearThumbCache);
+
 
 	// loading policy
 	QVector<QRadioButton*> loadButtons;
@@ -952,9 +974,15 @@ void DkFilePreference::createLayout() {
 	loadButtonGroup->addButton(loadButtons[0], 0);
 	loadButtonGroup->addButton(loadButtons[1], 1);
 
+	QCheckBox* cbDecodeForDisplay = new QCheckBox(tr("Decode Large Images at Screen Resolution"), this);
+	cbDecodeForDisplay->setObjectName("decodeForDisplay");
+	cbDecodeForDisplay->setToolTip(tr("The full resolution is decoded when you zoom in or edit the image."));
+	cbDecodeForDisplay->setChecked(DkSettingsManager::param().resources().decodeForDisplay);
+
 	DkGroupWidget* loadGroup = new DkGroupWidget(tr("Image Loading Policy"), this);
 	loadGroup->addWidget(loadButtons[0]);
 	loadGroup->addWidget(loadButtons[1]);
+	loadGroup->addWidget(cbDecodeForDisplay);
 
 	// skip images
 	QSpinBox* skipBox = new QSpinBox(this);
@@ -973,6 +1001,7 @@ void DkFilePreference::createLayout() {
 	leftLayout->addWidget(tempFolderGroup);
 	leftLayout->addWidget(cacheGroup);
 	leftLayout->addWidget(historyGroup);
+	leftLayout->addWidget(thumbCacheGroup);
 	leftLayout->addWidget(loadGroup);
 	leftLayout->addWidget(skipGroup);
 
@@ -999,6 +1028,12 @@ void DkFilePreference::on_loadGroup_buttonClicked(int buttonId) const {
 
 }
 
+void DkFilePreference::on_decodeForDisplay_toggled(bool checked) const {
+
+	if (DkSettingsManager::param().resources().decodeForDisplay != checked)
+		DkSettingsManager::param().resources().decodeForDisplay = checked;
+}
+
 void DkFilePreference::on_skipBox_valueChanged(int value) const {
 
 	if (DkSettingsManager::param().global().skipImgs != value) {
@@ -1022,6 +1057,19 @@ void DkFilePreference::on_historyBox_valueChanged(int value) const {
 	}
 }
 
+void DkFilePreference::on_thumbCacheBox_valueChanged(int value) const {
+
+	if (DkSettingsManager::param().resources().thumbCacheSize != value) {
+		DkSettingsManager::param().resources().thumbCacheSize = value;
+	}
+}
+
+void DkFilePreference::on_clearThumbCache_clicked() const {
+
+	DkThumbCache::instance().clear();
+	emit infoSignal(tr("Thumbnail cache cleared"));
+}
+
 void DkFilePreference::paintEvent(QPaintEvent *event) {
 
 	// fixes stylesheets which are not applied to custom widgets
@@ -218,9 +218,12 @@ public:
 public slots:
 	void on_dirChooser_directoryChanged(const QString& dirPath) const;
 	void on_loadGroup_buttonClicked(int buttonId) const;
+	void on_decodeForDisplay_toggled(bool checked) const;
 	void on_skipBox_valueChanged(int value) const;
 	void on_cacheBox_valueChanged(int value) const;
 	void on_historyBox_valueChanged(int value) const;
+	void on_thumbCacheBox_valueChanged(int value) const;
+	void on_clearThumbCache_clicked() const;
 
 signals:
 	void infoSignal(const QString& msg) const;
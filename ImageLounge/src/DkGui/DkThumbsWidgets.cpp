@@ -36,6 +36,7 @@
 #include "DkUtils.h"
 #include "DkMessageBox.h"
 #include "DkStatusBar.h"
+#include "DkTaskScheduler.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTimer>
@@ -345,7 +346,7 @@ void DkFilePreview::drawThumbs(QPainter* painter) {
 			break;
 
 		if (thumb->hasImage() == DkThumbNail::not_loaded && 
-			DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading) {
+			!DkTaskScheduler::instance().isBusy(DkTaskScheduler::priority_thumbs)) {
 				thumb->fetchThumb();
 				connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(update()));
 		}
@@ -1042,7 +1043,7 @@ void DkThumbLabel::setVisible(bool visible) {
 void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
 	
 	if (!mFetchingThumb && mThumb->hasImage() == DkThumbNail::not_loaded && 
-		DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading*2) {
+		!DkTaskScheduler::instance().isBusy(DkTaskScheduler::priority_thumbs)) {
 			mThumb->fetchThumb();
 			mFetchingThumb = true;
 	}
@@ -1804,10 +1805,10 @@ void DkThumbsView::dropEvent(QDropEvent *event) {
 
 void DkThumbsView::fetchThumbs() {
 
-	int maxThreads = DkSettingsManager::param().resources().maxThumbsLoading*2;
+	int maxThreads = DkTaskScheduler::instance().maxRunning(DkTaskScheduler::priority_thumbs);
 
 	// don't do anything if it is loading anyway
-	if (DkSettingsManager::param().resources().numThumbsLoading/* > maxThreads*/) {
+	if (DkTaskScheduler::instance().numPending(DkTaskScheduler::priority_thumbs)) {
 		return;
 	}
 
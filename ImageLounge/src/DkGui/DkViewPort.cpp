@@ -208,12 +208,24 @@ void DkViewPort::updateImage(QSharedPointer<DkImageContainerT> image, bool loade
 	}
 
 	// should not happen -> the mLoader should send this signal
-	if (!mLoader)
+	if (!mLoader || !mLoader->hasImage())
 		return;
 
-	if (mLoader->hasImage()) {
-		setImage(mLoader->getImage());
+	QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+
+	// the full resolution arrived - swap it without resetting the view
+	if (isDownscaled() && mDownscaledImg == imgC && !imgC->isDownscaled() && 
+		!imgC->isEdited() && imgC->fullSize() == mFullImageSize) {
+		setFullImage(imgC->displayImage());
+		return;
 	}
+
+	if (imgC->isDownscaled()) {
+		mDownscaledImg = imgC;
+		mFullImageSize = imgC->fullSize();
+	}
+
+	setImage(imgC->displayImage());
 }
 
 void DkViewPort::loadImage(const QImage& newImg) {
@@ -240,7 +252,7 @@ void DkViewPort::loadImage(QSharedPointer<DkImageContainerT> img) {
 
 		if (img->hasImage()) {
 			mLoader->setCurrentImage(img);
-			setImage(img->image());
+			updateImage(img);
 		}
 		mLoader->load(img);
 	}
@@ -258,6 +270,14 @@ void DkViewPort::setImage(QImage newImg) {
 
 	mController->getOverview()->setImage(QImage());	// clear overview
 
+	// anything else than the display image of the current container is rendered as is
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+	if (!imgC || mDownscaledImg != imgC || !imgC->isDownscaled() || 
+		newImg.cacheKey() != imgC->displayImage().cacheKey()) {
+		mDownscaledImg.clear();
+		mFullImageSize = QSize();
+	}
+
 	mImgStorage.setImage(newImg);
 
 	if (mLoader->hasMovie() && !mLoader->isEdited())
@@ -324,7 +344,74 @@ void DkViewPort::setImage(QImage newImg) {
 	// status info
 	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
 	DkStatusBarManager::instance().setMessage(DkUtils::formatToString(newImg.format()), DkStatusBar::status_format_info);
-	DkStatusBarManager::instance().setMessage(QString::number(newImg.width()) + " x " + QString::number(newImg.height()), DkStatusBar::status_dimension_info);
+	DkStatusBarManager::instance().setMessage(QString::number(getImageSize().width()) + " x " + QString::number(getImageSize().height()), DkStatusBar::status_dimension_info);
+}
+
+/**
+ * Replaces the display image with the full resolution image.
+ * The image rect does not change, so the current view is kept.
+ * @param img the full resolution image
+ **/ 
+void DkViewPort::setFullImage(const QImage& img) {
+
+	mDownscaledImg.clear();
+	mFullImageSize = QSize();
+
+	mImgStorage.setImage(img);
+	update();
+}
+
+/**
+ * Requests the full resolution if we zoom beyond the display image.
+ **/ 
+void DkViewPort::loadFullImage() {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (!imgC || mDownscaledImg != imgC)
+		return;
+
+	if (imgC->isDownscaled())
+		imgC->loadFullImageThreaded();
+	else if (!imgC->isEdited() && imgC->fullSize() == mFullImageSize)
+		setFullImage(imgC->displayImage());
+}
+
+bool DkViewPort::isDownscaled() const {
+
+	return mFullImageSize.isValid();
+}
+
+bool DkViewPort::hasImage() const {
+
+	return !DkBaseViewPort::getImage().isNull();
+}
+
+/**
+ * Returns the full resolution image.
+ * Call this if the pixels are edited or exported - getImage() returns the displayed image.
+ * If we render an image decoded at display size, the full image is decoded in the
+ * background while the viewport keeps painting.
+ * @return QImage the current image in full resolution
+ **/ 
+QImage DkViewPort::getFullImage() {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (!isDownscaled() || !imgC || mDownscaledImg != imgC)
+		return getImage();
+
+	imgC->waitForFullImage();
+
+	return imgC->image();
+}
+
+QSize DkViewPort::getImageSize() const {
+
+	if (isDownscaled())
+		return mFullImageSize;
+
+	return DkBaseViewPort::getImageSize();
 }
 
 void DkViewPort::setThumbImage(QImage newImg) {
@@ -567,7 +654,7 @@ void DkViewPort::tcpSetTransforms(QTransform newWorldMatrix, QTransform newImgMa
 		mImgMatrix = newImgMatrix;
 		updateImageMatrix();
 
-		QPointF imgPos = QPointF(canvasSize.x()*mImgStorage.getImage().width(), canvasSize.y()*mImgStorage.getImage().height());
+		QPointF imgPos = QPointF(canvasSize.x()*getImageSize().width(), canvasSize.y()*getImageSize().height());
 
 		// go to screen coordinates
 		imgPos = mImgMatrix.map(imgPos);
@@ -602,7 +689,7 @@ void DkViewPort::tcpSynchronize(QTransform relativeMatrix) {
 		QPointF size = QPointF(geometry().width()/2.0f, geometry().height()/2.0f);
 		size = mWorldMatrix.inverted().map(size);
 		size = mImgMatrix.inverted().map(size);
-		size = QPointF(size.x()/(float)mImgStorage.getImage().width(), size.y()/(float)mImgStorage.getImage().height());
+		size = QPointF(size.x()/(float)getImageSize().width(), size.y()/(float)getImageSize().height());
 
 		emit sendTransformSignal(mWorldMatrix, mImgMatrix, size);
 	}
@@ -702,6 +789,10 @@ void DkViewPort::paintEvent(QPaintEvent* event) {
 			painter.setTransform(swipeTransform);
 		}
 
+		// zoomed beyond the display image - get the full resolution
+		if (isDownscaled() && mImgMatrix.m11()*mWorldMatrix.m11()*mFullImageSize.width()*devicePixelRatio() > mImgStorage.getImageConst().width()+1)
+			loadFullImage();
+
 		// TODO: if fading is active we interpolate with background instead of the other image
 		double opacity = (DkSettingsManager::param().display().transition == DkSettings::trans_fade) ? 1.0 - mAnimationValue : 1.0;
 		draw(painter, opacity);
@@ -872,6 +963,9 @@ void DkViewPort::resizeEvent(QResizeEvent *event) {
 
 	mViewportRect = QRect(0, 0, width(), height());
 
+	// images are decoded at this size (if supported)
+	DkImageContainer::setDisplaySize(size()*devicePixelRatio());
+
 	// >DIR: diem - bug if zoom factor is large and window becomes small
 	updateImageMatrix();
 	centerImage();
@@ -1138,7 +1232,9 @@ QPoint DkViewPort::mapToImage(const QPoint& windowPos) const {
 
 	QPoint xy(qFloor(imgPos.x()), qFloor(imgPos.y()));
 
-	if (xy.x() < 0 || xy.y() < 0 || xy.x() >= mImgStorage.getImageConst().width() || xy.y() >= mImgStorage.getImageConst().height())
+	QSize imgSize = getImageSize();
+
+	if (xy.x() < 0 || xy.y() < 0 || xy.x() >= imgSize.width() || xy.y() >= imgSize.height())
 		return QPoint(-1,-1);
 
 	return xy;
@@ -1154,7 +1250,7 @@ void DkViewPort::getPixelInfo(const QPoint& pos) {
 	if (xy.x() == -1 || xy.y() == -1)
 		return;
 
-	QColor col = mImgStorage.getImage().pixel(xy);
+	QColor col = pixelColor(xy);
 	
 	QString msg = "<font color=#555555>x: " + QString::number(xy.x()) + " y: " + QString::number(xy.y()) + "</font>"
 		" | r: " + QString::number(col.red()) + " g: " + QString::number(col.green()) + " b: " + QString::number(col.blue());
@@ -1177,14 +1273,34 @@ QString DkViewPort::getCurrentPixelHexValue() {
 
 	QPoint xy(qFloor(imgPos.x()), qFloor(imgPos.y()));
 
-	if (xy.x() < 0 || xy.y() < 0 || xy.x() >= mImgStorage.getImage().width() || xy.y() >= mImgStorage.getImage().height())
+	if (xy.x() < 0 || xy.y() < 0 || xy.x() >= getImageSize().width() || xy.y() >= getImageSize().height())
 		return QString();
 
-	QColor col = mImgStorage.getImage().pixel(xy);
+	QColor col = pixelColor(xy);
 	
 	return col.name().toUpper().remove(0,1);
 }
 
+/**
+ * Returns the color at the given image position.
+ * The position is mapped to the stored image which might be decoded at display size.
+ * @param imgPos the position in image coordinates
+ * @return QColor the pixel's color
+ **/ 
+QColor DkViewPort::pixelColor(const QPoint& imgPos) const {
+
+	QImage img = mImgStorage.getImageConst();
+	QSize imgSize = getImageSize();
+
+	if (img.size() == imgSize || imgSize.isEmpty())
+		return img.pixel(imgPos);
+
+	QPoint xy(qMin(imgPos.x()*img.width()/imgSize.width(), img.width()-1), 
+		qMin(imgPos.y()*img.height()/imgSize.height(), img.height()-1));
+
+	return img.pixel(xy);
+}
+
 // Copy & Paste --------------------------------------------------------
 void DkViewPort::copyPixelColorValue() {
 
@@ -1234,13 +1350,11 @@ void DkViewPort::copyImageBuffer() {
 
 	qDebug() << "copying...";
 
-	if (getImage().isNull())
+	if (!hasImage())
 		return;
 
 	QMimeData* mimeData = new QMimeData;
-
-	if (!getImage().isNull())
-		mimeData->setImageData(getImage());
+	mimeData->setImageData(getFullImage());
 
 	QClipboard* clipboard = QApplication::clipboard();
 	clipboard->setMimeData(mimeData);
@@ -2278,7 +2392,7 @@ void DkViewPortContrast::draw(QPainter & painter, double opacity) {
 	}
 
 	if (mDrawFalseColorImg)
-		painter.drawImage(mImgViewRect, mFalseColorImg, mImgRect);
+		painter.drawImage(mImgViewRect, mFalseColorImg, mFalseColorImg.rect());	// might be decoded at display size
 }
 
 void DkViewPortContrast::setImage(QImage newImg) {
@@ -2428,7 +2542,7 @@ QImage DkViewPortContrast::getImage() const {
 	if (mDrawFalseColorImg)
 		return mFalseColorImg;
 	else
-		return mImgStorage.getImageConst();
+		return DkViewPort::getImage();
 
 }
 
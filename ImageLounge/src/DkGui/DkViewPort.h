@@ -108,6 +108,11 @@ public:
 	
 	QString getCurrentPixelHexValue();
 	QPoint mapToImage(const QPoint& windowPos) const;
+
+	QImage getFullImage();
+	QSize getImageSize() const override;
+	bool hasImage() const;
+	bool isDownscaled() const;
 	
 	void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
 
@@ -230,6 +235,10 @@ protected:
 	
 	DkRotatingRect mCropRect;
 
+	// the image that is rendered at display resolution
+	QWeakPointer<DkImageContainerT> mDownscaledImg;
+	QSize mFullImageSize;
+
 	// functions
 	virtual int swipeRecognition(QPoint start, QPoint end);
 	virtual void swipeAction(int swipeGesture);
@@ -241,6 +250,9 @@ protected:
 	void showZoom();
 	void toggleLena(bool fullscreen);
 	void getPixelInfo(const QPoint& pos);
+	QColor pixelColor(const QPoint& imgPos) const;
+	void loadFullImage();
+	void setFullImage(const QImage& img);
 
 };
 
@@ -36,6 +36,7 @@
 #include "DkSettings.h"
 #include "DkStatusBar.h"
 #include "DkActionManager.h"
+#include "DkTaskScheduler.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QMainWindow>
@@ -334,7 +335,8 @@ void DkThumbsSaver::loadNext() {
 	if (mStop)
 		return;
 
-	int missing = DkSettingsManager::param().resources().maxThumbsLoading-DkSettingsManager::param().resources().numThumbsLoading;
+	// at least one - the thumb that just finished might still be counted
+	int missing = qMax(1, DkTaskScheduler::instance().maxRunning(DkTaskScheduler::priority_batch)-DkTaskScheduler::instance().numPending(DkTaskScheduler::priority_batch));
 	int numLoading = mCLoadIdx+missing;
 	int force = (mForceSave) ? DkThumbNail::force_save_thumb : DkThumbNail::save_thumb;
 
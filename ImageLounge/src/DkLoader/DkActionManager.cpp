@@ -427,6 +427,7 @@ QMenu * DkActionManager::createSortMenu(QWidget * parent) {
 	
 	mSortMenu = new QMenu(QObject::tr("S&ort"), parent);
 	mSortMenu->addAction(mSortActions[menu_sort_filename]);
+	mSortMenu->addAction(mSortActions[menu_sort_date_taken]);
 	mSortMenu->addAction(mSortActions[menu_sort_date_created]);
 	mSortMenu->addAction(mSortActions[menu_sort_date_modified]);
 	mSortMenu->addAction(mSortActions[menu_sort_random]);
@@ -1044,6 +1045,12 @@ void DkActionManager::createActions(QWidget* parent) {
 	mSortActions[menu_sort_random]->setCheckable(true);
 	mSortActions[menu_sort_random]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_random);
 
+	mSortActions[menu_sort_date_taken] = new QAction(QObject::tr("by Date &Taken"), parent);
+	mSortActions[menu_sort_date_taken]->setObjectName("menu_sort_date_taken");
+	mSortActions[menu_sort_date_taken]->setStatusTip(QObject::tr("Sort by the Date the Image was Taken"));
+	mSortActions[menu_sort_date_taken]->setCheckable(true);
+	mSortActions[menu_sort_date_taken]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_date_taken);
+
 	mSortActions[menu_sort_ascending] = new QAction(QObject::tr("&Ascending"), parent);
 	mSortActions[menu_sort_ascending]->setObjectName("menu_sort_ascending");
 	mSortActions[menu_sort_ascending]->setStatusTip(QObject::tr("Sort in Ascending Order"));
@@ -554,7 +554,15 @@ void DkBaseViewPort::draw(QPainter & painter, double opacity) {
 		painter.setWorldMatrixEnabled(true);
 	}
 
-	QImage imgQt = mImgStorage.getImage((float)(mImgMatrix.m11()*mWorldMatrix.m11()));
+	float factor = (float)(mImgMatrix.m11()*mWorldMatrix.m11());
+
+	// the stored image might be smaller than the image rect (decoded at display size)
+	double scale = 1.0;
+	if (mImgRect.width() > 0 && mImgStorage.hasImage())
+		scale = mImgStorage.getImageConst().width()/mImgRect.width();
+	factor = (float)(factor/scale);
+
+	QImage imgQt = mImgStorage.getImage(factor);
 
 	// opacity == 1.0f -> do not show pattern if we crossfade two images
 	if (DkSettingsManager::param().display().tpPattern && imgQt.hasAlphaChannel() && opacity == 1.0f) {
@@ -577,8 +585,12 @@ void DkBaseViewPort::draw(QPainter & painter, double opacity) {
 	}
 	else if (mMovie && mMovie->isValid())
 		painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
-	else
-		painter.drawImage(mImgViewRect, imgQt, imgQt.rect());
+	else {
+		// the image region that is currently visible
+		QRectF visibleRect = (mImgMatrix*mWorldMatrix).inverted().mapRect(QRectF(mViewportRect)) & mImgRect;
+		visibleRect = QRectF(visibleRect.topLeft()*scale, visibleRect.size()*scale);
+		mImgStorage.draw(painter, mImgViewRect, visibleRect, factor);
+	}
 
 	painter.setOpacity(oldOp);
 
@@ -45,8 +45,11 @@
 #include <QBuffer>
 #include <QNetworkProxyFactory>
 #include <QPixmap>
-#include <QIcon>
 #include <QDebug>
+#include <QSaveFile>
+#if QT_VERSION >= 0x050400
+#include <QStorageInfo>
+#endif
 
 #include <qmath.h>
 
@@ -187,6 +190,9 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 					qWarning() << "deleting illegal EXIV orientation...";
 				}
 			}
+
+			// share what we parsed with thumbnails & co
+			DkMetaDataCache::instance().insert(filePath, QSharedPointer<DkMetaDataRecord>(new DkMetaDataRecord(*mMetaData, filePath)));
 		}
 		catch (...) {}	// ignore if we cannot read the metadata
 	}
@@ -206,25 +212,34 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 			mLoader = qt_loader;
 	}
 
-	// load large icons
+	// load large icons - QIcon would need a QGuiApplication (and the GUI thread)
 	if (!imgLoaded && suf == "ico") {
 
-		QIcon icon(mFile);
+		QImageReader reader(mFile, "ico");
 
-		if (!icon.isNull()) {
-			img = icon.pixmap(QSize(256, 256)).toImage();
-			imgLoaded = true;
+		for (int idx = 0; idx < reader.imageCount(); idx++) {
+
+			QImage cImg;
+
+			if (reader.jumpToImage(idx) && reader.read(&cImg) && cImg.width() > img.width())
+				img = cImg;
 		}
+
+		imgLoaded = !img.isNull();
 	}
 
 	// default Qt loader
 	// here we just try those formats that are officially supported
 	if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str())) {
 
+		// decode directly to the display size if the format supports it
+		if (mDisplaySize.isValid())
+			imgLoaded = loadScaledFile(mFile, img, ba);
+
 		// if image has Indexed8 + alpha channel -> we crash... sorry for that
-		if (!ba || ba->isEmpty())
+		if (!imgLoaded && (!ba || ba->isEmpty()))
 			imgLoaded = img.load(mFile, suf.toStdString().c_str());
-		else
+		else if (!imgLoaded)
 			imgLoaded = img.loadFromData(*ba.data(), suf.toStdString().c_str());	// toStdString() in order get 1 byte per char
 
 		if (imgLoaded) mLoader = qt_loader;
@@ -251,7 +266,10 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		
 		// TODO: sometimes (e.g. _DSC6289.tif) strange opencv errors are thrown - catch them!
 		// load raw files
-		imgLoaded = loadRawFile(mFile, img, ba, fast);
+		if (mDisplaySize.isValid() && !fast)
+			imgLoaded = loadRawPreview(mFile, img, ba);
+		if (!imgLoaded)
+			imgLoaded = loadRawFile(mFile, img, ba, fast);
 		if (imgLoaded) mLoader = raw_loader;
 	}
 
@@ -260,9 +278,8 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 
 		// if we first load files to buffers, we can additionally load images with wrong extensions (rainer bugfix : )
 		// TODO: add warning here
-		QByteArray lba;
-		loadFileToBuffer(mFile, lba);
-		imgLoaded = img.loadFromData(lba);
+		QSharedPointer<QByteArray> lba = (ba && !ba->isEmpty()) ? ba : loadFileToBuffer(mFile);
+		imgLoaded = img.loadFromData(*lba);
 		
 		if (imgLoaded) mLoader = qt_loader;
 	}  
@@ -300,9 +317,13 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 			mMetaData->setQtValues(img);
 			int orientation = mMetaData->getOrientationDegree();
 
-			if (orientation != -1 && !mMetaData->isTiff() && !DkSettingsManager::param().metaData().ignoreExifOrientation)
+			if (orientation != -1 && !mMetaData->isTiff() && !DkSettingsManager::param().metaData().ignoreExifOrientation) {
 				img = rotate(img, orientation);
 
+				if (mDownscaled && qAbs(orientation) == 90)
+					mFullSize.transpose();
+			}
+
 		} catch(...) {}	// ignore if we cannot read the metadata
 	}
 	else if (!mMetaData) {
@@ -317,6 +338,134 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 	return imgLoaded;
 }
 
+/**
+ * Decodes the image directly to the display size.
+ * This is only done if the image handler supports scaled decoding
+ * (e.g. DCT scaling of jpgs) and if the image is at least twice
+ * as large as the display.
+ * @param filePath the image's file path.
+ * @param img the downscaled image.
+ * @param ba the file buffer (might be empty).
+ * @return bool true if a downscaled image was decoded.
+ **/
+bool DkBasicLoader::loadScaledFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba) {
+
+	QBuffer buffer;
+	QImageReader reader;
+
+	if (ba && !ba->isEmpty()) {
+		buffer.setData(*ba);
+		buffer.open(QIODevice::ReadOnly);
+		reader.setDevice(&buffer);
+		reader.setFormat(QFileInfo(filePath).suffix().toLower().toLatin1());
+	}
+	else
+		reader.setFileName(filePath);
+
+	if (!reader.supportsOption(QImageIOHandler::ScaledSize))
+		return false;
+
+	QSize fullSize = reader.size();
+
+	if (fullSize.isEmpty())
+		return false;
+
+	QSize scaledSize = fullSize.scaled(orientedDisplaySize(), Qt::KeepAspectRatio);
+
+	// not worth it - decode the full image
+	if (scaledSize.isEmpty() || scaledSize.width()*2 > fullSize.width())
+		return false;
+
+	reader.setScaledSize(scaledSize);
+
+	if (!reader.read(&img)) {
+		qDebug() << "scaled decoding failed:" << reader.errorString();
+		img = QImage();
+		return false;
+	}
+
+	mFullSize = fullSize;
+	mDownscaled = true;
+	qDebug() << "[Scaled] decoded" << img.size() << "of" << fullSize;
+
+	return true;
+}
+
+/**
+ * Loads the embedded preview of RAW files if it covers the display.
+ * The full RAW image is developed as soon as the user needs it (zoom, edit).
+ * @param filePath the RAW file path.
+ * @param img the preview image.
+ * @param ba the file buffer (might be empty).
+ * @return bool true if a preview was loaded.
+ **/
+bool DkBasicLoader::loadRawPreview(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba) {
+
+	if (!mMetaData || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_never)
+		return false;
+
+	try {
+		if (!mMetaData->isLoaded())
+			mMetaData->readMetaData(filePath, ba);
+
+		// decode the preview directly to the display size
+		QSize ds = orientedDisplaySize();
+		img = DkEmbeddedPreview::load(filePath, ds, ds.width()-1, ba);
+
+		if (img.isNull())
+			img = mMetaData->getPreviewImage(ds.width()-1);
+	}
+	catch (...) {
+		img = QImage();
+	}
+
+	if (img.isNull())
+		return false;
+
+	QSize fullSize = mMetaData->getImageSize();
+	mFullSize = fullSize.width() > img.width() ? fullSize : img.size();
+	mDownscaled = true;
+	qDebug() << "[RAW] preview decoded" << img.size() << "of" << mFullSize;
+
+	return true;
+}
+
+/**
+ * Returns the display size with respect to the EXIF orientation.
+ * Images are decoded before they are rotated.
+ * @return QSize the display size in the image's native orientation.
+ **/
+QSize DkBasicLoader::orientedDisplaySize() const {
+
+	QSize s = mDisplaySize;
+
+	if (mMetaData && !DkSettingsManager::param().metaData().ignoreExifOrientation &&
+		qAbs(mMetaData->getOrientationDegree()) == 90)
+		s.transpose();
+
+	return s;
+}
+
+void DkBasicLoader::setDisplaySize(const QSize& displaySize) {
+	mDisplaySize = displaySize;
+}
+
+QSize DkBasicLoader::displaySize() const {
+	return mDisplaySize;
+}
+
+bool DkBasicLoader::isDownscaled() const {
+	return mDownscaled && !mImages.empty();
+}
+
+QSize DkBasicLoader::fullSize() const {
+	
+	if (isDownscaled() && mFullSize.isValid())
+		return mFullSize;
+
+	return image().size();
+}
+
 /**
  * Loads special RAW files that are generated by the Hamamatsu camera.
  * @param fileName the filename of the file to be loaded.
@@ -404,7 +553,9 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QImage& img, QSharedPoi
 			if (fast || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
 				DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
 
-				mMetaData->readMetaData(filePath, ba);
+				// loadGeneral() parsed it already
+				if (!mMetaData->isLoaded())
+					mMetaData->readMetaData(filePath, ba);
 
 				int minWidth = 0;
 
@@ -412,7 +563,10 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QImage& img, QSharedPoi
 				if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
 					minWidth = 1920;
 #endif
-				img = mMetaData->getPreviewImage(minWidth);
+				img = DkEmbeddedPreview::load(filePath, QSize(), minWidth, ba);
+
+				if (img.isNull())
+					img = mMetaData->getPreviewImage(minWidth);
 
 				if (!img.isNull()) {
 					//setEditImage(img, tr("Original Image"));
@@ -906,30 +1060,27 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileIn
 		return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo));
 #endif
 
-	QFile file(fileInfo);
-	file.open(QIODevice::ReadOnly);
-
-	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-	file.close();
-
-	return ba;
+	return DkFileBuffer::load(fileInfo);
 }
 
-bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const {
+bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) {
 
 	if (!ba || ba->isEmpty())
 		return false;
 
-	QFile file(fileInfo);
+	// the file is written to a temporary file and renamed afterwards:
+	// buffers that are still mapped (see DkFileBuffer) keep the old file's data
+	QSaveFile file(fileInfo);
 	file.open(QIODevice::WriteOnly);
 	qint64 bytesWritten = file.write(*ba.data(), ba->size());
-	file.close();
 	qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
 
-	if (!bytesWritten || bytesWritten == -1)
+	if (!bytesWritten || bytesWritten == -1) {
+		file.cancelWriting();
 		return false;
+	}
 
-	return true;
+	return file.commit();
 }
 
 void DkBasicLoader::indexPages(const QString& filePath) {
@@ -1157,14 +1308,20 @@ bool DkBasicLoader::saveToBuffer(const QString& filePath, const QImage& img, QSh
 
 	if (saved && mMetaData) {
 		
-		if (!mMetaData->isLoaded() || !mMetaData->hasMetaData())
+		// meta data read from the new buffer references it - so it cannot be spliced in
+		bool decodedMetaData = mMetaData->isLoaded() && mMetaData->hasMetaData();
+
+		if (!decodedMetaData)
 			mMetaData->readMetaData(filePath, ba);
 
 		if (mMetaData->isLoaded()) {
 			try {
 				mMetaData->updateImageMetaData(img);
 				//mMetaData->printMetaData();	// debug
-				mMetaData->saveMetaData(ba, true);
+
+				// jpgs get the segments inserted - everything else is rewritten by exiv2
+				if (!decodedMetaData || !mMetaData->insertJpgSegments(ba))
+					mMetaData->saveMetaData(ba, true);
 			} 
 			catch (...) {
 				// is it still throwing anything?
@@ -1264,6 +1421,8 @@ void DkBasicLoader::release(bool clear) {
 	saveMetaData(mFile);
 
 	mImages.clear();
+	mDownscaled = false;
+	mFullSize = QSize();
 	//metaData.clear();
 	
 	// TODO: where should we clear the metadata?
@@ -1609,6 +1768,172 @@ int DkBasicLoader::mergeVecFiles(const QStringList& vecFilePaths, QString& saveF
 
 #endif // #ifdef WITH_OPENCV
 
+// DkFileBuffer --------------------------------------------------------------------
+/**
+ * Returns a shared buffer of the file's content.
+ * The file is mapped if possible and read otherwise.
+ * @param filePath the file to be loaded
+ * @return QSharedPointer<QByteArray> the file's content (empty if the file could not be read)
+ **/ 
+QSharedPointer<QByteArray> DkFileBuffer::load(const QString& filePath) {
+
+	QSharedPointer<QByteArray> ba = map(filePath);
+
+	if (ba)
+		return ba;
+
+	QFile file(filePath);
+	file.open(QIODevice::ReadOnly);
+
+	ba = QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+	file.close();
+
+	return ba;
+}
+
+/**
+ * Maps a file into memory.
+ * @param filePath the file to be mapped
+ * @return QSharedPointer<QByteArray> the mapped file or a null pointer if the file cannot be mapped
+ **/ 
+QSharedPointer<QByteArray> DkFileBuffer::map(const QString& filePath) {
+
+	if (!isMappable(filePath))
+		return QSharedPointer<QByteArray>();
+
+	QFile* file = new QFile(filePath);
+	uchar* data = 0;
+
+	if (file->open(QIODevice::ReadOnly) && 
+		file->size() >= min_map_size && 
+		file->size() < INT_MAX)
+		data = file->map(0, file->size());
+
+	if (!data) {
+		delete file;
+		return QSharedPointer<QByteArray>();
+	}
+
+	int size = (int)file->size();
+	file->close();	// the mapping stays valid until we unmap it
+
+	return QSharedPointer<QByteArray>(new QByteArray(QByteArray::fromRawData((const char*)data, size)),
+		[file, data](QByteArray* ba) {
+			delete ba;
+			file->unmap(data);
+			delete file;
+	});
+}
+
+/**
+ * Returns true if the file is on a local drive where it can be mapped safely.
+ * @param filePath the file's path
+ * @return bool true if the file should be mapped
+ **/ 
+bool DkFileBuffer::isMappable(const QString& filePath) {
+
+#ifdef Q_OS_WIN
+	// mapped views lock the file on windows - and we need to rename, delete & overwrite the files we show
+	Q_UNUSED(filePath);
+	return false;
+#else
+
+	if (filePath.startsWith("//"))
+		return false;
+
+#if QT_VERSION >= 0x050400
+	// pages of network files might vanish while they are mapped
+	QString fs = QStorageInfo(QFileInfo(filePath).absolutePath()).fileSystemType().toLower();
+
+	if (fs.startsWith("nfs") || fs.startsWith("cifs") || fs.startsWith("smb") || 
+		fs.startsWith("fuse") || fs == "afpfs" || fs == "webdav" || fs == "9p")
+		return false;
+#endif
+
+	return true;
+#endif
+}
+
+// DkEmbeddedPreview --------------------------------------------------------------------
+/**
+ * Decodes the largest embedded jpg.
+ * @param filePath the file path
+ * @param maxSize the preview is decoded (DCT scaled) to fit this size - invalid sizes decode the full preview
+ * @param minWidth previews that are not wider are rejected
+ * @param ba the file buffer (optional) - the file is mapped if it is empty
+ * @return QImage the preview - null if there is no (large enough) preview
+ **/ 
+QImage DkEmbeddedPreview::load(const QString& filePath, const QSize& maxSize, int minWidth, QSharedPointer<QByteArray> ba) {
+
+	DkTimer dt;
+	DkExifScanner scanner;
+	bool scanned = (ba && !ba->isEmpty()) ? scanner.scan(*ba) : scanner.scan(filePath);
+
+	QVector<DkExifScanner::Region> previews = scanner.previews();
+
+	if (!scanned || previews.empty())
+		return QImage();
+
+	QSharedPointer<QByteArray> fileBuffer = (ba && !ba->isEmpty()) ? ba : DkFileBuffer::map(filePath);
+	QFile file;		// regions are read if the file cannot be mapped
+
+	for (const DkExifScanner::Region& r : previews) {
+
+		QByteArray data;
+
+		if (fileBuffer) {
+
+			if (r.offset < 0 || r.offset + r.size > fileBuffer->size())
+				continue;
+
+			// no copy - the buffer outlives the reader
+			data = QByteArray::fromRawData(fileBuffer->constData() + r.offset, (int)r.size);
+		}
+		else {
+
+			if (!file.isOpen()) {
+				file.setFileName(filePath);
+				if (!file.open(QIODevice::ReadOnly))
+					return QImage();
+			}
+
+			if (r.size > file.size() || !file.seek(r.offset))
+				continue;
+
+			data = file.read(r.size);
+		}
+
+		if (data.size() < 2 || (uchar)data[0] != 0xFF || (uchar)data[1] != 0xD8)
+			continue;
+
+		QBuffer buffer;
+		buffer.setData(data);	// shallow copy
+		buffer.open(QIODevice::ReadOnly);
+
+		QImageReader reader(&buffer, "jpg");
+		QSize size = reader.size();
+
+		// e.g. lossless jpgs
+		if (size.isEmpty())
+			continue;
+
+		// the previews are sorted by size - so the others will not be wider
+		if (size.width() <= minWidth)
+			break;
+
+		if (maxSize.isValid() && (size.width() > maxSize.width() || size.height() > maxSize.height()))
+			reader.setScaledSize(size.scaled(maxSize, Qt::KeepAspectRatio));
+
+		QImage img;
+		if (reader.read(&img)) {
+			qDebug() << "[DkEmbeddedPreview]" << img.size() << "of" << size << "decoded in" << dt;
+			return img;
+		}
+	}
+
+	return QImage();
+}
+
 // FileDownloader --------------------------------------------------------------------
 FileDownloader::FileDownloader(QUrl imageUrl, QObject *parent) : QObject(parent) {
 	QNetworkProxyQuery npq(QUrl("http://www.nomacs.org"));
@@ -1656,6 +1981,301 @@ QUrl FileDownloader::getUrl() const {
 
 #ifdef WITH_QUAZIP
 
+// DkZipArchive --------------------------------------------------------------------
+QMutex DkZipArchive::mArchivesMutex;
+QList<QSharedPointer<DkZipArchive> > DkZipArchive::mArchives;
+
+DkZipArchive::DkZipArchive(const QString& zipPath) {
+
+	QFileInfo fInfo(zipPath);
+
+	mZipPath = zipPath;
+	mFileSize = fInfo.size();
+	mModified = fInfo.lastModified();
+	mValid = index();
+
+	// stored entries are then served without copying
+	if (mValid)
+		mMap = DkFileBuffer::map(zipPath);
+}
+
+DkZipArchive::~DkZipArchive() {
+
+	for (QuaZip* zip : mHandles) {
+		zip->close();
+		delete zip;
+	}
+}
+
+/**
+ * Returns the archive.
+ * Recently used archives are kept open - they are reopened if the file was modified.
+ * @param zipPath the archive's file path
+ * @return QSharedPointer<DkZipArchive> the archive (never NULL - see isValid())
+ **/ 
+QSharedPointer<DkZipArchive> DkZipArchive::open(const QString& zipPath) {
+
+	QFileInfo fInfo(zipPath);
+
+	QMutexLocker locker(&mArchivesMutex);
+
+	for (int idx = 0; idx < mArchives.size(); idx++) {
+
+		QSharedPointer<DkZipArchive> a = mArchives[idx];
+
+		if (a->zipPath() == zipPath) {
+
+			mArchives.removeAt(idx);
+
+			if (a->mFileSize == fInfo.size() && a->mModified == fInfo.lastModified()) {
+				mArchives.prepend(a);
+				return a;
+			}
+
+			break;
+		}
+	}
+
+	// parsing is done while the cache is locked - so no archive is indexed twice
+	QSharedPointer<DkZipArchive> a(new DkZipArchive(zipPath));
+	mArchives.prepend(a);
+
+	while (mArchives.size() > max_archives)
+		mArchives.removeLast();
+
+	return a;
+}
+
+/**
+ * Releases an archive that was opened with open().
+ * The unzip handles are closed as soon as no extraction is running anymore.
+ * The mapping is unmapped once all extracted entries are released.
+ * @param zipPath the archive's file path
+ **/ 
+void DkZipArchive::close(const QString& zipPath) {
+
+	QMutexLocker locker(&mArchivesMutex);
+
+	for (int idx = 0; idx < mArchives.size(); idx++) {
+
+		if (mArchives[idx]->zipPath() == zipPath) {
+			mArchives.removeAt(idx);
+			break;
+		}
+	}
+}
+
+bool DkZipArchive::isValid() const {
+
+	return mValid;
+}
+
+QString DkZipArchive::zipPath() const {
+
+	return mZipPath;
+}
+
+/**
+ * Returns the names of all files in the archive (in the archive's order).
+ * @return QStringList the file names (relative to the archive's root)
+ **/ 
+QStringList DkZipArchive::fileNames() const {
+
+	QStringList names;
+	names.reserve(mEntries.size());
+
+	for (const Entry& e : mEntries)
+		names << e.name;
+
+	return names;
+}
+
+int DkZipArchive::indexOf(const QString& fileName) const {
+
+	return mIndex.value(fileName, -1);
+}
+
+QSharedPointer<QByteArray> DkZipArchive::extract(const QString& fileName) {
+
+	return extract(indexOf(fileName));
+}
+
+/**
+ * Extracts an entry.
+ * Stored entries point into the mapped archive: keep the shared pointer
+ * alive while the data is used and do not copy the QByteArray out of it
+ * (copies share the mapping without keeping it alive).
+ * @param idx the entry's index (see indexOf())
+ * @return QSharedPointer<QByteArray> the entry's content (empty if it could not be extracted)
+ **/ 
+QSharedPointer<QByteArray> DkZipArchive::extract(int idx) {
+
+	if (idx < 0 || idx >= mEntries.size())
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	const Entry& e = mEntries[idx];
+
+	if (e.stored && mMap) {
+
+		qint64 offset = dataOffset(idx);
+
+		if (offset >= 0 && offset + e.size <= mMap->size()) {
+
+			// the slice keeps the mapping alive
+			QSharedPointer<QByteArray> map = mMap;
+			return QSharedPointer<QByteArray>(new QByteArray(QByteArray::fromRawData(map->constData() + offset, (int)e.size)),
+				[map](QByteArray* ba) {
+					delete ba;
+			});
+		}
+	}
+
+	QSharedPointer<QByteArray> ba(new QByteArray());
+	QuaZip* zip = acquire();
+
+	if (!zip)
+		return ba;
+
+	unzFile uf = zip->getUnzFile();
+	unz64_file_pos pos;
+	pos.pos_in_zip_directory = e.dirPos;
+	pos.num_of_file = e.fileNum;
+
+	if (unzGoToFilePos64(uf, &pos) == UNZ_OK && unzOpenCurrentFile(uf) == UNZ_OK) {
+
+		ba->resize((int)e.size);
+		int read = e.size > 0 ? unzReadCurrentFile(uf, ba->data(), (unsigned)e.size) : 0;
+
+		// the crc is checked on close
+		if (unzCloseCurrentFile(uf) != UNZ_OK || read != e.size) {
+			qWarning() << "[DkZipArchive] could not extract" << e.name << "from" << mZipPath;
+			ba->clear();
+		}
+	}
+
+	release(zip);
+
+	return ba;
+}
+
+/**
+ * Parses the central directory.
+ * @return bool true if the archive could be opened
+ **/ 
+bool DkZipArchive::index() {
+
+	DkTimer dt;
+
+	QuaZip* zip = acquire();
+
+	if (!zip)
+		return false;
+
+	unzFile uf = zip->getUnzFile();
+
+	for (bool more = zip->goToFirstFile(); more; more = zip->goToNextFile()) {
+
+		QuaZipFileInfo64 info;
+		unz64_file_pos pos;
+
+		if (!zip->getCurrentFileInfo(&info) || unzGetFilePos64(uf, &pos) != UNZ_OK)
+			continue;
+
+		// skip folders
+		if (info.name.endsWith("/"))
+			continue;
+
+		Entry e;
+		e.name = info.name;
+		e.dirPos = pos.pos_in_zip_directory;
+		e.fileNum = pos.num_of_file;
+		e.size = (qint64)info.uncompressedSize;
+		e.stored = info.method == 0 && !(info.flags & 1);
+
+		// QByteArrays are limited to 2GB
+		if (e.size >= INT_MAX)
+			continue;
+
+		mIndex.insert(e.name, mEntries.size());
+		mEntries << e;
+	}
+
+	release(zip);
+
+	qDebug() << "[DkZipArchive]" << mEntries.size() << "entries of" << mZipPath << "indexed in" << dt;
+
+	return true;
+}
+
+/**
+ * Returns the offset of a stored entry's data in the archive.
+ * The local header is read on first access only.
+ * @param idx the entry's index
+ * @return qint64 the offset - -1 if it could not be located
+ **/ 
+qint64 DkZipArchive::dataOffset(int idx) {
+
+	{
+		QMutexLocker locker(&mMutex);
+		if (mEntries[idx].dataOffset != -1)
+			return mEntries[idx].dataOffset;
+	}
+
+	QuaZip* zip = acquire();
+
+	if (!zip)
+		return -1;
+
+	unzFile uf = zip->getUnzFile();
+	unz64_file_pos pos;
+	pos.pos_in_zip_directory = mEntries[idx].dirPos;
+	pos.num_of_file = mEntries[idx].fileNum;
+
+	qint64 offset = -1;
+
+	if (unzGoToFilePos64(uf, &pos) == UNZ_OK && unzOpenCurrentFile(uf) == UNZ_OK) {
+		offset = (qint64)unzGetCurrentFileZStreamPos64(uf);
+		unzCloseCurrentFile(uf);
+	}
+
+	release(zip);
+
+	QMutexLocker locker(&mMutex);
+	mEntries[idx].dataOffset = offset;
+
+	return offset;
+}
+
+/**
+ * Returns an unused unzip handle - it is opened if needed.
+ * @return QuaZip* the handle - NULL if the archive cannot be opened
+ **/ 
+QuaZip* DkZipArchive::acquire() {
+
+	{
+		QMutexLocker locker(&mMutex);
+
+		if (!mHandles.empty())
+			return mHandles.takeLast();
+	}
+
+	QuaZip* zip = new QuaZip(mZipPath);
+
+	if (!zip->open(QuaZip::mdUnzip)) {
+		qWarning() << "[DkZipArchive] could not open" << mZipPath;
+		delete zip;
+		return 0;
+	}
+
+	return zip;
+}
+
+void DkZipArchive::release(QuaZip* zip) {
+
+	QMutexLocker locker(&mMutex);
+	mHandles << zip;
+}
+
 // DkZipContainer --------------------------------------------------------------------
 DkZipContainer::DkZipContainer(const QString& encodedFilePath) {
 
@@ -1702,44 +2322,25 @@ QString DkZipContainer::decodeImageFile(const QString& encodedFileInfo) {
 	return tmp;
 }
 
+/**
+ * Extracts an image from the zip archive.
+ * The data might point into the mapped archive - see DkZipArchive::extract().
+ * @param zipFile the archive's file path
+ * @param imageFile the image's path within the archive
+ * @return QSharedPointer<QByteArray> the image's content - keep it alive while the data is used
+ **/ 
 QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile) {
 
-	QuaZip zip(zipFile);		
-	if(!zip.open(QuaZip::mdUnzip)) 
-		return QSharedPointer<QByteArray>(new QByteArray());
-
-	qDebug() << "DkZip::extractImage filePath: " << zipFile;
-	qDebug() << "3.0 image file" << imageFile;
-
-	zip.setCurrentFile(imageFile);
-	QuaZipFile extractedFile(&zip);
-	if(!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK) 
-		return QSharedPointer<QByteArray>(new QByteArray());
-
-	QSharedPointer<QByteArray> ba(new QByteArray(extractedFile.readAll()));
-	extractedFile.close();
-
-	zip.close();
-
-	return ba;
+	return DkZipArchive::open(zipFile)->extract(imageFile);
 }
 
 void DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile, QByteArray& ba) {
 
-	QuaZip zip(zipFile);		
-	if(!zip.open(QuaZip::mdUnzip)) 
-		return;
-
-	zip.setCurrentFile(imageFile);
-	QuaZipFile extractedFile(&zip);
-	if(!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK) 
-		return;
-
-	ba = QByteArray(extractedFile.readAll());
-	extractedFile.close();
-
-	zip.close();
+	QSharedPointer<QByteArray> cba = DkZipArchive::open(zipFile)->extract(imageFile);
 
+	// deep copy - the buffer might point into the mapped archive
+	if (!cba->isEmpty())
+		ba = QByteArray(cba->constData(), cba->size());
 }
 
 bool DkZipContainer::isZip() const {
@@ -32,6 +32,11 @@
 #include <QSharedPointer>
 #include <QUrl>
 #include <QImage>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QDateTime>
 #pragma warning(pop)
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -65,11 +70,108 @@
 // Qt defines
 class QNetworkReply;
 
+#ifdef WITH_QUAZIP
+class QuaZip;
+#endif
+
 namespace nmc {
 
 class DkMetaDataT;
 
+/**
+ * Read-only file buffers that can be shared without copying.
+ * Local files are memory mapped and wrapped into a QByteArray (see QByteArray::fromRawData).
+ * The mapping is released together with the last reference to the buffer.
+ * Network paths and small files are read into memory instead.
+ * Note: non-const access to a mapped buffer detaches (copies) it.
+ **/ 
+class DllLoaderExport DkFileBuffer {
+
+public:
+	enum {
+		min_map_size = 256*1024,	// smaller files are simply read
+	};
+
+	static QSharedPointer<QByteArray> load(const QString& filePath);
+	static QSharedPointer<QByteArray> map(const QString& filePath);
+	static bool isMappable(const QString& filePath);
+};
+
+/**
+ * Decodes jpgs that are embedded in image files (e.g. the previews of RAW files).
+ * The largest jpg is located by scanning the header (see DkExifScanner) and it is
+ * decoded straight from the mapped file - neither exiv2 nor LibRaw are involved.
+ **/ 
+class DllLoaderExport DkEmbeddedPreview {
+
+public:
+	static QImage load(const QString& filePath, const QSize& maxSize = QSize(), int minWidth = 0, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+};
+
 #ifdef WITH_QUAZIP
+/**
+ * An opened zip archive.
+ * The central directory is parsed once and entries are served by index.
+ * Unzip handles are pooled - each thread that extracts concurrently
+ * works with its own handle.
+ * Stored (uncompressed) entries are served from the mapped archive without copying.
+ * Use open() - it shares archives that are already open.
+ * Call close() if the archive is not browsed anymore - otherwise it stays locked (Windows).
+ * All functions are thread-safe.
+ **/
+class DllLoaderExport DkZipArchive {
+
+public:
+	static QSharedPointer<DkZipArchive> open(const QString& zipPath);
+	static void close(const QString& zipPath);
+	~DkZipArchive();
+
+	bool isValid() const;
+	QString zipPath() const;
+	QStringList fileNames() const;
+	int indexOf(const QString& fileName) const;
+	QSharedPointer<QByteArray> extract(int idx);
+	QSharedPointer<QByteArray> extract(const QString& fileName);
+
+protected:
+	DkZipArchive(const QString& zipPath);
+	DkZipArchive(DkZipArchive const&);		// hide
+	void operator=(DkZipArchive const&);	// hide
+
+	enum {
+		max_archives = 4,	// archives that are kept open
+	};
+
+	struct Entry {
+		QString name;
+		quint64 dirPos = 0;		// position in the central directory (see unzGoToFilePos64)
+		quint64 fileNum = 0;
+		qint64 size = 0;
+		bool stored = false;		// uncompressed & not encrypted
+		qint64 dataOffset = -1;	// of stored entries - located on first access
+	};
+
+	bool index();
+	qint64 dataOffset(int idx);
+	QuaZip* acquire();
+	void release(QuaZip* zip);
+
+	QString mZipPath;
+	qint64 mFileSize = 0;
+	QDateTime mModified;
+	bool mValid = false;
+
+	QVector<Entry> mEntries;		// read-only after index()
+	QHash<QString, int> mIndex;
+	QSharedPointer<QByteArray> mMap;
+
+	QMutex mMutex;
+	QList<QuaZip*> mHandles;		// unused handles
+
+	static QMutex mArchivesMutex;
+	static QList<QSharedPointer<DkZipArchive> > mArchives;	// most recently used first
+};
+
 class DllLoaderExport DkZipContainer {
 
 public:
@@ -237,6 +339,27 @@ public:
 		return !image().isNull();
 	};
 
+	/**
+	 * Requests images to be decoded at (about) the given display size.
+	 * Formats that support scaled decoding (e.g. jpg) are then decoded
+	 * directly to the display size. Pass an invalid size to decode full images.
+	 * @param displaySize the target size in device pixels
+	 **/
+	void setDisplaySize(const QSize& displaySize);
+	QSize displaySize() const;
+
+	/**
+	 * Returns true if the current image was decoded below its native resolution.
+	 * @return bool true if the image is downscaled
+	 **/
+	bool isDownscaled() const;
+
+	/**
+	 * Returns the native size of the current image (already rotated).
+	 * @return QSize the full resolution image size
+	 **/
+	QSize fullSize() const;
+
 	void undo();
 	void redo();
 	QVector<DkEditImage>* history();
@@ -245,7 +368,7 @@ public:
 
 	void loadFileToBuffer(const QString& filePath, QByteArray& ba) const;
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath) const;
-	bool writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const;
+	static bool writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba);
 
 	void release(bool clear = false);
 
@@ -284,6 +407,9 @@ public slots:
 protected:
 	bool loadRohFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
 	bool loadRawFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false) const;
+	bool loadScaledFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	bool loadRawPreview(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	QSize orientedDisplaySize() const;
 	void indexPages(const QString& filePath);
 	void convert32BitOrder(void *buffer, int width);
 
@@ -298,6 +424,10 @@ protected:
 	QSharedPointer<DkMetaDataT> mMetaData;
 	QVector<DkEditImage> mImages;
 	int mImageIndex = 0;
+
+	QSize mDisplaySize;
+	QSize mFullSize;
+	bool mDownscaled = false;
 };
 
 // file downloader from: http://qt-project.org/wiki/Download_Data_from_URL
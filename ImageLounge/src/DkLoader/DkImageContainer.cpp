@@ -37,6 +37,8 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QObject>
 #include <QImage>
+#include <QEventLoop>
+#include <QThread>
 #include <QtConcurrentRun>
 
 // quazip
@@ -54,6 +56,8 @@ namespace nmc {
 QString DkZipContainer::mZipMarker = "dIrChAr";
 #endif
 
+QSize DkImageContainer::mDisplaySize;
+
 // DkImageContainer --------------------------------------------------------------------
 /**
  * Creates a DkImageContainer.
@@ -66,6 +70,17 @@ DkImageContainer::DkImageContainer(const QString& filePath) {
 	init();
 }
 
+/**
+ * Creates a DkImageContainer from a file info.
+ * File attributes that were already queried (e.g. by a directory scan) are kept.
+ * @param fileInfo the image's file info
+ **/ 
+DkImageContainer::DkImageContainer(const QFileInfo& fileInfo) {
+
+	setFileInfo(fileInfo);
+	init();
+}
+
 DkImageContainer::~DkImageContainer() {
 
 }
@@ -116,11 +131,27 @@ void DkImageContainer::clear() {
 
 	if (mLoader)
 		mLoader->release();
-	if (mFileBuffer)
-		mFileBuffer->clear();
+	mFileBuffer.clear();	// drop our reference - mapped files are released with the last one
 	init();
 }
 
+/**
+ * Releases the decoded image but keeps the file buffer.
+ * Decoding from the buffer is much faster than reading the file again.
+ * Edited images are not released.
+ **/ 
+void DkImageContainer::releaseImage() {
+
+	if (mEdited)
+		return;
+
+	if (mLoader)
+		mLoader->release();
+
+	if (mLoadState == loaded)
+		mLoadState = not_loaded;
+}
+
 void DkImageContainer::undo() {
 
 	getLoader()->undo();
@@ -290,8 +321,29 @@ DkRotatingRect DkImageContainer::cropRect() {
 }
 
 
+/**
+ * Returns the full resolution image.
+ * If the image was decoded at display size, the full image is decoded now.
+ * @return QImage the image
+ **/ 
 QImage DkImageContainer::image() {
 
+	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
+		loadImage();
+
+	if (isDownscaled())
+		loadFullImage();
+
+	return mLoader->image();
+}
+
+/**
+ * Returns the image for rendering.
+ * In contrast to image(), this might be decoded at the display size only.
+ * @return QImage the (downscaled) image
+ **/ 
+QImage DkImageContainer::displayImage() {
+
 	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
 		loadImage();
 
@@ -354,6 +406,7 @@ void DkImageContainer::setFilePath(const QString& filePath) {
 
 	mFilePath = filePath;
 	mFileInfo = filePath;
+	mSortKeyDirty = true;
 
 #ifdef Q_OS_WIN
 #if QT_VERSION < 0x050000
@@ -365,6 +418,49 @@ void DkImageContainer::setFilePath(const QString& filePath) {
 
 }
 
+void DkImageContainer::setFileInfo(const QFileInfo& fileInfo) {
+
+	setFilePath(fileInfo.absoluteFilePath());
+	mFileInfo = fileInfo;	// keeps the cached stat
+}
+
+/**
+ * Returns the keys for sorting.
+ * They are computed on the first call (file name chunks, file dates).
+ * Note: computing the keys is not thread-safe for the same container.
+ * @return const DkImageContainer::SortKey& the sort keys
+ **/ 
+const DkImageContainer::SortKey& DkImageContainer::sortKey() const {
+
+	if (mSortKeyDirty) {
+		mSortKey.name = DkNaturalSortKey(fileName());
+		mSortKey.created = mFileInfo.created().toMSecsSinceEpoch();
+		mSortKey.modified = mFileInfo.lastModified().toMSecsSinceEpoch();
+		mSortKey.taken = -1;
+		mSortKeyDirty = false;
+	}
+
+	return mSortKey;
+}
+
+/**
+ * Returns the date the image was taken (ms since epoch).
+ * The date is read from the metadata index - only files that are not indexed yet are scanned.
+ * Images without a capture date fall back to the creation date.
+ * @return qint64 the capture date
+ **/ 
+qint64 DkImageContainer::dateTaken() const {
+
+	const SortKey& key = sortKey();
+
+	if (key.taken == -1) {
+		QDateTime dt = DkMetaDataIndex::instance().record(filePath())->dateTaken();
+		mSortKey.taken = dt.isValid() ? dt.toMSecsSinceEpoch() : key.created;
+	}
+
+	return mSortKey.taken;
+}
+
 bool DkImageContainer::hasImage() const {
 
 	if (!mLoader)
@@ -373,6 +469,27 @@ bool DkImageContainer::hasImage() const {
 	return mLoader->hasImage();
 }
 
+bool DkImageContainer::isDownscaled() const {
+
+	return mLoader && mLoader->isDownscaled();
+}
+
+QSize DkImageContainer::fullSize() const {
+
+	if (!mLoader)
+		return QSize();
+
+	return mLoader->fullSize();
+}
+
+void DkImageContainer::setDisplaySize(const QSize& displaySize) {
+	mDisplaySize = displaySize;
+}
+
+QSize DkImageContainer::displaySize() {
+	return mDisplaySize;
+}
+
 int DkImageContainer::getLoadState() const {
 
 	return mLoadState;
@@ -391,8 +508,35 @@ bool DkImageContainer::loadImage() {
 	return mLoader->hasImage();
 }
 
+/**
+ * Decodes the image from a buffer that was read beforehand (e.g. by the batch reader).
+ * @param fileBuffer the file's content - if it is empty the file is read again
+ * @return bool true if the image was loaded
+ **/ 
+bool DkImageContainer::loadImage(const QSharedPointer<QByteArray> fileBuffer) {
+
+	mFileBuffer = fileBuffer;
+
+	return loadImage();
+}
+
+/**
+ * Decodes the full resolution of an image that was decoded at display size.
+ **/ 
+void DkImageContainer::loadFullImage() {
+
+	qDebug() << "decoding full resolution of" << fileName();
+
+	if (getFileBuffer()->isEmpty())
+		mFileBuffer = loadFileToBuffer(mFilePath);
+
+	scaledImages.clear();
+	getLoader()->setDisplaySize(QSize());
+	mLoader = loadImageIntern(mFilePath, mLoader, mFileBuffer);
+}
+
 bool DkImageContainer::saveImage(const QString& filePath, int compression /* = -1 */) {
-	return saveImage(filePath, getLoader()->image(), compression);
+	return saveImage(filePath, image(), compression);
 }
 
 bool DkImageContainer::saveImage(const QString& filePath, const QImage saveImg, int compression /* = -1 */) {
@@ -421,13 +565,7 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString& fil
 		return QSharedPointer<QByteArray>(new QByteArray());
 	}
 
-	QFile file(fInfo.absoluteFilePath());
-	file.open(QIODevice::ReadOnly);
-
-	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-	file.close();
-
-	return ba;
+	return DkFileBuffer::load(fInfo.absoluteFilePath());
 }
 
 
@@ -496,7 +634,7 @@ QSharedPointer<DkZipContainer> DkImageContainer::getZipData() {
 }
 #endif
 #ifdef Q_OS_WIN
-std::wstring DkImageContainer::getFileNameWStr() const {
+const std::wstring& DkImageContainer::getFileNameWStr() const {
 	
 	return mFileNameStr;
 }
@@ -531,32 +669,39 @@ bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r
 			return !DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
 		break;
 #else
+		// precomputed keys - compFilename parses and allocates in every comparison
 		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
+			return l.sortKey().name < r.sortKey().name;
 		else
-			return DkUtils::compFilenameInv(l.fileInfo(), r.fileInfo());
+			return r.sortKey().name < l.sortKey().name;
 		break;
 #endif
 
 	case DkSettings::sort_date_created:
 		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateCreated(l.fileInfo(), r.fileInfo());
+			return l.sortKey().created < r.sortKey().created;
 		else
-			return DkUtils::compDateCreatedInv(l.fileInfo(), r.fileInfo());
+			return r.sortKey().created < l.sortKey().created;
 		break;
 
 	case DkSettings::sort_date_modified:
 		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateModified(l.fileInfo(), r.fileInfo());
+			return l.sortKey().modified < r.sortKey().modified;
+		else
+			return r.sortKey().modified < l.sortKey().modified;
+
+	case DkSettings::sort_date_taken:
+		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
+			return l.dateTaken() < r.dateTaken();
 		else
-			return DkUtils::compDateModifiedInv(l.fileInfo(), r.fileInfo());
+			return r.dateTaken() < l.dateTaken();
 
 	case DkSettings::sort_random:
 		return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
 
 	default:
 		// filename
-		return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
+		return l.sortKey().name < r.sortKey().name;
 	}
 	
 }
@@ -564,6 +709,16 @@ bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r
 // DkImageContainerT --------------------------------------------------------------------
 DkImageContainerT::DkImageContainerT(const QString& filePath) : DkImageContainer(filePath) {
 	
+	initFileWatcher();
+}
+
+DkImageContainerT::DkImageContainerT(const QFileInfo& fileInfo) : DkImageContainer(fileInfo) {
+
+	initFileWatcher();
+}
+
+void DkImageContainerT::initFileWatcher() {
+
 	// our file watcher
 	mFileUpdateTimer.setSingleShot(false);
 	mFileUpdateTimer.setInterval(500);
@@ -578,6 +733,9 @@ DkImageContainerT::~DkImageContainerT() {
 	mBufferWatcher.cancel();
 	mImageWatcher.blockSignals(true);
 	mImageWatcher.cancel();
+	mFullImageWatcher.blockSignals(true);
+	mFullImageWatcher.cancel();
+	DkTaskScheduler::instance().cancel(this);
 
 	saveMetaData();
 
@@ -590,12 +748,24 @@ void DkImageContainerT::clear() {
 
 	cancel();
 
+	// a running full resolution decode is outdated now
+	disconnect(&mFullImageWatcher, SIGNAL(finished()), this, SLOT(fullImageLoaded()));
+	mFullImageFailed = false;
+
 	if (mFetchingImage || mFetchingBuffer)
 		return;
 
 	DkImageContainer::clear();
 }
 
+void DkImageContainerT::releaseImage() {
+
+	if (mFetchingImage || mFetchingBuffer || mLoadState == loading || mFullImageWatcher.isRunning())
+		return;
+
+	DkImageContainer::releaseImage();
+}
+
 void DkImageContainerT::checkForFileUpdates() {
 
 #ifdef WITH_QUAZIP
@@ -605,6 +775,9 @@ void DkImageContainerT::checkForFileUpdates() {
 
 	QDateTime modifiedBefore = fileInfo().lastModified();
 	mFileInfo.refresh();
+
+	if (mFileInfo.lastModified() != modifiedBefore)
+		mSortKeyDirty = true;
 	
 	bool changed = false;
 
@@ -693,13 +866,17 @@ void DkImageContainerT::fetchFile() {
 	
 	if (mFetchingBuffer && getLoadState() == loading_canceled) {
 		mLoadState = loading;	// uncancel loading - we had another call
+		DkTaskScheduler::instance().setPriority(this, mPriority);
 		return;
 	}
 	if (mFetchingImage)
 		mImageWatcher.waitForFinished();
 	// I think we missed to return here
-	if (mFetchingBuffer)
+	if (mFetchingBuffer) {
+		// the buffer might be prefetched - we need it now
+		DkTaskScheduler::instance().setPriority(this, mPriority);
 		return;
+	}
 
 	// ignore doubled calls
 	if (mFileBuffer && !mFileBuffer->isEmpty()) {
@@ -710,8 +887,11 @@ void DkImageContainerT::fetchFile() {
 	mFetchingBuffer = true;	// saves the threaded call
 	connect(&mBufferWatcher, SIGNAL(finished()), this, SLOT(bufferLoaded()), Qt::UniqueConnection);
 
-	mBufferWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::loadFileToBuffer, filePath()));
+	// files are prefetched if we are not loading the image
+	DkTaskScheduler::Priority priority = getLoadState() == loading ? mPriority : DkTaskScheduler::priority_prefetch;
+
+	mBufferWatcher.setFuture(DkTaskScheduler::instance().run<QSharedPointer<QByteArray> >(priority, this, 
+		std::bind(&nmc::DkImageContainerT::loadFileToBuffer, this, filePath())));
 }
 
 void DkImageContainerT::bufferLoaded() {
@@ -748,10 +928,121 @@ void DkImageContainerT::fetchImage() {
 	qInfoClean() << "loading " << filePath();
 	mFetchingImage = true;
 
+	// decode at display size - the full image is decoded on demand
+	bool decodeForDisplay = DkSettingsManager::param().resources().decodeForDisplay && !mEdited;
+	getLoader()->setDisplaySize(decodeForDisplay ? mDisplaySize : QSize());
+
 	connect(&mImageWatcher, SIGNAL(finished()), this, SLOT(imageLoaded()), Qt::UniqueConnection);
 
-	mImageWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::loadImageIntern, filePath(), mLoader, mFileBuffer));
+	mImageWatcher.setFuture(DkTaskScheduler::instance().run<QSharedPointer<DkBasicLoader> >(mPriority, this, 
+		std::bind(&nmc::DkImageContainerT::loadImageIntern, this, filePath(), mLoader, mFileBuffer)));
+}
+
+/**
+ * Decodes the full resolution in the background if the image was decoded at display size.
+ * imageUpdatedSignal() is emitted as soon as the full image is available.
+ * @return bool true if the full image is being decoded
+ **/ 
+bool DkImageContainerT::loadFullImageThreaded() {
+
+	if (!isDownscaled() || mFetchingImage || mFullImageWatcher.isRunning() || mFullImageFailed)
+		return false;
+
+	qInfoClean() << "decoding full resolution of " << filePath();
+
+	// use a new loader - the current one keeps rendering meanwhile
+	QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+
+	connect(&mFullImageWatcher, SIGNAL(finished()), this, SLOT(fullImageLoaded()), Qt::UniqueConnection);
+
+	mFullImageWatcher.setFuture(DkTaskScheduler::instance().run<QSharedPointer<DkBasicLoader> >(mPriority, this, 
+		std::bind(&nmc::DkImageContainerT::loadFullImageIntern, this, filePath(), loader, mFileBuffer)));
+
+	return true;
+}
+
+/**
+ * Waits until the full resolution is decoded in the background.
+ * Other events (e.g. painting) are processed meanwhile - but no user input.
+ **/ 
+void DkImageContainerT::waitForFullImage() {
+
+	// the image is still loading (at display size)
+	waitFor(mImageWatcher);
+
+	loadFullImageThreaded();
+	waitFor(mFullImageWatcher);
+
+	// the task might have finished before the watcher's signal was delivered
+	if (isDownscaled() && mFullImageWatcher.isFinished() && !mFullImageWatcher.isCanceled())
+		fullImageLoaded();
+}
+
+/**
+ * Waits for a threaded task of this image.
+ * The tasks are moved to the visible priority since the user waits for them.
+ * If called from the GUI thread, a local event loop keeps painting - otherwise we block.
+ * @param watcher the task's watcher - its slots are called before this returns
+ **/ 
+void DkImageContainerT::waitFor(QFutureWatcherBase& watcher) {
+
+	if (!watcher.isRunning())
+		return;
+
+	DkTaskScheduler::instance().setPriority(this, DkTaskScheduler::priority_visible);
+
+	if (QThread::currentThread() != thread()) {
+		watcher.waitForFinished();
+		return;
+	}
+
+	// the container's slots are connected first - so they are called once the loop quits
+	QEventLoop loop;
+	connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+	loop.exec(QEventLoop::ExcludeUserInputEvents);
+}
+
+void DkImageContainerT::fullImageLoaded() {
+
+	// dropped by the scheduler
+	if (mFullImageWatcher.isCanceled())
+		return;
+
+	QSharedPointer<DkBasicLoader> loader = mFullImageWatcher.result();
+
+	// edited or reloaded meanwhile
+	if (!isDownscaled() || mEdited)
+		return;
+
+	if (!loader || !loader->hasImage()) {
+		qWarning() << "could not decode the full resolution of" << filePath();
+		mFullImageFailed = true;
+		return;
+	}
+
+	// do not drop metadata changes that are not saved yet
+	if (getLoader()->getMetaData()->isDirty())
+		DkImageContainer::loadFullImage();
+	else {
+		mLoader = loader;
+		connect(mLoader.data(), SIGNAL(errorDialogSignal(const QString&)), this, SIGNAL(errorDialogSignal(const QString&)));
+	}
+
+	scaledImages.clear();
+	emit imageUpdatedSignal();
+}
+
+/**
+ * Decodes the full resolution in the background and waits for it (see waitForFullImage()).
+ * So image() does not freeze the GUI if e.g. an image is rotated or saved.
+ **/ 
+void DkImageContainerT::loadFullImage() {
+
+	waitForFullImage();
+
+	// the threaded decode failed (or we are not in the GUI thread)
+	if (isDownscaled())
+		DkImageContainer::loadFullImage();
 }
 
 void DkImageContainerT::imageLoaded() {
@@ -764,6 +1055,12 @@ void DkImageContainerT::imageLoaded() {
 		return;
 	}
 
+	// the decode was dropped before it started, but we are loading again
+	if (mImageWatcher.isCanceled()) {
+		fetchImage();
+		return;
+	}
+
 	// deliver image
 	mLoader = mImageWatcher.result();
 
@@ -810,7 +1107,7 @@ void DkImageContainerT::loadingFinished() {
 
 	// clear file buffer if it exceeds a certain size?! e.g. psd files
 	if (mFileBuffer && mFileBuffer->size()/(1024.0f*1024.0f) > DkSettingsManager::param().resources().cacheMemory*0.5f)
-		mFileBuffer->clear();
+		mFileBuffer.clear();
 	
 	mLoadState = loaded;
 	emit fileLoadedSignal(true);
@@ -857,6 +1154,26 @@ void DkImageContainerT::cancel() {
 		return;
 
 	mLoadState = loading_canceled;
+
+	// drop tasks that did not start yet
+	DkTaskScheduler::instance().cancel(this);
+}
+
+/**
+ * Sets the priority of threaded loading.
+ * Tasks that are queued already are moved to the new priority.
+ * @param priority e.g. DkTaskScheduler::priority_visible for the current image
+ **/ 
+void DkImageContainerT::setPriority(DkTaskScheduler::Priority priority) {
+
+	if (mPriority == priority)
+		return;
+
+	mPriority = priority;
+
+	// prefetched buffers stay prefetched
+	if (getLoadState() == loading)
+		DkTaskScheduler::instance().setPriority(this, priority);
 }
 
 void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = true */) {
@@ -896,7 +1213,7 @@ void DkImageContainerT::saveMetaDataThreaded() {
 
 bool DkImageContainerT::saveImageThreaded(const QString& filePath, int compression /* = -1 */) {
 
-	return saveImageThreaded(filePath, getLoader()->image(), compression);
+	return saveImageThreaded(filePath, image(), compression);
 }
 
 
@@ -947,8 +1264,7 @@ void DkImageContainerT::savingFinished() {
 		//// reset thumb - loadImageThreaded should do it anyway
 		//thumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(saveFile, loader->image()));
 
-		if (mFileBuffer)
-			mFileBuffer->clear();	// do a complete clear?
+		mFileBuffer.clear();	// do a complete clear?
 		setFilePath(savePath);
 		mEdited = false;
 		mDownloaded = false;
@@ -970,6 +1286,15 @@ QSharedPointer<DkBasicLoader> DkImageContainerT::loadImageIntern(const QString&
 	return DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
 }
 
+QSharedPointer<DkBasicLoader> DkImageContainerT::loadFullImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer) {
+
+	// large buffers are dropped after loading
+	if (!fileBuffer || fileBuffer->isEmpty())
+		fileBuffer = loadFileToBuffer(filePath);
+
+	return loadImageIntern(filePath, loader, fileBuffer);
+}
+
 QString DkImageContainerT::saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression) {
 
 	qDebug() << "saveImage in T: " << filePath;
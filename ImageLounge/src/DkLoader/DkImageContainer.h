@@ -46,6 +46,8 @@
 #endif
 
 #include "DkThumbs.h"
+#include "DkUtils.h"
+#include "DkTaskScheduler.h"
 
 namespace nmc {
 
@@ -67,7 +69,19 @@ public:
 		loaded,
 	};
 
+	/**
+	 * Keys needed for sorting.
+	 * They are computed once since sorting compares them O(n log n) times.
+	 **/
+	struct SortKey {
+		DkNaturalSortKey name;
+		qint64 created = 0;
+		qint64 modified = 0;
+		qint64 taken = -1;	// -1 if the file was not scanned yet (see dateTaken())
+	};
+
 	DkImageContainer(const QString& filePath);
+	DkImageContainer(const QFileInfo& fileInfo);
 	virtual ~DkImageContainer();
 	bool operator==(const DkImageContainer& ric) const;
 	bool operator< (const DkImageContainer& o) const;
@@ -76,10 +90,13 @@ public:
 	bool operator>= (const DkImageContainer& o) const;
 
 	QImage image();
+	QImage displayImage();
 	QImage imageScaledToHeight(int height);
 	QImage imageScaledToWidth(int width);
 
 	bool hasImage() const;
+	bool isDownscaled() const;
+	QSize fullSize() const;
 	int getLoadState() const;
 	QFileInfo fileInfo() const;
 	QString filePath() const;
@@ -101,7 +118,7 @@ public:
 	QSharedPointer<DkZipContainer> getZipData();
 #endif
 #ifdef Q_OS_WIN
-	std::wstring getFileNameWStr() const;
+	const std::wstring& getFileNameWStr() const;
 #endif
 
 	bool exists();
@@ -109,23 +126,32 @@ public:
 
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	bool loadImage();
+	bool loadImage(const QSharedPointer<QByteArray> fileBuffer);
 	void setImage(const QImage& img, const QString& editName);
 	void setImage(const QImage& img, const QString& editName, const QString& filePath);
 	bool saveImage(const QString& filePath, const QImage saveImg, int compression = -1);
 	bool saveImage(const QString& filePath, int compression = -1);
 	void saveMetaData();
 	virtual void clear();
+	virtual void releaseImage();
 	virtual void undo();
 	virtual void redo();
 	virtual void setHistoryIndex(int idx);
 	void cropImage(const DkRotatingRect & rect, const QColor & col, bool cropToMetadata);
 	DkRotatingRect cropRect();
+	const SortKey& sortKey() const;
+	qint64 dateTaken() const;
+
+	static void setDisplaySize(const QSize& displaySize);
+	static QSize displaySize();
 
 protected:
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer = QSharedPointer<QByteArray>());
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void setFilePath(const QString& filePath);
+	void setFileInfo(const QFileInfo& fileInfo);
+	virtual void loadFullImage();
 	void init();
 
 	QSharedPointer<QByteArray> mFileBuffer;
@@ -139,6 +165,11 @@ protected:
 	QFileInfo mFileInfo;
 	QVector<QImage> scaledImages;
 
+	mutable SortKey mSortKey;
+	mutable bool mSortKeyDirty = true;
+
+	static QSize mDisplaySize;
+
 #ifdef WITH_QUAZIP	
 	QSharedPointer<DkZipContainer> mZipData;
 #endif
@@ -159,15 +190,20 @@ class DllLoaderExport DkImageContainerT : public QObject, public DkImageContaine
 
 public:
 	DkImageContainerT(const QString& filePath);
+	DkImageContainerT(const QFileInfo& fileInfo);
 	virtual ~DkImageContainerT();
 
 	void fetchFile();
 	void cancel();
 	void clear();
+	void setPriority(DkTaskScheduler::Priority priority);
+	void releaseImage();
 	void receiveUpdates(QObject* obj, bool connectSignals = true);
 	void downloadFile(const QUrl& url);
 
 	bool loadImageThreaded(bool force = false);
+	bool loadFullImageThreaded();
+	void waitForFullImage();
 	bool saveImageThreaded(const QString& filePath, const QImage saveImg, int compression = -1);
 	bool saveImageThreaded(const QString& filePath, int compression = -1);
 	void saveMetaDataThreaded();
@@ -197,18 +233,24 @@ protected slots:
 	void imageLoaded();
 	void savingFinished();
 	void loadingFinished();
+	void fullImageLoaded();
 	void fileDownloaded();
 
 protected:
+	void initFileWatcher();
 	void fetchImage();
+	void loadFullImage() override;
+	void waitFor(QFutureWatcherBase& watcher);
 	
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
+	QSharedPointer<DkBasicLoader> loadFullImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
 	
 	QFutureWatcher<QSharedPointer<QByteArray> > mBufferWatcher;
 	QFutureWatcher<QSharedPointer<DkBasicLoader> > mImageWatcher;
+	QFutureWatcher<QSharedPointer<DkBasicLoader> > mFullImageWatcher;
 	QFutureWatcher<QString> mSaveImageWatcher;
 	QFutureWatcher<bool> mSaveMetaDataWatcher;
 
@@ -227,6 +269,9 @@ protected:
 	bool mFetchingImage = false;
 	bool mFetchingBuffer = false;
 	bool mDownloaded = false;
+	bool mFullImageFailed = false;
+
+	DkTaskScheduler::Priority mPriority = DkTaskScheduler::priority_visible;	// priority of full loads
 
 	QTimer mFileUpdateTimer;
 };
@@ -73,6 +73,11 @@
 #include <QPainter>
 #include <qmath.h>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QHash>
+#include <QThreadPool>
+#include <algorithm>
+#include <random>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -97,6 +102,215 @@
 
 namespace nmc {
 
+// DkImageCache --------------------------------------------------------------------
+/**
+ * Updates the cache after imgC became the current image.
+ * Edited images that are not current anymore are cleared, the least recently
+ * used images are evicted and the neighbors of imgC are prefetched.
+ * @param images the folder's images
+ * @param imgC the current image
+ **/ 
+void DkImageCache::update(const QVector<QSharedPointer<DkImageContainerT> >& images, QSharedPointer<DkImageContainerT> imgC) {
+
+	int cIdx = indexOf(images, imgC);
+
+	if (cIdx == -1) {
+		qDebug() << "WARNING: image not found for caching!";
+		return;
+	}
+
+	DkTimer dt;
+
+	// observe the navigation direction
+	if (mLastIdx != -1 && mLastIdx != cIdx) {
+
+		int diff = cIdx - mLastIdx;
+
+		// we wrapped around the folder's end
+		if (qAbs(diff) > images.size()/2)
+			diff = -diff;
+
+		mDirection = (diff > 0) ? 1 : -1;
+	}
+	mLastIdx = cIdx;
+
+	// clear images if they are edited
+	for (int idx = mEntries.size()-1; idx >= 0; idx--) {
+
+		if (mEntries[idx] != imgC && mEntries[idx]->isEdited()) {
+			mEntries[idx]->clear();
+			mEntries.removeAt(idx);
+		}
+	}
+
+	// the window: current, next, previous and then further in our direction
+	QVector<QSharedPointer<DkImageContainerT> > window;
+	window << imgC;
+
+	int numCached = DkSettingsManager::param().resources().maxImagesCached;
+	int nIdx = cIdx + mDirection;
+	int pIdx = cIdx - mDirection;
+
+	QSharedPointer<DkImageContainerT> nextImg;
+	if (nIdx >= 0 && nIdx < images.size()) {
+		nextImg = images[nIdx];
+		window << nextImg;
+	}
+	if (pIdx >= 0 && pIdx < images.size())
+		window << images[pIdx];
+
+	for (int idx = 2; idx < numCached; idx++) {
+
+		int fIdx = cIdx + idx*mDirection;
+
+		if (fIdx < 0 || fIdx >= images.size())
+			break;
+
+		window << images[fIdx];
+	}
+
+	// the current image is the most recently used one
+	for (int idx = window.size()-1; idx >= 0; idx--)
+		touch(window[idx]);
+
+	float maxMemory = DkSettingsManager::param().resources().cacheMemory;
+	evict(maxMemory, imgC);
+
+	// prefetch
+	float mem = memoryUsage();
+	for (int idx = 1; idx < window.size() && mem < maxMemory; idx++) {
+
+		QSharedPointer<DkImageContainerT> cImg = window[idx];
+
+		if (cImg->getLoadState() != DkImageContainerT::not_loaded)
+			continue;
+
+		// fully load the next image
+		if (cImg == nextImg) {
+			cImg->setPriority(DkTaskScheduler::priority_next);
+			cImg->loadImageThreaded();
+			qDebug() << "[Cacher] " << cImg->filePath() << " fully cached...";
+		}
+		else if (!cImg->getFileBuffer() || cImg->getFileBuffer()->isEmpty()) {
+			cImg->fetchFile();
+			qDebug() << "[Cacher] " << cImg->filePath() << " file fetched...";
+		}
+
+		// the loader's accounting follows once the image is loaded
+		mem += cImg->getFileSize();
+	}
+
+	// forget about images that do not hold anything
+	for (int idx = mEntries.size()-1; idx >= 0; idx--) {
+
+		if (!window.contains(mEntries[idx]) && mEntries[idx]->getMemoryUsage() == 0)
+			mEntries.removeAt(idx);
+	}
+
+	qDebug() << "cache with: " << memoryUsage() << " MB (" << mEntries.size() << " images) updated in: " << dt;
+}
+
+/**
+ * Clears all cached images (except for the image currently displayed).
+ **/ 
+void DkImageCache::clear() {
+
+	for (QSharedPointer<DkImageContainerT> imgC : mEntries) {
+
+		if (!imgC->isSelected())
+			imgC->clear();
+	}
+
+	mEntries.clear();
+	mLastIdx = -1;
+}
+
+/**
+ * Returns the memory currently allocated by the cached images.
+ * @return float the memory in MB
+ **/ 
+float DkImageCache::memoryUsage() const {
+
+	float mem = 0;
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : mEntries)
+		mem += imgC->getMemoryUsage();
+
+	return mem;
+}
+
+int DkImageCache::indexOf(const QVector<QSharedPointer<DkImageContainerT> >& images, QSharedPointer<DkImageContainerT> imgC) const {
+
+	// we usually moved just a few images
+	if (mLastIdx != -1) {
+
+		int range = DkSettingsManager::param().global().skipImgs + 1;
+
+		for (int idx = 0; idx <= range; idx++) {
+
+			if (mLastIdx+idx < images.size() && images[mLastIdx+idx] == imgC)
+				return mLastIdx+idx;
+			if (mLastIdx-idx >= 0 && mLastIdx-idx < images.size() && images[mLastIdx-idx] == imgC)
+				return mLastIdx-idx;
+		}
+	}
+
+	int cIdx = images.indexOf(imgC);
+
+	// the folder was reloaded
+	if (cIdx == -1) {
+
+		for (int idx = 0; idx < images.size(); idx++) {
+
+			if (images[idx]->filePath() == imgC->filePath())
+				return idx;
+		}
+	}
+
+	return cIdx;
+}
+
+void DkImageCache::touch(QSharedPointer<DkImageContainerT> imgC) {
+
+	mEntries.removeOne(imgC);
+	mEntries.prepend(imgC);
+}
+
+/**
+ * Evicts the least recently used images until the cache fits into maxMemory.
+ * Decoded images are released first since they can be restored from the file buffer.
+ * @param maxMemory the cache budget in MB
+ * @param imgC the current image which is never evicted
+ **/ 
+void DkImageCache::evict(float maxMemory, QSharedPointer<DkImageContainerT> imgC) {
+
+	float mem = memoryUsage();
+
+	for (int idx = mEntries.size()-1; idx >= 0 && mem > maxMemory; idx--) {
+
+		QSharedPointer<DkImageContainerT> cImg = mEntries[idx];
+
+		if (cImg == imgC || !cImg->hasImage())
+			continue;
+
+		float cMem = cImg->getMemoryUsage();
+		cImg->releaseImage();
+		mem -= cMem - cImg->getMemoryUsage();
+	}
+
+	for (int idx = mEntries.size()-1; idx >= 0 && mem > maxMemory; idx--) {
+
+		QSharedPointer<DkImageContainerT> cImg = mEntries[idx];
+
+		if (cImg == imgC)
+			continue;
+
+		mem -= cImg->getMemoryUsage();
+		cImg->clear();
+		mEntries.removeAt(idx);
+	}
+}
+
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
  * Default constructor.
@@ -148,6 +362,12 @@ DkImageLoader::~DkImageLoader() {
  **/ 
 void DkImageLoader::clearPath() {
 
+#ifdef WITH_QUAZIP
+	// unlock the archive
+	if (mCurrentImage && mCurrentImage->isFromZip() && mCurrentImage->getZipData())
+		DkZipArchive::close(mCurrentImage->getZipData()->getZipFilePath());
+#endif
+
 	// lastFileLoaded must exist
 	if (mCurrentImage && mCurrentImage->exists()) {
 		mCurrentImage->receiveUpdates(this, false);
@@ -165,7 +385,8 @@ void DkImageLoader::clearPath() {
  **/ 
 bool DkImageLoader::loadZipArchive(const QString& zipPath) {
 
-	QStringList fileNameList = JlCompress::getFileList(zipPath);
+	// the archive stays open - so extracting images & thumbnails needs no further parsing
+	QStringList fileNameList = DkZipArchive::open(zipPath)->fileNames();
 	
 	// remove the * in fileFilters
 	QStringList fileFiltersClean = DkSettingsManager::param().app().browseFilters;
@@ -227,6 +448,8 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		mFolderUpdated = false;
 		QFileInfoList files = getFilteredFileInfoList(newDirPath, mIgnoreKeywords, mKeywords, mFolderFilterString);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
 
+		DkMetaDataIndex::instance().update(newDirPath, files);
+
 		// might get empty too (e.g. someone deletes all images)
  		if (files.empty()) {
 			emit showInfoSignal(tr("%1 \n does not contain any image").arg(newDirPath), 4000);	// stop showing
@@ -269,8 +492,11 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 			return false;
 		}
 
+		DkMetaDataIndex::instance().update(mCurrentDir, files);
+
 		// ok new folder, this should speed-up loading
 		mImages.clear();
+		mCache.clear();
 		
 		//// TODO: creating ~120 000 images takes about 2 secs
 		//// but sorting (just filenames) takes ages (on windows)
@@ -329,26 +555,49 @@ void DkImageLoader::imagesSorted() {
 	qDebug() << "images sorted...";
 }
 
+/**
+ * Queries the file attributes (stat).
+ * QFileInfo caches them, so later calls (e.g. when sorting) are for free.
+ * @param fileInfo the file to be queried
+ **/ 
+static void statFile(QFileInfo& fileInfo) {
+
+	fileInfo.lastModified();
+}
+
 void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
 
-	// TODO: change files to QStringList
 	DkTimer dt;
 	QVector<QSharedPointer<DkImageContainerT > > oldImages = mImages;
 	mImages.clear();
+	mImages.reserve(files.size());
 
-	for (int idx = 0; idx < files.size(); idx++) {
+	// index the old containers - searching them for every file is O(n^2)
+	QHash<QString, QSharedPointer<DkImageContainerT> > oldIndex;
+	oldIndex.reserve(oldImages.size());
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : oldImages)
+		oldIndex.insert(imgC->filePath(), imgC);
+
+	// stat in parallel - this is what blocks on network drives
+	QFileInfoList fileInfos = files;
+	QtConcurrent::blockingMap(fileInfos, statFile);
+	qDebugClean() << "[DkImageLoader] " << fileInfos.size() << " files queried in " << dt;
 
-		int oIdx = findFileIdx(files.at(idx).absoluteFilePath(), oldImages);
+	for (const QFileInfo& fileInfo : fileInfos) {
 
-		if (oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == files.at(idx).lastModified())
-			mImages.append(oldImages.at(oIdx));
+		QSharedPointer<DkImageContainerT> imgC = oldIndex.value(fileInfo.absoluteFilePath());
+
+		// keep unchanged containers - they might hold a decoded image
+		if (imgC && imgC->fileInfo().lastModified() == fileInfo.lastModified())
+			mImages.append(imgC);
 		else
-			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(files.at(idx).absoluteFilePath())));
+			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(fileInfo)));
 	}
 	qDebugClean() << "[DkImageLoader] " << mImages.size() << " containers created in " << dt;
 
 	if (sort) {
-		qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+		mImages = sortImages(mImages);
 		qDebug() << "[DkImageLoader] after sorting: " << dt;
 
 		emit updateDirSignal(mImages);
@@ -362,9 +611,117 @@ void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
 
 }
 
+/**
+ * Sorts in parallel.
+ * Chunks are sorted by the global thread pool and merged pairwise afterwards.
+ * @param vec the vector to be sorted
+ * @param lessThan a strict weak ordering
+ **/ 
+template <typename T, typename LessThan>
+static void parallelSort(QVector<T>& vec, LessThan lessThan) {
+
+	int numThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+	if (vec.size() < 4096 || numThreads < 2) {
+		std::stable_sort(vec.begin(), vec.end(), lessThan);
+		return;
+	}
+
+	struct Range {
+		int first;
+		int mid;
+		int last;
+	};
+
+	T* data = vec.data();
+	int chunkSize = (vec.size() + numThreads - 1) / numThreads;
+
+	QVector<Range> ranges;
+	for (int idx = 0; idx < vec.size(); idx += chunkSize)
+		ranges.append({idx, idx, qMin(idx + chunkSize, vec.size())});
+
+	QtConcurrent::blockingMap(ranges, [&](const Range& r) {
+		std::stable_sort(data + r.first, data + r.last, lessThan);
+	});
+
+	// merge neighbours until a single range is left
+	while (ranges.size() > 1) {
+
+		QVector<Range> merges;
+		for (int idx = 0; idx + 1 < ranges.size(); idx += 2)
+			merges.append({ranges[idx].first, ranges[idx].last, ranges[idx+1].last});
+
+		QtConcurrent::blockingMap(merges, [&](const Range& r) {
+			std::inplace_merge(data + r.first, data + r.mid, data + r.last, lessThan);
+		});
+
+		if (ranges.size() % 2)
+			merges.append(ranges.last());
+
+		ranges = merges;
+	}
+}
+
+/**
+ * Sorts the images with respect to the current sort mode.
+ * The sort keys are computed once per image (in parallel), the comparisons
+ * are flat key comparisons then.
+ * @param images the images to be sorted
+ * @return QVector<QSharedPointer<DkImageContainerT > > the sorted images
+ **/ 
 QVector<QSharedPointer<DkImageContainerT > > DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const {
 
-	qSort(images.begin(), images.end(), imageContainerLessThanPtr);
+	DkTimer dt;
+
+	int sortMode = DkSettingsManager::param().global().sortMode;
+	bool asc = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	if (sortMode == DkSettings::sort_random) {
+		std::mt19937 rng(std::random_device{}());
+		std::shuffle(images.begin(), images.end(), rng);
+		return images;
+	}
+
+	// compute all keys before sorting - each container is touched by one thread only
+	QtConcurrent::blockingMap(images, [sortMode](QSharedPointer<DkImageContainerT>& imgC) {
+		
+		if (sortMode == DkSettings::sort_date_taken)
+			imgC->dateTaken();	// scans the exif header
+		else
+			imgC->sortKey();
+	});
+
+	typedef QSharedPointer<DkImageContainerT> ImgPtr;
+
+	if (sortMode == DkSettings::sort_date_created) {
+		parallelSort(images, [asc](const ImgPtr& l, const ImgPtr& r) {
+			return asc ? l->sortKey().created < r->sortKey().created : r->sortKey().created < l->sortKey().created;
+		});
+	}
+	else if (sortMode == DkSettings::sort_date_taken) {
+		parallelSort(images, [asc](const ImgPtr& l, const ImgPtr& r) {
+			return asc ? l->dateTaken() < r->dateTaken() : r->dateTaken() < l->dateTaken();
+		});
+	}
+	else if (sortMode == DkSettings::sort_date_modified) {
+		parallelSort(images, [asc](const ImgPtr& l, const ImgPtr& r) {
+			return asc ? l->sortKey().modified < r->sortKey().modified : r->sortKey().modified < l->sortKey().modified;
+		});
+	}
+	else {
+#ifdef Q_OS_WIN
+		// keep the explorer's order - the cached wide names are compared (no copies)
+		parallelSort(images, [asc](const ImgPtr& l, const ImgPtr& r) {
+			return asc ? DkUtils::wCompLogic(l->getFileNameWStr(), r->getFileNameWStr()) : DkUtils::wCompLogic(r->getFileNameWStr(), l->getFileNameWStr());
+		});
+#else
+		parallelSort(images, [asc](const ImgPtr& l, const ImgPtr& r) {
+			return asc ? l->sortKey().name < r->sortKey().name : r->sortKey().name < l->sortKey().name;
+		});
+#endif
+	}
+
+	qDebug() << "[DkImageLoader]" << images.size() << "images sorted in" << dt;
 
 	return images;
 }
@@ -795,9 +1152,16 @@ void DkImageLoader::activate(bool isActive /* = true */) {
 void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg) {
 
 	// force index folder if we dir out of the zip
-	if (mCurrentImage && newImg && mCurrentImage->isFromZip() && !newImg->isFromZip())
+	if (mCurrentImage && newImg && mCurrentImage->isFromZip() && !newImg->isFromZip()) {
 		mFolderUpdated = true;
 
+#ifdef WITH_QUAZIP
+		// unlock the archive
+		if (mCurrentImage->getZipData())
+			DkZipArchive::close(mCurrentImage->getZipData()->getZipFilePath());
+#endif
+	}
+
 	if (signalsBlocked()) {
 		mCurrentImage = newImg;
 		return;
@@ -904,6 +1268,10 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
 
 	setCurrentImage(image);
 
+	// the image might be loading as next image already
+	if (mCurrentImage)
+		mCurrentImage->setPriority(DkTaskScheduler::priority_visible);
+
 	if (mCurrentImage && mCurrentImage->getLoadState() == DkImageContainerT::loading)
 		return;
 
@@ -1699,60 +2067,16 @@ void DkImageLoader::errorDialog(const QString& msg) const {
 
 void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC) {
 
-	if (!imgC || !DkSettingsManager::param().resources().cacheMemory)
+	// no caching? forget everything
+	if (!DkSettingsManager::param().resources().cacheMemory) {
+		mCache.clear();
 		return;
-
-	DkTimer dt;
-
-	//// no caching? delete all
-	//if (!DkSettingsManager::param().resources().cacheMemory) {
-	//	for (int idx = 0; idx < images.size(); idx++) {
-	//		images.at(idx)->clear();
-	//	}
-	//	return;
-	//}
-
-	int cIdx = findFileIdx(imgC->filePath(), mImages);
-	float mem = 0;
-
-	if (cIdx == -1) {
-		qDebug() << "WARNING: image not found for caching!";
-		return;
-	}
-
-	for (int idx = 0; idx < mImages.size(); idx++) {
-
-		// clear images if they are edited
-		if (idx != cIdx && mImages.at(idx)->isEdited()) {
-			mImages.at(idx)->clear();
-			continue;
-		}
-
-		if (idx >= cIdx-1 && idx <= cIdx+DkSettingsManager::param().resources().maxImagesCached)
-			mem += mImages.at(idx)->getMemoryUsage();
-		else {
-			mImages.at(idx)->clear();
-			continue;
-		}
-
-		// ignore the last and current one
-		if (idx == cIdx-1 || idx == cIdx) {
-			continue;
-		}
-		// fully load the next image
-		else if (idx == cIdx+1 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			mImages.at(idx)->loadImageThreaded();
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " fully cached...";
-		}
-		else if (idx > cIdx && idx < cIdx+DkSettingsManager::param().resources().maxImagesCached-2 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			//dt.getIvl();
-			mImages.at(idx)->fetchFile();		// TODO: crash detected here
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " file fetched...";
-		}
 	}
 
-	qDebug() << "cache with: " << mem << " MB created in: " << dt;
+	if (!imgC)
+		return;
 
+	mCache.update(mImages, imgC);
 }
 
 /**
@@ -1823,7 +2147,7 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 	// true file list
 	QDir tmpDir = dirPath;
-	tmpDir.setSorting(QDir::LocaleAware);
+	tmpDir.setSorting(QDir::NoSort);	// the containers are sorted anyway
 	QStringList fileList = tmpDir.entryList(DkSettingsManager::param().app().browseFilters);
 	qDebug() << fileList;
 
@@ -1841,7 +2165,7 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 	if (folderKeywords != "") {
 		QStringList filterList = fileList;
-		fileList = DkUtils::filterStringList(folderKeywords, filterList);
+		fileList = DkMetaDataIndex::instance().filter(dirPath, folderKeywords, filterList);
 	}
 
 	if (DkSettingsManager::param().resources().filterDuplicats) {
@@ -1852,31 +2176,34 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 		QStringList resultList = fileList;
 		fileList.clear();
+
+		// count the files with the preferred extension per base name (instead of comparing all pairs)
+		QVector<QString> baseNames;
+		baseNames.reserve(resultList.size());
+		QHash<QString, int> preferredBases;
+
+		for (const QString& cFile : resultList) {
+			baseNames.append(QFileInfo(cFile).baseName());
+			if (cFile.contains(preferredExtension, Qt::CaseInsensitive))
+				preferredBases[baseNames.last()]++;
+		}
 		
 		for (int idx = 0; idx < resultList.size(); idx++) {
 			
-			QFileInfo cFName = QFileInfo(resultList.at(idx));
+			const QString& cFile = resultList.at(idx);
 
-			if (preferredExtension.compare(cFName.suffix(), Qt::CaseInsensitive) == 0) {
-				fileList.append(resultList.at(idx));
+			if (preferredExtension.compare(QFileInfo(cFile).suffix(), Qt::CaseInsensitive) == 0) {
+				fileList.append(cFile);
 				continue;
 			}
 
-			QString cFBase = cFName.baseName();
-			bool remove = false;
-
-			for (int cIdx = 0; cIdx < resultList.size(); cIdx++) {
-
-				QString ccBase = QFileInfo(resultList.at(cIdx)).baseName();
+			// is there another file with the same base name & the preferred extension?
+			int numPreferred = preferredBases.value(baseNames[idx]);
+			if (cFile.contains(preferredExtension, Qt::CaseInsensitive))
+				numPreferred--;
 
-				if (cIdx != idx && ccBase == cFBase && resultList.at(cIdx).contains(preferredExtension, Qt::CaseInsensitive)) {
-					remove = true;
-					break;
-				}
-			}
-			
-			if (!remove)
-				fileList.append(resultList.at(idx));
+			if (numPreferred <= 0)
+				fileList.append(cFile);
 		}
 	}
 
@@ -1892,7 +2219,7 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 void DkImageLoader::sort() {
 	
-	qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+	mImages = sortImages(mImages);
 	emit updateDirSignal(mImages);
 }
 
@@ -55,6 +55,33 @@ class QUrl;
 
 namespace nmc {
 
+/**
+ * Memory budgeted LRU cache for the images of a folder.
+ * Only images that were touched by the cache are visited, so updating
+ * it does not depend on the folder size. Images are prefetched in the
+ * observed navigation direction (and one in the opposite direction).
+ * If the cache exceeds resources().cacheMemory, decoded images are
+ * released first - their file buffers are dropped only if that is not enough.
+ **/ 
+class DllLoaderExport DkImageCache {
+
+public:
+	DkImageCache() {};
+
+	void update(const QVector<QSharedPointer<DkImageContainerT> >& images, QSharedPointer<DkImageContainerT> imgC);
+	void clear();
+	float memoryUsage() const;
+
+protected:
+	int indexOf(const QVector<QSharedPointer<DkImageContainerT> >& images, QSharedPointer<DkImageContainerT> imgC) const;
+	void touch(QSharedPointer<DkImageContainerT> imgC);
+	void evict(float maxMemory, QSharedPointer<DkImageContainerT> imgC);
+
+	QList<QSharedPointer<DkImageContainerT> > mEntries;	// most recently used first
+	int mLastIdx = -1;
+	int mDirection = 1;
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -199,6 +226,7 @@ protected:
 	bool mSortingImages = false;
 	bool mSortingIsDirty = false;
 	QFutureWatcher<QVector<QSharedPointer<DkImageContainerT > > > mCreateImageWatcher;
+	DkImageCache mCache;
 
 };
 
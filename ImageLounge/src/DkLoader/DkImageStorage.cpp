@@ -40,8 +40,19 @@
 #include <QBitmap>
 #include <qmath.h>
 #include <QSvgRenderer>
+#include <QtAlgorithms>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QMutex>
+#include <limits>
 #pragma warning(pop)		// no warnings from includes - end
 
+// SSE2 is available on all x64 machines
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DK_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #if defined(Q_OS_WIN) && !defined(SOCK_STREAM)
 #include <winsock2.h>	// needed since libraw 0.16
 #endif
@@ -306,12 +317,361 @@ float DkImage::getBufferSizeFloat(const QSize& imgSize, const int depth) {
 	return (float)size/(1024.0f*1024.0f);
 }
 
+/**
+ * Filter weights of a separable resampling filter (for one image axis).
+ **/ 
+struct DkResampleWeights {
+	QVector<int> first;		// first source index of each destination index
+	QVector<int> count;		// number of taps of each destination index
+	QVector<float> weights;	// maxTaps weights per destination index
+	int maxTaps = 0;
+};
+
+static double resampleSupport(int interpolation) {
+
+	switch (interpolation) {
+	case DkImage::ipl_area:		return 0.5;
+	case DkImage::ipl_linear:	return 1.0;
+	case DkImage::ipl_lanczos:	return 3.0;
+	default:					return 2.0;
+	}
+}
+
+static double resampleKernel(double t, int interpolation) {
+
+	t = qAbs(t);
+
+	switch (interpolation) {
+	case DkImage::ipl_area:
+		return t < 0.5 ? 1.0 : 0.0;
+	case DkImage::ipl_linear:
+		return t < 1.0 ? 1.0 - t : 0.0;
+	case DkImage::ipl_lanczos:
+		if (t < 1e-8)
+			return 1.0;
+		if (t >= 3.0)
+			return 0.0;
+		return 3.0*qSin(M_PI*t)*qSin(M_PI*t/3.0)/(M_PI*M_PI*t*t);
+	default: {
+		// cubic convolution (Keys, a = -0.5)
+		const double a = -0.5;
+		if (t < 1.0)
+			return ((a+2.0)*t - (a+3.0))*t*t + 1.0;
+		if (t < 2.0)
+			return ((a*t - 5.0*a)*t + 8.0*a)*t - 4.0*a;
+		return 0.0;
+		}
+	}
+}
+
+static DkResampleWeights resampleWeights(int srcSize, int dstSize, int interpolation) {
+
+	DkResampleWeights rw;
+
+	double scale = (double)dstSize/srcSize;
+	double fScale = qMin(scale, 1.0);	// widen the filter if we downsample (anti-aliasing)
+	double radius = resampleSupport(interpolation)/fScale;
+
+	rw.maxTaps = qCeil(radius)*2 + 1;
+	rw.first.resize(dstSize);
+	rw.count.resize(dstSize);
+	rw.weights.fill(0.0f, dstSize*rw.maxTaps);
+
+	for (int idx = 0; idx < dstSize; idx++) {
+
+		double center = (idx + 0.5)/scale - 0.5;
+		int x0 = qBound(0, qCeil(center - radius), srcSize-1);
+		int x1 = qBound(0, qFloor(center + radius), srcSize-1);
+		int n = qBound(1, x1 - x0 + 1, rw.maxTaps);
+		float* w = rw.weights.data() + idx*rw.maxTaps;
+
+		double sum = 0;
+		for (int k = 0; k < n; k++) {
+			w[k] = (float)resampleKernel((x0 + k - center)*fScale, interpolation);
+			sum += w[k];
+		}
+
+		if (sum != 0) {
+			for (int k = 0; k < n; k++)
+				w[k] = (float)(w[k]/sum);
+		}
+		else {
+			// no tap hit - take the nearest pixel
+			for (int k = 0; k < n; k++)
+				w[k] = 0.0f;
+			w[qBound(0, qRound(center) - x0, n-1)] = 1.0f;
+		}
+
+		rw.first[idx] = x0;
+		rw.count[idx] = n;
+	}
+
+	return rw;
+}
+
+/**
+ * A strip of destination rows that is resampled by one thread.
+ **/ 
+struct DkResampleJob {
+	const uchar* src = 0;
+	uchar* dst = 0;
+	int srcBpl = 0;
+	int dstBpl = 0;
+	int srcWidth = 0;
+	int dstWidth = 0;
+	const DkResampleWeights* wx = 0;
+	const DkResampleWeights* wy = 0;
+	int firstRow = 0;
+	int lastRow = 0;
+	bool premultiply = false;	// colors are weighted with alpha while filtering
+};
+
+// the re-gamma table is indexed with quantized linear values
+#define gamma_lut_size 8192
+
+static const float* gammaToLinearLut(int channel) {
+
+	static QVector<float> colorLut;
+	static QVector<float> alphaLut;
+	static QMutex lutMutex;
+
+	QMutexLocker locker(&lutMutex);
+
+	if (colorLut.isEmpty()) {
+		for (int idx = 0; idx < 256; idx++) {
+			double i = idx/255.0;
+			colorLut << (float)((i <= 0.04045) ? i/12.92 : qPow((i+0.055)/1.055, 2.4));
+			alphaLut << (float)i;
+		}
+	}
+
+	// alpha is not gamma corrected
+	int alphaIdx = (QSysInfo::ByteOrder == QSysInfo::LittleEndian) ? 3 : 0;
+
+	return (channel == alphaIdx) ? alphaLut.constData() : colorLut.constData();
+}
+
+static const uchar* linearToGammaLut() {
+
+	static QVector<uchar> lut;
+	static QMutex lutMutex;
+
+	QMutexLocker locker(&lutMutex);
+
+	if (lut.isEmpty()) {
+		for (int idx = 0; idx <= gamma_lut_size; idx++) {
+			double i = (double)idx/gamma_lut_size;
+			double g = (i <= 0.0031308) ? i*12.92 : 1.055*qPow(i, 1/2.4) - 0.055;
+			lut << (uchar)qBound(0, qRound(g*255), 255);
+		}
+	}
+
+	return lut.constData();
+}
+
+static void resampleRows(DkResampleJob& job) {
+
+	const float* toLinear[4] = {gammaToLinearLut(0), gammaToLinearLut(1), gammaToLinearLut(2), gammaToLinearLut(3)};
+	const uchar* toGamma = linearToGammaLut();
+	int alphaIdx = (QSysInfo::ByteOrder == QSysInfo::LittleEndian) ? 3 : 0;
+
+	// horizontally filtered source rows (ring buffer)
+	int ringSize = job.wy->maxTaps;
+	QVector<QVector<float> > ring(ringSize);
+	QVector<int> ringRow(ringSize, -1);
+	for (QVector<float>& r : ring)
+		r.resize(job.dstWidth*4);
+
+	QVector<float> lineLin(job.srcWidth*4);
+	QVector<float> acc(job.dstWidth*4);
+	const DkResampleWeights& wx = *job.wx;
+	const DkResampleWeights& wy = *job.wy;
+
+	for (int rIdx = job.firstRow; rIdx < job.lastRow; rIdx++) {
+
+		int fy = wy.first[rIdx];
+		int ny = wy.count[rIdx];
+		const float* wyk = wy.weights.constData() + rIdx*wy.maxTaps;
+
+		// linearize & filter the source rows we need (horizontal pass)
+		for (int k = 0; k < ny; k++) {
+
+			int sy = fy + k;
+			int slot = sy % ringSize;
+
+			if (ringRow[slot] == sy)
+				continue;
+
+			const uchar* s = job.src + sy*job.srcBpl;
+			float* l = lineLin.data();
+
+			for (int cIdx = 0; cIdx < job.srcWidth; cIdx++, s += 4, l += 4) {
+				l[0] = toLinear[0][s[0]];
+				l[1] = toLinear[1][s[1]];
+				l[2] = toLinear[2][s[2]];
+				l[3] = toLinear[3][s[3]];
+
+				// otherwise transparent pixels bleed their color into the neighbors
+				if (job.premultiply) {
+					float alpha = l[alphaIdx];
+					for (int ch = 0; ch < 4; ch++) {
+						if (ch != alphaIdx)
+							l[ch] *= alpha;
+					}
+				}
+			}
+
+			float* h = ring[slot].data();
+
+			for (int cIdx = 0; cIdx < job.dstWidth; cIdx++, h += 4) {
+
+				const float* p = lineLin.constData() + 4*wx.first[cIdx];
+				const float* w = wx.weights.constData() + cIdx*wx.maxTaps;
+				int nx = wx.count[cIdx];
+
+#ifdef DK_USE_SSE2
+				__m128 sum = _mm_setzero_ps();
+				for (int t = 0; t < nx; t++, p += 4)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[t]), _mm_loadu_ps(p)));
+				_mm_storeu_ps(h, sum);
+#else
+				float sum[4] = {0, 0, 0, 0};
+				for (int t = 0; t < nx; t++, p += 4) {
+					sum[0] += w[t]*p[0];
+					sum[1] += w[t]*p[1];
+					sum[2] += w[t]*p[2];
+					sum[3] += w[t]*p[3];
+				}
+				h[0] = sum[0]; h[1] = sum[1]; h[2] = sum[2]; h[3] = sum[3];
+#endif
+			}
+
+			ringRow[slot] = sy;
+		}
+
+		// vertical pass
+		acc.fill(0.0f);
+		float* a = acc.data();
+		int numVals = job.dstWidth*4;
+
+		for (int k = 0; k < ny; k++) {
+
+			const float* h = ring[(fy + k) % ringSize].constData();
+			float w = wyk[k];
+			int idx = 0;
+
+#ifdef DK_USE_SSE2
+			__m128 wv = _mm_set1_ps(w);
+			for (; idx + 4 <= numVals; idx += 4)
+				_mm_storeu_ps(a + idx, _mm_add_ps(_mm_loadu_ps(a + idx), _mm_mul_ps(wv, _mm_loadu_ps(h + idx))));
+#endif
+			for (; idx < numVals; idx++)
+				a[idx] += w*h[idx];
+		}
+
+		// back to gamma space
+		uchar* d = job.dst + rIdx*job.dstBpl;
+		const float* v = acc.constData();
+
+		for (int cIdx = 0; cIdx < job.dstWidth; cIdx++, v += 4, d += 4) {
+
+			float alpha = qBound(0.0f, v[alphaIdx], 1.0f);
+			float norm = (job.premultiply && alpha > 0.0f) ? 1.0f/alpha : 1.0f;
+
+			for (int ch = 0; ch < 4; ch++) {
+
+				if (ch == alphaIdx)
+					d[ch] = (uchar)qRound(alpha*255.0f);
+				else
+					d[ch] = toGamma[(int)(qBound(0.0f, v[ch]*norm, 1.0f)*gamma_lut_size + 0.5f)];
+			}
+		}
+	}
+}
+
+/**
+ * Resizes an image in linear color space.
+ * The image is linearized, resampled (separable filter) and converted
+ * back to gamma space row by row, so no intermediate image is needed.
+ * The destination rows are split into strips which are processed in parallel.
+ * @param img the image to resize
+ * @param newSize the new size
+ * @param interpolation the interpolation method
+ * @return QImage the resized image
+ **/ 
+static QImage resizeImageLinear(const QImage& img, const QSize& newSize, int interpolation) {
+
+	DkTimer dt;
+	QImage src = img;
+
+	bool gray = false;
+#if QT_VERSION >= 0x050500
+	gray = src.format() == QImage::Format_Grayscale8;
+#endif
+	bool indexed = src.format() == QImage::Format_Indexed8 || 
+		src.format() == QImage::Format_Mono || 
+		src.format() == QImage::Format_MonoLSB;
+
+	// colors are linearized unpremultiplied - they are premultiplied in linear space then
+	bool alpha = src.hasAlphaChannel();
+	QImage::Format fmt = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+
+	if (src.format() != fmt)
+		src = src.convertToFormat(fmt);
+
+	QImage dst(newSize, src.format());
+
+	if (dst.isNull() || src.isNull())
+		return QImage();
+
+	DkResampleWeights wx = resampleWeights(src.width(), dst.width(), interpolation);
+	DkResampleWeights wy = resampleWeights(src.height(), dst.height(), interpolation);
+
+	DkResampleJob job;
+	job.src = src.constBits();
+	job.dst = dst.bits();
+	job.srcBpl = src.bytesPerLine();
+	job.dstBpl = dst.bytesPerLine();
+	job.srcWidth = src.width();
+	job.dstWidth = dst.width();
+	job.wx = &wx;
+	job.wy = &wy;
+	job.premultiply = alpha;
+
+	// strips should not be too small - otherwise we filter too many source rows twice
+	int numJobs = qMax(1, QThreadPool::globalInstance()->maxThreadCount()*2);
+	int rowsPerJob = qMax(32, (dst.height() + numJobs - 1)/numJobs);
+
+	QVector<DkResampleJob> jobs;
+	for (int rIdx = 0; rIdx < dst.height(); rIdx += rowsPerJob) {
+		job.firstRow = rIdx;
+		job.lastRow = qMin(rIdx + rowsPerJob, dst.height());
+		jobs << job;
+	}
+
+	if (jobs.size() == 1)
+		resampleRows(jobs[0]);
+	else
+		QtConcurrent::blockingMap(jobs, resampleRows);
+
+	// restore the input's format (and color table)
+	if (indexed)
+		dst = dst.convertToFormat(img.format(), img.colorTable());
+	else if (gray || img.format() == QImage::Format_ARGB32_Premultiplied)
+		dst = dst.convertToFormat(img.format());
+
+	qDebug() << "[resizeImage]" << img.size() << "->" << newSize << "in" << dt;
+
+	return dst;
+}
+
 /**
  * This function resizes an image according to the interpolation method specified.
  * @param img the image to resize
  * @param newSize the new size
  * @param factor the resize factor
  * @param interpolation the interpolation method
+ * @param correctGamma if true, the image is resized in linear color space
  * @return QImage the resized image
  **/ 
 QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float factor /* = 1.0f */, int interpolation /* = ipl_cubic */, bool correctGamma /* = true */) {
@@ -329,6 +689,10 @@ QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float facto
 		return QImage();
 	}
 
+	// linearize, resample & re-gamma in one pass
+	if (correctGamma && interpolation != ipl_nearest)
+		return resizeImageLinear(img, nSize, interpolation);
+
 	Qt::TransformationMode iplQt = Qt::FastTransformation;
 	switch(interpolation) {
 	case ipl_nearest:	
@@ -353,28 +717,16 @@ QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float facto
 		
 		QImage qImg;
 		cv::Mat resizeImage = DkImage::qImage2Mat(img);
-		
-		if (correctGamma) {
-			resizeImage.convertTo(resizeImage, CV_16U, USHRT_MAX/255.0f);
-			DkImage::gammaToLinear(resizeImage);
-		}
 
 		// is the image convertible?
 		if (resizeImage.empty()) {
-			qImg = img.scaled(newSize, Qt::IgnoreAspectRatio, iplQt);
+			qImg = img.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
 		}
 		else {
 
 			cv::Mat tmp;
 			cv::resize(resizeImage, tmp, cv::Size(nSize.width(), nSize.height()), 0, 0, ipl);
-			resizeImage = tmp;
-			
-			if (correctGamma) {
-				DkImage::linearToGamma(resizeImage);
-				resizeImage.convertTo(resizeImage, CV_8U, 255.0f/USHRT_MAX);
-			}
-
-			qImg = DkImage::mat2QImage(resizeImage);
+			qImg = DkImage::mat2QImage(tmp);
 		}
 
 		if (!img.colorTable().isEmpty())
@@ -389,15 +741,7 @@ QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float facto
 
 #else
 
-	QImage qImg = img.copy();
-	
-	if (correctGamma)
-		DkImage::gammaToLinear(qImg);
-	qImg.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
-	
-	if (correctGamma)
-		DkImage::linearToGamma(qImg);
-	return qImg;
+	return img.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
 #endif
 }
 	
@@ -486,34 +830,174 @@ void DkImage::linearToGamma(QImage& img) {
 void DkImage::mapGammaTable(QImage& img, const QVector<uchar>& gammaTable) {
 
 	DkTimer dt;
+	applyLut(img, gammaTable);
+	qDebug() << "gamma computation takes: " << dt;
+}
 
-	// number of bytes per line used
-	int bpl = (img.width() * img.depth() + 7) / 8;
-	int pad = img.bytesPerLine() - bpl;
+/**
+ * A block of rows that is mapped through lookup tables by one thread.
+ **/ 
+struct DkLutJob {
+	uchar* data = 0;
+	int bpl = 0;
+	int samples = 0;	// samples per row (pixels * channels)
+	int channels = 1;
+	const void* luts[4];	// one table per interleaved channel
+	int firstRow = 0;
+	int lastRow = 0;
+};
 
-	//int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
+template <typename T>
+static void lutRows(DkLutJob& job) {
 
-	uchar* mPtr = img.bits();
+	const T* l0 = (const T*)job.luts[0];
+	const T* l1 = (const T*)job.luts[1];
+	const T* l2 = (const T*)job.luts[2];
+	const T* l3 = (const T*)job.luts[3];
 
-	for (int rIdx = 0; rIdx < img.height(); rIdx++) {
+	for (int rIdx = job.firstRow; rIdx < job.lastRow; rIdx++) {
 
-		for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
+		T* ptr = (T*)(job.data + rIdx*job.bpl);
+		T* end = ptr + job.samples;
 
-			if (*mPtr < 0 || *mPtr > gammaTable.size()) {
-				qDebug() << "WRONG VALUE: " << *mPtr;
-				continue;
+		// SSE2 has no gather, so the lookups are unrolled scalar loads without any branches
+		switch (job.channels) {
+		case 4:
+			for (; ptr + 4 <= end; ptr += 4) {
+				T v0 = l0[ptr[0]], v1 = l1[ptr[1]], v2 = l2[ptr[2]], v3 = l3[ptr[3]];
+				ptr[0] = v0; ptr[1] = v1; ptr[2] = v2; ptr[3] = v3;
 			}
-			if ((int)gammaTable[*mPtr] < 0 || (int)gammaTable[*mPtr] > USHRT_MAX) {
-				qDebug() << "WRONG VALUE: " << *mPtr;
-				continue;
+			break;
+		case 3:
+			for (; ptr + 3 <= end; ptr += 3) {
+				T v0 = l0[ptr[0]], v1 = l1[ptr[1]], v2 = l2[ptr[2]];
+				ptr[0] = v0; ptr[1] = v1; ptr[2] = v2;
 			}
+			break;
+		case 2:
+			for (; ptr + 2 <= end; ptr += 2) {
+				T v0 = l0[ptr[0]], v1 = l1[ptr[1]];
+				ptr[0] = v0; ptr[1] = v1;
+			}
+			break;
+		default:
+			for (; ptr + 4 <= end; ptr += 4) {
+				T v0 = l0[ptr[0]], v1 = l0[ptr[1]], v2 = l0[ptr[2]], v3 = l0[ptr[3]];
+				ptr[0] = v0; ptr[1] = v1; ptr[2] = v2; ptr[3] = v3;
+			}
+			for (; ptr < end; ptr++)
+				*ptr = l0[*ptr];
+		}
+	}
+}
+
+/**
+ * Splits the rows of a buffer into jobs and maps them in the global thread pool.
+ * @param job the buffer description (rows are set here)
+ * @param rows the number of rows
+ * @param sampleSize 1 for 8 bit and 2 for 16 bit samples
+ **/ 
+static void runLutJobs(DkLutJob job, int rows, int sampleSize) {
+
+	// ~4 jobs per thread, small images are mapped in the calling thread
+	int numJobs = (qint64)rows*job.samples < 256*256 ? 1 : qMax(1, QThreadPool::globalInstance()->maxThreadCount()*4);
+	int rowsPerJob = qMax(16, (rows + numJobs - 1)/numJobs);
 
-			*mPtr = gammaTable[*mPtr];
+	QVector<DkLutJob> jobs;
+	for (int rIdx = 0; rIdx < rows; rIdx += rowsPerJob) {
+		job.firstRow = rIdx;
+		job.lastRow = qMin(rIdx + rowsPerJob, rows);
+		jobs << job;
+	}
+
+	void (*fn)(DkLutJob&) = sampleSize == 2 ? lutRows<unsigned short> : lutRows<uchar>;
+
+	if (jobs.size() == 1)
+		fn(jobs[0]);
+	else if (!jobs.empty())
+		QtConcurrent::blockingMap(jobs, fn);
+}
+
+template <typename T>
+static const QVector<T>& identityLut() {
+
+	static QVector<T> lut;
+	static QMutex mutex;
+	QMutexLocker lock(&mutex);
+
+	if (lut.empty()) {
+		lut.resize((int)std::numeric_limits<T>::max() + 1);
+		for (int idx = 0; idx < lut.size(); idx++)
+			lut[idx] = (T)idx;
+	}
+
+	return lut;
+}
+
+/**
+ * Fills the table pointers of a job. Missing or truncated tables are replaced by the identity
+ * so that the inner loop can look up every channel without branching.
+ **/ 
+template <typename T>
+static void setLuts(DkLutJob& job, const QVector<QVector<T> >& luts) {
+
+	const int size = (int)std::numeric_limits<T>::max() + 1;
+
+	for (int cIdx = 0; cIdx < 4; cIdx++) {
+
+		if (cIdx < luts.size() && luts[cIdx].size() >= size)
+			job.luts[cIdx] = luts[cIdx].constData();
+		else {
+			if (cIdx < luts.size() && cIdx < job.channels)
+				qWarning() << "[DkImage] lookup table" << cIdx << "has" << luts[cIdx].size() << "entries, expected" << size << "- ignoring";
+			job.luts[cIdx] = identityLut<T>().constData();
 		}
-		mPtr += pad;
 	}
+}
 
-	qDebug() << "gamma computation takes: " << dt;
+/**
+ * Maps all bytes of an image (including alpha) through a single lookup table.
+ * @param img the image which is changed in place
+ * @param lut a table with 256 entries
+ **/ 
+void DkImage::applyLut(QImage& img, const QVector<uchar>& lut) {
+
+	if (img.isNull())
+		return;
+
+	DkLutJob job;
+	job.data = img.bits();
+	job.bpl = img.bytesPerLine();
+	job.samples = (img.width() * img.depth() + 7) / 8;	// number of bytes per line used
+	job.channels = 1;
+	setLuts(job, QVector<QVector<uchar> >() << lut);
+
+	runLutJobs(job, img.height(), 1);
+}
+
+/**
+ * Maps each channel of an image through its own lookup table.
+ * The tables are applied in memory order which is BGRA for 32 bit images on little endian machines.
+ * Channels without a table are not changed. Images that are neither 32, 24 or 8 bit are converted to ARGB32.
+ * @param img the image which is changed in place
+ * @param luts one table with 256 entries per channel
+ **/ 
+void DkImage::applyLut(QImage& img, const QVector<QVector<uchar> >& luts) {
+
+	if (img.isNull())
+		return;
+
+	if (img.depth() != 32 && img.depth() != 24 && img.depth() != 8)
+		img = img.convertToFormat(QImage::Format_ARGB32);
+
+	DkLutJob job;
+	job.data = img.bits();
+	job.bpl = img.bytesPerLine();
+	job.channels = img.depth() / 8;
+	job.samples = img.width() * job.channels;
+	setLuts(job, luts);
+
+	runLutJobs(job, img.height(), 1);
 }
 
 QImage DkImage::normImage(const QImage& img) {
@@ -997,30 +1481,56 @@ void DkImage::gammaToLinear(cv::Mat& img) {
 void DkImage::mapGammaTable(cv::Mat& img, const QVector<unsigned short>& gammaTable) {
 
 	DkTimer dt;
+	applyLut(img, QVector<QVector<unsigned short> >(img.channels(), gammaTable));
+	qDebug() << "gamma computation takes: " << dt;
+}
 
-	for (int rIdx = 0; rIdx < img.rows; rIdx++) {
+static bool applyLutMat(cv::Mat& img, int depth, DkLutJob& job) {
 
-		unsigned short* mPtr = img.ptr<unsigned short>(rIdx);
+	if (img.empty())
+		return false;
 
-		for (int cIdx = 0; cIdx < img.cols; cIdx++) {
+	if (img.depth() != depth) {
+		qWarning() << "[DkImage] cannot apply lookup table, wrong depth:" << img.depth();
+		return false;
+	}
 
-			for (int channelIdx = 0; channelIdx < img.channels(); channelIdx++, mPtr++) {
+	job.data = img.data;
+	job.bpl = (int)img.step;
+	job.channels = img.channels();
+	job.samples = img.cols * img.channels();
 
-				if (*mPtr < 0 || *mPtr > gammaTable.size()) {
-					qDebug() << "WRONG VALUE: " << *mPtr;
-					continue;
-				}
-				if ((int)gammaTable[*mPtr] < 0 || (int)gammaTable[*mPtr] > USHRT_MAX) {
-					qDebug() << "WRONG VALUE: " << *mPtr;
-					continue;
-				}
+	return true;
+}
 
-				*mPtr = gammaTable[*mPtr];
-			}
-		}
-	}
+/**
+ * Maps each channel of a CV_8U image through its own lookup table.
+ * @param img the image which is changed in place
+ * @param luts one table with 256 entries per channel, channels without a table are not changed
+ **/ 
+void DkImage::applyLut(cv::Mat& img, const QVector<QVector<uchar> >& luts) {
 
-	qDebug() << "gamma computation takes: " << dt;
+	DkLutJob job;
+	if (!applyLutMat(img, CV_8U, job))
+		return;
+
+	setLuts(job, luts);
+	runLutJobs(job, img.rows, 1);
+}
+
+/**
+ * Maps each channel of a CV_16U image through its own lookup table.
+ * @param img the image which is changed in place
+ * @param luts one table with 65536 entries per channel, channels without a table are not changed
+ **/ 
+void DkImage::applyLut(cv::Mat& img, const QVector<QVector<unsigned short> >& luts) {
+
+	DkLutJob job;
+	if (!applyLutMat(img, CV_16U, job))
+		return;
+
+	setLuts(job, luts);
+	runLutJobs(job, img.rows, 2);
 }
 
 void DkImage::logPolar(const cv::Mat& src, cv::Mat& dst, CvPoint2D32f center, double scaleLog, double angle, double scale) {
@@ -1253,6 +1763,159 @@ QColor DkImage::getMeanColor(const QImage& img) {
 		return DkSettingsManager::param().display().hudBgColor;
 }
 
+/**
+ * A block of rows that is downsampled by one thread.
+ **/ 
+struct DkDownsampleJob {
+	const uchar* src = 0;
+	uchar* dst = 0;
+	int srcBpl = 0;
+	int dstBpl = 0;
+	int width = 0;		// destination width
+	int depth = 0;
+	int firstRow = 0;	// destination rows
+	int lastRow = 0;
+};
+
+static void downsampleRows(DkDownsampleJob& job) {
+
+	for (int rIdx = job.firstRow; rIdx < job.lastRow; rIdx++) {
+
+		const uchar* r0 = job.src + (2*rIdx)*job.srcBpl;
+		const uchar* r1 = r0 + job.srcBpl;
+		uchar* d = job.dst + rIdx*job.dstBpl;
+		int cIdx = 0;
+
+		if (job.depth == 32) {
+
+#ifdef DK_USE_SSE2
+			// 8 source pixels -> 4 destination pixels
+			// the sums are computed with 16 bit so that the rounding matches the scalar code
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+
+			for (; cIdx + 4 <= job.width; cIdx += 4) {
+
+				__m128i half[2];
+
+				for (int hIdx = 0; hIdx < 2; hIdx++) {
+
+					__m128i a = _mm_loadu_si128((const __m128i*)(r0 + cIdx*8 + hIdx*16));
+					__m128i b = _mm_loadu_si128((const __m128i*)(r1 + cIdx*8 + hIdx*16));
+
+					// vertical sums of 2 pixels each
+					__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+					__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+					// add the neighboring pixel
+					lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+					hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+					half[hIdx] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+				}
+
+				_mm_storeu_si128((__m128i*)(d + cIdx*4), _mm_packus_epi16(half[0], half[1]));
+			}
+#endif
+			for (; cIdx < job.width; cIdx++) {
+
+				const uchar* p0 = r0 + cIdx*8;
+				const uchar* p1 = r1 + cIdx*8;
+				uchar* pd = d + cIdx*4;
+
+				for (int ch = 0; ch < 4; ch++)
+					pd[ch] = (uchar)((p0[ch] + p0[ch+4] + p1[ch] + p1[ch+4] + 2) >> 2);
+			}
+		}
+		else {
+
+#ifdef DK_USE_SSE2
+			// 32 source pixels -> 16 destination pixels
+			// the sums are computed with 16 bit so that the rounding matches the scalar code
+			const __m128i lowMask = _mm_set1_epi16(0x00FF);
+			const __m128i two = _mm_set1_epi16(2);
+
+			for (; cIdx + 16 <= job.width; cIdx += 16) {
+
+				__m128i half[2];
+
+				for (int hIdx = 0; hIdx < 2; hIdx++) {
+
+					__m128i a = _mm_loadu_si128((const __m128i*)(r0 + cIdx*2 + hIdx*16));
+					__m128i b = _mm_loadu_si128((const __m128i*)(r1 + cIdx*2 + hIdx*16));
+
+					// even + odd pixels of both rows
+					__m128i sum = _mm_add_epi16(
+						_mm_add_epi16(_mm_and_si128(a, lowMask), _mm_srli_epi16(a, 8)),
+						_mm_add_epi16(_mm_and_si128(b, lowMask), _mm_srli_epi16(b, 8)));
+
+					half[hIdx] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+				}
+
+				_mm_storeu_si128((__m128i*)(d + cIdx), _mm_packus_epi16(half[0], half[1]));
+			}
+#endif
+			for (; cIdx < job.width; cIdx++)
+				d[cIdx] = (uchar)((r0[2*cIdx] + r0[2*cIdx+1] + r1[2*cIdx] + r1[2*cIdx+1] + 2) >> 2);
+		}
+	}
+}
+
+/**
+ * Downsamples an image by a factor of 2 using a 2x2 box filter.
+ * The rows are split across the global thread pool. 32 bit and
+ * grayscale images are processed directly, all other formats are converted first.
+ * Note: odd image dimensions are truncated.
+ * @param img the image to be downsampled
+ * @return QImage the image with half the size
+ **/ 
+QImage DkImage::downsample2x(const QImage& img) {
+
+	QImage src = img;
+
+	bool gray = false;
+#if QT_VERSION >= 0x050500
+	gray = src.format() == QImage::Format_Grayscale8;
+#endif
+
+	if (!gray &&
+		src.format() != QImage::Format_ARGB32 &&
+		src.format() != QImage::Format_ARGB32_Premultiplied &&
+		src.format() != QImage::Format_RGB32) {
+		src = src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+	}
+
+	QImage dst(src.width()/2, src.height()/2, src.format());
+
+	if (dst.isNull())
+		return dst;
+
+	DkDownsampleJob job;
+	job.src = src.constBits();
+	job.dst = dst.bits();
+	job.srcBpl = src.bytesPerLine();
+	job.dstBpl = dst.bytesPerLine();
+	job.width = dst.width();
+	job.depth = src.depth();
+
+	// ~4 jobs per thread for a good load balance
+	int numJobs = qMax(1, QThreadPool::globalInstance()->maxThreadCount()*4);
+	int rowsPerJob = qMax(16, (dst.height() + numJobs - 1)/numJobs);
+
+	QVector<DkDownsampleJob> jobs;
+	for (int rIdx = 0; rIdx < dst.height(); rIdx += rowsPerJob) {
+		job.firstRow = rIdx;
+		job.lastRow = qMin(rIdx + rowsPerJob, dst.height());
+		jobs << job;
+	}
+
+	if (jobs.size() == 1)
+		downsampleRows(jobs[0]);
+	else
+		QtConcurrent::blockingMap(jobs, downsampleRows);
+
+	return dst;
+}
 
 // DkImageStorage --------------------------------------------------------------------
 DkImageStorage::DkImageStorage(const QImage& img) {
@@ -1268,8 +1931,15 @@ DkImageStorage::DkImageStorage(const QImage& img) {
 void DkImageStorage::setImage(const QImage& img) {
 
 	mStop = true;
-	mImgs.clear();	// is it save (if the thread is still working?)
 	mImg = img;
+
+	QMutexLocker locker(&mMutex);
+	mImgs.clear();
+	mTileSource = img;
+	mTiles.clear();
+	mTileAccess.clear();
+	mTileRequests.clear();
+	mTileMemory = 0;
 }
 
 void DkImageStorage::antiAliasingChanged(bool antiAliasing) {
@@ -1278,6 +1948,7 @@ void DkImageStorage::antiAliasingChanged(bool antiAliasing) {
 
 	if (!antiAliasing) {
 		mStop = true;
+		QMutexLocker locker(&mMutex);
 		mImgs.clear();
 	}
 
@@ -1297,11 +1968,13 @@ QImage DkImageStorage::getImage(float factor) {
 		return mImg;
 
 	// check if we have an image similar to that requested
+	QMutexLocker locker(&mMutex);
 	for (int idx = 0; idx < mImgs.size(); idx++) {
 
 		if ((float)mImgs.at(idx).height()/mImg.height() >= factor)
 			return mImgs.at(idx);
 	}
+	locker.unlock();
 
 	// if the image does not exist - create it
 	if (!mBusy && mImgs.empty() && /*img.colorTable().isEmpty() &&*/ mImg.width() > 32 && mImg.height() > 32) {
@@ -1323,34 +1996,19 @@ void DkImageStorage::computeImage() {
 	DkTimer dt;
 	mBusy = true;
 	QImage resizedImg = mImg;
-	
 
 	// down sample the image until it is twice times full HD
-	QSize iSize = mImg.size();
-	while (iSize.width() > 2*1920 && iSize.height() > 2*1920)	// in general we need less than 200 ms for the whole downscaling if we start at 1500 x 1500
-		iSize *= 0.5;
-
-	// for extreme panorama images the Qt scaling crashes (if we have a width > 30000) so we simply 
-	if (qMax(iSize.width(), iSize.height()) < 20000)
-		resizedImg = resizedImg.scaled(iSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+	// we do not keep these levels since they are hardly used
+	while (resizedImg.width() > 2*1920 && resizedImg.height() > 2*1920 && !mStop)
+		resizedImg = DkImage::downsample2x(resizedImg);
 
 	// it would be pretty strange if we needed more than 30 sub-images
-	for (int idx = 0; idx < 30; idx++) {
+	for (int idx = 0; idx < 30 && !mStop; idx++) {
 
-		QSize s = resizedImg.size();
-		s *= 0.5;
-
-		if (s.width() < 32 || s.height() < 32)
+		if (resizedImg.width()/2 < 32 || resizedImg.height()/2 < 32)
 			break;
 
-#ifdef WITH_OPENCV
-		cv::Mat rImgCv = DkImage::qImage2Mat(resizedImg);
-		cv::Mat tmp;
-		cv::resize(rImgCv, tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
-		resizedImg = DkImage::mat2QImage(tmp);
-#else
-		resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-#endif
+		resizedImg = DkImage::downsample2x(resizedImg);
 
 		// new image assigned?
 		if (mStop)
@@ -1359,13 +2017,13 @@ void DkImageStorage::computeImage() {
 		mMutex.lock();
 		mImgs.push_front(resizedImg);
 		mMutex.unlock();
+
+		// publish every level as soon as it is ready
+		emit imageUpdated();
 	}
 
 	mBusy = false;
 
-	// tell my caller I did something
-	emit imageUpdated();
-
 	qDebug() << "pyramid computation took me: " << dt << " layers: " << mImgs.size();
 
 	if (mImgs.size() > 6)
@@ -1373,4 +2031,226 @@ void DkImageStorage::computeImage() {
 
 }
 
+// tile keys: level (8 bit) | row (28 bit) | column (28 bit)
+static quint64 tileKey(int level, int row, int col) {
+	return ((quint64)level << 56) | ((quint64)row << 28) | (quint64)col;
+}
+
+static int tileLevel(quint64 key) {
+	return (int)(key >> 56);
+}
+
+/**
+ * Draws the image to targetRect.
+ * Large images are split into tiles of a resolution pyramid.
+ * Only tiles that intersect the visible rect are drawn,
+ * missing tiles are computed in the background.
+ * @param painter the painter
+ * @param targetRect the image rect in painter coordinates
+ * @param visibleRect the image region that is currently visible (in image coordinates)
+ * @param factor the current zoom factor
+ **/ 
+void DkImageStorage::draw(QPainter& painter, const QRectF& targetRect, const QRectF& visibleRect, float factor) {
+
+	QImage img = getImage(factor);
+
+	// the pyramid has an image for us or the image is small anyway
+	if (img.size() != mImg.size() || (qint64)mImg.width()*mImg.height() < tile_min_pixels) {
+		painter.drawImage(targetRect, img, img.rect());
+		return;
+	}
+
+	// find the pyramid level
+	int level = 0;
+	if (DkSettingsManager::param().display().antiAliasing && factor > 0 && factor < 1.0f)
+		level = qBound(0, qFloor(qLn(1.0/factor)/qLn(2.0)), 16);
+
+	int lts = tile_size << level;	// tile size in image coordinates
+	QRect vr = visibleRect.toAlignedRect() & mImg.rect();
+
+	if (vr.isEmpty())
+		return;
+
+	double sx = targetRect.width()/mImg.width();
+	double sy = targetRect.height()/mImg.height();
+
+	QMutexLocker locker(&mMutex);
+	QImage fallback = mImgs.empty() ? mImg : mImgs.last();
+	mPaintCount++;
+	mTileRequests.clear();	// we are only interested in what is visible now
+
+	for (int rIdx = vr.top()/lts; rIdx <= vr.bottom()/lts; rIdx++) {
+		for (int cIdx = vr.left()/lts; cIdx <= vr.right()/lts; cIdx++) {
+
+			quint64 key = tileKey(level, rIdx, cIdx);
+			QRect r = tileRect(mImg.size(), key);
+			QRectF tr(targetRect.x() + r.x()*sx, targetRect.y() + r.y()*sy, r.width()*sx, r.height()*sy);
+
+			QHash<quint64, QImage>::const_iterator tIt = mTiles.constFind(key);
+
+			if (tIt != mTiles.constEnd()) {
+				painter.drawImage(tr, tIt.value(), tIt.value().rect());
+				mTileAccess[key] = mPaintCount;
+			}
+			else {
+				// draw what we have until the tile is ready
+				double fs = (double)fallback.width()/mImg.width();
+				QRectF fr(r.x()*fs, r.y()*fs, r.width()*fs, r.height()*fs);
+				painter.drawImage(tr, fallback, fr);
+				mTileRequests << key;
+			}
+		}
+	}
+
+	if (!mTileRequests.empty() && !mTilesQueued) {
+		mTilesQueued = true;
+		QMetaObject::invokeMethod(this, "computeTiles", Qt::QueuedConnection);
+	}
+}
+
+/**
+ * Computes the tiles requested by draw().
+ * Tiles are published as soon as they are ready.
+ **/ 
+void DkImageStorage::computeTiles() {
+
+	DkTimer dt;
+	int numTiles = 0;
+
+	while (true) {
+
+		quint64 key;
+		QImage img;
+
+		{
+			QMutexLocker locker(&mMutex);
+
+			if (mTileRequests.empty()) {
+				mTilesQueued = false;
+				break;
+			}
+
+			key = mTileRequests.takeFirst();
+
+			if (mTiles.contains(key) || mTileSource.isNull())
+				continue;
+
+			img = mTileSource;
+		}
+
+		QImage tile = computeTile(img, key);
+
+		QMutexLocker locker(&mMutex);
+
+		// new image assigned?
+		if (img.cacheKey() != mTileSource.cacheKey())
+			continue;
+
+		mTiles.insert(key, tile);
+		mTileAccess.insert(key, mPaintCount);
+		mTileMemory += tile.bytesPerLine()*tile.height();
+		numTiles++;
+
+		// let the viewport draw the first tiles while we are working
+		if (numTiles % 4 == 0)
+			emit imageUpdated();
+	}
+
+	evictTiles();
+
+	if (numTiles > 0) {
+		emit imageUpdated();
+		qDebug() << numTiles << "tiles computed in" << dt;
+	}
+}
+
+/**
+ * Computes a single tile.
+ * @param img the full resolution image
+ * @param key the tile's key
+ * @return QImage the tile in a format that can be painted without conversion.
+ **/ 
+QImage DkImageStorage::computeTile(const QImage& img, quint64 key) const {
+
+	int level = tileLevel(key);
+	QRect r = tileRect(img.size(), key);
+	QImage region;
+
+	// copying the region would be way too expensive for coarse levels - so we work on a shallow view
+	if (img.depth() >= 8) {
+		region = QImage(img.constScanLine(r.top()) + r.left()*(img.depth()/8), r.width(), r.height(), img.bytesPerLine(), img.format());
+		region.setColorTable(img.colorTable());
+	}
+	else
+		region = img.copy(r);
+
+	QImage tile;
+
+	if (level == 0)
+		tile = region.copy();	// deep copy - the view does not own its data
+	else {
+		QSize ts(qCeil((double)r.width()/(1 << level)), qCeil((double)r.height()/(1 << level)));
+		tile = region.scaled(ts, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
+
+	// the raster engine draws these formats without converting them
+	QImage::Format format = tile.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+	if (tile.format() != format)
+		tile = tile.convertToFormat(format);
+
+	return tile;
+}
+
+/**
+ * Returns the region of a tile in image coordinates.
+ * @param imgSize the full resolution image size
+ * @param key the tile's key
+ **/ 
+QRect DkImageStorage::tileRect(const QSize& imgSize, quint64 key) const {
+
+	int level = tileLevel(key);
+	int row = (int)((key >> 28) & 0xFFFFFFF);
+	int col = (int)(key & 0xFFFFFFF);
+	int lts = tile_size << level;
+
+	// tiles overlap by one (level) pixel - otherwise we would see seams when interpolating
+	QRect r(col*lts, row*lts, lts + (1 << level), lts + (1 << level));
+
+	return r & QRect(QPoint(), imgSize);
+}
+
+/**
+ * Removes the least recently drawn tiles if the tile cache is full.
+ **/ 
+void DkImageStorage::evictTiles() {
+
+	QMutexLocker locker(&mMutex);
+
+	qint64 maxMemory = (qint64)tile_cache_size*1024*1024;
+
+	if (mTileMemory <= maxMemory)
+		return;
+
+	QVector<QPair<quint64, quint64> > tiles;
+	tiles.reserve(mTileAccess.size());
+
+	for (QHash<quint64, quint64>::const_iterator aIt = mTileAccess.constBegin(); aIt != mTileAccess.constEnd(); aIt++)
+		tiles << qMakePair(aIt.value(), aIt.key());
+
+	// least recently drawn first
+	qSort(tiles);
+
+	for (const QPair<quint64, quint64>& t : tiles) {
+
+		// never remove tiles that are visible now
+		if (mTileMemory <= maxMemory || t.first == mPaintCount)
+			break;
+
+		const QImage& tile = mTiles[t.second];
+		mTileMemory -= tile.bytesPerLine()*tile.height();
+		mTiles.remove(t.second);
+		mTileAccess.remove(t.second);
+	}
+}
+
 }
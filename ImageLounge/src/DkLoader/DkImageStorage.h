@@ -33,6 +33,9 @@
 #include <QVector>
 #include <QObject>
 #include <QColor>
+#include <QHash>
+#include <QList>
+#include <QRectF>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -61,6 +64,7 @@ class QPixmap;
 class QString;
 class QSize;
 class QColor;
+class QPainter;
 
 namespace nmc {
 
@@ -91,6 +95,8 @@ public:
 	static QImage mat2QImage(cv::Mat img);
 	static cv::Mat get1DGauss(double sigma);
 	static void mapGammaTable(cv::Mat& img, const QVector<unsigned short>& gammaTable);
+	static void applyLut(cv::Mat& img, const QVector<QVector<uchar> >& luts);
+	static void applyLut(cv::Mat& img, const QVector<QVector<unsigned short> >& luts);
 	static void gammaToLinear(cv::Mat& img);
 	static void linearToGamma(cv::Mat& img);
 	static void logPolar(const cv::Mat& src, cv::Mat& dst, CvPoint2D32f center, double scaleLog, double angle, double scale = 1.0);
@@ -101,6 +107,7 @@ public:
 	static QString getBufferSize(const QSize& imgSize, const int depth);
 	static float getBufferSizeFloat(const QSize& imgSize, const int depth);
 	static QImage resizeImage(const QImage& img, const QSize& newSize, float factor = 1.0f, int interpolation = ipl_cubic, bool correctGamma = true);
+	static QImage downsample2x(const QImage& img);
 
 	template <typename numFmt>
 	static QVector<numFmt> getGamma2LinearTable(int maxVal = USHRT_MAX);
@@ -109,6 +116,8 @@ public:
 	static void gammaToLinear(QImage& img);
 	static void linearToGamma(QImage& img);
 	static void mapGammaTable(QImage& img, const QVector<uchar>& gammaTable);
+	static void applyLut(QImage& img, const QVector<uchar>& lut);
+	static void applyLut(QImage& img, const QVector<QVector<uchar> >& luts);
 	static QImage normImage(const QImage& img);
 	static bool normImage(QImage& img);
 	static QImage autoAdjustImage(const QImage& img);
@@ -134,15 +143,23 @@ class DllLoaderExport DkImageStorage : public QObject {
 public:
 	DkImageStorage(const QImage& img = QImage());
 
+	enum {
+		tile_size = 512,				// tile edge length in pixels
+		tile_min_pixels = 4096*4096,	// smaller images are drawn at once
+		tile_cache_size = 256,			// MB
+	};
+
 	void setImage(const QImage& img);
 	QImage getImageConst() const;
 	QImage getImage(float factor = 1.0f);
+	void draw(QPainter& painter, const QRectF& targetRect, const QRectF& visibleRect, float factor = 1.0f);
 	bool hasImage() const {
 		return !mImg.isNull();
 	}
 
 public slots:
 	void computeImage();
+	void computeTiles();
 	void antiAliasingChanged(bool antiAliasing);
 
 signals:
@@ -150,9 +167,22 @@ signals:
 	void infoSignal(const QString& msg) const;
 
 protected:
+	QImage computeTile(const QImage& img, quint64 key) const;
+	QRect tileRect(const QSize& imgSize, quint64 key) const;
+	void evictTiles();
+
 	QImage mImg;
 	QVector<QImage> mImgs;
 
+	// tiles of large images (guarded by mMutex)
+	QImage mTileSource;
+	QHash<quint64, QImage> mTiles;
+	QHash<quint64, quint64> mTileAccess;
+	QList<quint64> mTileRequests;
+	qint64 mTileMemory = 0;
+	quint64 mPaintCount = 0;
+	bool mTilesQueued = false;
+
 	QMutex mMutex;
 	QThread* mComputeThread = 0;
 	bool mBusy = false;
@@ -30,6 +30,7 @@
 #include "DkMath.h"
 #include "DkImageStorage.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTranslator>
@@ -39,8 +40,18 @@
 #include <QBuffer>
 #include <QVector2D>
 #include <QApplication>
+#include <QFileInfo>
+#include <QVector>
+#include <QtEndian>
+#include <QDir>
+#include <QSet>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QtConcurrentMap>
 #pragma warning(pop)		// no warnings from includes - end
 
+#include <algorithm>
+
 namespace nmc {
 
 // DkMetaDataT --------------------------------------------------------------------
@@ -58,6 +69,7 @@ void DkMetaDataT::readMetaData(const QString& filePath, QSharedPointer<QByteArra
 
 	mFilePath = filePath;
 	QFileInfo fileInfo(filePath);
+	mExifBuffer.clear();
 
 	try {
 		if (!ba || ba->isEmpty()) {
@@ -77,6 +89,8 @@ void DkMetaDataT::readMetaData(const QString& filePath, QSharedPointer<QByteArra
 #endif
 		}
 		else {
+			// MemIo does not copy the data
+			mExifBuffer = ba;
 			Exiv2::MemIo::AutoPtr exifBuffer(new Exiv2::MemIo((const byte*)ba->constData(), ba->size()));
 			mExifImg = Exiv2::ImageFactory::open(exifBuffer);
 		}
@@ -136,9 +150,13 @@ bool DkMetaDataT::saveMetaData(const QString& filePath, bool force) {
 		return false;
 	}
 
-	file.open(QFile::WriteOnly);
-	file.write(ba->data(), ba->size());
-	file.close();
+	// the file might be mapped (see DkFileBuffer) - so it is replaced rather than truncated
+	QSaveFile saveFile(filePath);
+
+	if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(*ba) != ba->size() || !saveFile.commit()) {
+		qWarning() << "[DkMetaDataT] could not write: " << QFileInfo(filePath).fileName();
+		return false;
+	}
 
 	qDebug() << "[DkMetaDataT] I saved: " << ba->size() << " bytes";
 
@@ -192,8 +210,10 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray>& ba, bool force) {
 	if (exifBuf.pData_) {
 		QSharedPointer<QByteArray> tmp = QSharedPointer<QByteArray>(new QByteArray((const char*)exifBuf.pData_, exifBuf.size_));
 
-		if (tmp->size() > qRound(ba->size()*0.5f))
+		if (tmp->size() > qRound(ba->size()*0.5f)) {
+			mExifBuffer = ba;	// exifImgN's MemIo was opened on it
 			ba = tmp;
+		}
 		else
 			return false;	// catch exif bug - observed e.g. for hasselblad RAW (3fr) files - see: Bug #995 (http://dev.exiv2.org/issues/995)
 	}
@@ -206,6 +226,98 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray>& ba, bool force) {
 	return true;
 }
 
+/**
+ * Inserts the exif & xmp segments into a freshly encoded jpg.
+ * Other than saveMetaData(), the encoded buffer is not parsed
+ * by exiv2 - the segments are spliced in right after the header.
+ * @param ba an encoded jpg without meta data
+ * @return bool false if the buffer is no jpg or the meta data
+ * does not fit into segments - use saveMetaData() then
+ **/ 
+bool DkMetaDataT::insertJpgSegments(QSharedPointer<QByteArray>& ba) {
+
+	if (mExifState != loaded && mExifState != dirty)
+		return false;
+
+	// SOI + next marker
+	if (!ba || ba->size() < 4 || (uchar)ba->at(0) != 0xFF || (uchar)ba->at(1) != 0xD8 || (uchar)ba->at(2) != 0xFF)
+		return false;
+
+	// iptc needs a photoshop segment - let exiv2 handle that
+	if (!mExifImg->iptcData().empty())
+		return false;
+
+	const int maxSegmentSize = 0xFFFF - 2;	// the segment's length field is included in the 16 bit length
+	QByteArray segments;
+
+	try {
+		const Exiv2::ExifData& exifData = mExifImg->exifData();
+
+		if (!exifData.empty()) {
+
+			Exiv2::ByteOrder bo = mExifImg->byteOrder();
+			if (bo == Exiv2::invalidByteOrder)
+				bo = Exiv2::littleEndian;
+
+			Exiv2::Blob blob;
+			Exiv2::ExifParser::encode(blob, bo, exifData);
+
+			QByteArray payload = QByteArray("Exif\0\0", 6) + QByteArray((const char*)blob.data(), (int)blob.size());
+			if (payload.size() > maxSegmentSize)
+				return false;
+
+			segments += jpgSegment(0xE1, payload);
+		}
+
+		const Exiv2::XmpData& xmpData = mExifImg->xmpData();
+
+		if (!xmpData.empty()) {
+
+			std::string packet;
+			if (Exiv2::XmpParser::encode(packet, xmpData, Exiv2::XmpParser::useCompactFormat | Exiv2::XmpParser::omitAllFormatting))
+				return false;
+
+			QByteArray payload = QByteArray("http://ns.adobe.com/xap/1.0/", 29) + QByteArray(packet.data(), (int)packet.size());
+			if (payload.size() > maxSegmentSize)
+				return false;
+
+			segments += jpgSegment(0xE1, payload);
+		}
+	}
+	catch (...) {
+		qDebug() << "[DkMetaDataT] could not encode meta data segments";
+		return false;
+	}
+
+	// exif follows the JFIF header (if there is one)
+	int pos = 2;
+	if ((uchar)ba->at(3) == 0xE0 && ba->size() > 6 && ba->mid(6, 4) == "JFIF")
+		pos += 2 + (((uchar)ba->at(4) << 8) | (uchar)ba->at(5));
+
+	if (pos > ba->size())
+		return false;
+
+	ba->insert(pos, segments);
+	mExifState = loaded;
+
+	return true;
+}
+
+QByteArray DkMetaDataT::jpgSegment(uchar marker, const QByteArray& payload) const {
+
+	int length = payload.size() + 2;
+
+	QByteArray segment;
+	segment.reserve(length + 2);
+	segment.append((char)0xFF);
+	segment.append((char)marker);
+	segment.append((char)((length >> 8) & 0xFF));
+	segment.append((char)(length & 0xFF));
+	segment.append(payload);
+
+	return segment;
+}
+
 QString DkMetaDataT::getDescription() const {
 
 	QString description;
@@ -641,14 +753,29 @@ void DkMetaDataT::getAllMetaData(QStringList& keys, QStringList& values) const {
 QImage DkMetaDataT::getThumbnail() const {
 
 	QImage qThumb;
+	QByteArray ba = getThumbnailData();
+
+	if (!ba.isEmpty())
+		qThumb.loadFromData(ba);
+
+	return qThumb;
+}
+
+/**
+ * Returns the encoded exif thumbnail.
+ * @return QByteArray the thumbnail's data (e.g. a jpg) - empty if there is no thumbnail
+ **/ 
+QByteArray DkMetaDataT::getThumbnailData() const {
+
+	QByteArray ba;
 
 	if (mExifState != loaded && mExifState != dirty)
-		return qThumb;
+		return ba;
 
 	Exiv2::ExifData &exifData = mExifImg->exifData();
 
 	if (exifData.empty())
-		return qThumb;
+		return ba;
 
 	try {
 		Exiv2::ExifThumb thumb(exifData);
@@ -656,9 +783,7 @@ QImage DkMetaDataT::getThumbnail() const {
 		
 		// ok, get the buffer...
 		std::pair<Exiv2::byte*, long> stdBuf = buffer.release();
-		QByteArray ba = QByteArray((char*)stdBuf.first, (int)stdBuf.second);
-		
-		qThumb.loadFromData(ba);
+		ba = QByteArray((char*)stdBuf.first, (int)stdBuf.second);
 
 		delete[] stdBuf.first;
 	}
@@ -666,7 +791,7 @@ QImage DkMetaDataT::getThumbnail() const {
 		qDebug() << "Sorry, I could not load the thumb from the exif data...";
 	}
 
-	return qThumb;
+	return ba;
 }
 
 QImage DkMetaDataT::getPreviewImage(int minPreviewWidth) const {
@@ -1444,6 +1569,1089 @@ bool DkMetaDataT::setXMPValue(Exiv2::XmpData& xmpData, QString xmpKey, QString x
 //	xmpSidecar->writeMetadata();
 //}
 
+// DkExifScanner --------------------------------------------------------------------
+/**
+ * Scans the file's header.
+ * @param filePath the file path
+ * @return bool true if the file is a JPG or TIFF based file
+ **/ 
+bool DkExifScanner::scan(const QString& filePath) {
+
+	mFile.setFileName(filePath);
+
+	if (!mFile.open(QIODevice::ReadOnly))
+		return false;
+
+	mData = mFile.read(header_size);
+
+	bool scanned = scan(mData);
+	mFile.close();
+
+	return scanned;
+}
+
+/**
+ * Scans a file's content (or its first bytes).
+ * @param data the data starting with the file's header
+ * @return bool true if the data is a JPG or TIFF based file
+ **/ 
+bool DkExifScanner::scan(const QByteArray& data) {
+
+	mData = data;
+
+	if (mData.size() < 8)
+		return false;
+
+	if ((uchar)mData[0] == 0xFF && (uchar)mData[1] == 0xD8)
+		return scanJpg();
+
+	return scanTiff(0);
+}
+
+/**
+ * Returns the orientation in degrees (see DkMetaDataT::getOrientationDegree()).
+ * @return int the orientation - -1 if the orientation is illegal
+ **/ 
+int DkExifScanner::orientation() const {
+
+	return mOrientation;
+}
+
+/**
+ * Returns the rating like DkMetaDataT::getRating() does.
+ * @return int the rating - -1 if the image is not rated
+ **/ 
+int DkExifScanner::rating() const {
+
+	if (mXmpRating != -1 && mExifRating == -1)
+		return mXmpRating;
+
+	return mExifRating;
+}
+
+QSize DkExifScanner::imageSize() const {
+
+	return mImageSize;
+}
+
+/**
+ * Returns the native exif value of a key that was scanned.
+ * @param key the exif key (e.g. Exif.Photo.DateTimeOriginal)
+ * @return QString the value - empty if it was not found
+ **/ 
+QString DkExifScanner::value(const QString& key) const {
+
+	return mValues.value(key);
+}
+
+/**
+ * Returns the encoded exif thumbnail.
+ * @return QByteArray the thumbnail (a jpg) - empty if there is none
+ **/ 
+QByteArray DkExifScanner::thumbnail() const {
+
+	return mThumbnail;
+}
+
+/**
+ * Returns the regions of embedded jpgs (exif thumbnail, RAW previews).
+ * The regions are not validated - they might e.g. exceed the file.
+ * @return QVector<DkExifScanner::Region> the jpg regions (largest first)
+ **/ 
+QVector<DkExifScanner::Region> DkExifScanner::previews() const {
+
+	QVector<Region> previews = mPreviews;
+	std::sort(previews.begin(), previews.end(), [](const Region& l, const Region& r) {
+		return l.size > r.size;
+	});
+
+	return previews;
+}
+
+bool DkExifScanner::scanJpg() {
+
+	qint64 pos = 2;
+
+	// APP segments are stored before the image data
+	while (pos < max_header_size) {
+
+		QByteArray marker = bytes(pos, 4);
+
+		if (marker.size() < 2 || (uchar)marker[0] != 0xFF)
+			break;
+
+		uchar type = (uchar)marker[1];
+
+		// fill bytes & markers without payload
+		if (type == 0xFF) {
+			pos++;
+			continue;
+		}
+		if (type == 0x01 || (type >= 0xD0 && type <= 0xD8)) {
+			pos += 2;
+			continue;
+		}
+
+		// start of scan or end of image
+		if (type == 0xDA || type == 0xD9 || marker.size() < 4)
+			break;
+
+		quint16 length = qFromBigEndian<quint16>((const uchar*)marker.constData()+2);
+
+		if (length < 2)
+			break;
+
+		// APP1 holds exif & xmp
+		if (type == 0xE1) {
+
+			QByteArray segment = bytes(pos+4, length-2);
+
+			if (segment.startsWith(QByteArray("Exif\0\0", 6)))
+				scanTiff(pos+4+6);
+			else if (segment.startsWith("http://ns.adobe.com/xap/1.0/"))
+				scanXmp(segment);
+		}
+
+		pos += 2 + length;
+	}
+
+	// a jpg without exif is scanned completely too
+	return true;
+}
+
+bool DkExifScanner::scanTiff(qint64 tiffOffset) {
+
+	QByteArray header = bytes(tiffOffset, 8);
+
+	if (header.size() < 8)
+		return false;
+
+	if (header.startsWith("II"))
+		mBigEndian = false;
+	else if (header.startsWith("MM"))
+		mBigEndian = true;
+	else
+		return false;
+
+	// 42 is TIFF - ORF & RW2 use their own magic numbers
+	quint16 magic = toUInt16(header.constData()+2);
+	if (magic != 42 && magic != 0x4F52 && magic != 0x5352 && magic != 0x55)
+		return false;
+
+	quint32 ifd1Offset = 0;
+	scanIfd(tiffOffset, toUInt32(header.constData()+4), ifd_image, &ifd1Offset);
+
+	if (ifd1Offset)
+		scanIfd(tiffOffset, ifd1Offset, ifd_thumbnail);
+
+	return true;
+}
+
+void DkExifScanner::scanIfd(qint64 tiffOffset, quint32 ifdOffset, Ifd ifd, quint32* nextIfdOffset) {
+
+	if (ifdOffset < 8)
+		return;
+
+	QByteArray countBytes = bytes(tiffOffset+ifdOffset, 2);
+
+	if (countBytes.size() < 2)
+		return;
+
+	int numEntries = toUInt16(countBytes.constData());
+
+	if (numEntries > max_entries)
+		return;
+
+	QByteArray entries = bytes(tiffOffset+ifdOffset+2, numEntries*12+4);
+
+	if (entries.size() < numEntries*12)
+		return;
+
+	// sizes of the TIFF types (BYTE, ASCII, SHORT, LONG, RATIONAL, SBYTE, UNDEFINED, SSHORT, SLONG, SRATIONAL, FLOAT, DOUBLE, IFD)
+	static const int typeSizes[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 4};
+
+	quint32 exifOffset = 0;
+	quint32 thumbOffset = 0;
+	quint32 thumbLength = 0;
+	quint32 compression = 0;
+	quint32 photometric = 0;
+	quint32 stripOffset = 0;
+	quint32 stripLength = 0;
+	QVector<quint32> subIfdOffsets;
+
+	for (int idx = 0; idx < numEntries; idx++) {
+
+		const char* entry = entries.constData() + idx*12;
+		quint16 tag = toUInt16(entry);
+		quint16 type = toUInt16(entry+2);
+		quint32 count = toUInt32(entry+4);
+
+		if (type == 0 || type > 13)
+			continue;
+
+		qint64 size = (qint64)count*typeSizes[type];
+
+		// Panasonic stores the full jpg as value (JpgFromRaw) - we just remember where it is
+		if (ifd == ifd_image && tag == 0x002E && size > 4) {
+			Region r;
+			r.offset = tiffOffset+toUInt32(entry+8);
+			r.size = size;
+			mPreviews << r;
+			continue;
+		}
+
+		if (size > max_value_size)
+			continue;
+
+		// values with 4 bytes or less are stored in the entry
+		QByteArray val = size <= 4 ? QByteArray(entry+8, (int)size) : bytes(tiffOffset+toUInt32(entry+8), size);
+
+		if (val.size() < size)
+			continue;
+
+		if (ifd == ifd_image) {
+
+			switch (tag) {
+			case 0x010F: mValues.insert("Exif.Image.Make", toString(val));		break;
+			case 0x0110: mValues.insert("Exif.Image.Model", toString(val));		break;
+			case 0x0132: mValues.insert("Exif.Image.DateTime", toString(val));	break;
+			case 0x4746: mExifRating = (int)toUInt(type, val);					break;
+			case 0x8769: exifOffset = toUInt(type, val);						break;
+			case 0x02BC: scanXmp(val);											break;
+			case 0x014A: 
+				// SubIFDs are LONG or IFD offsets - anything else would be read out of bounds
+				if (type != 4 && type != 13)
+					break;
+				for (int sIdx = 0; sIdx < val.size()/4 && sIdx < max_sub_ifds; sIdx++)
+					subIfdOffsets << toUInt32(val.constData() + sIdx*4);
+				break;
+			case 0x0112: {
+				int o = (int)toUInt(type, val);
+				mValues.insert("Exif.Image.Orientation", QString::number(o));
+
+				switch (o) {
+				case 6: case 7:	mOrientation = 90;	break;
+				case 3: case 4:	mOrientation = 180;	break;
+				case 8: case 5:	mOrientation = -90;	break;
+				case 1:			mOrientation = 0;	break;
+				default:		mOrientation = -1;	break;
+				}
+				break;
+			}
+			}
+		}
+		else if (ifd == ifd_exif) {
+
+			switch (tag) {
+			case 0x9003: mValues.insert("Exif.Photo.DateTimeOriginal", toString(val));	break;
+			case 0xA002: mImageSize.setWidth((int)toUInt(type, val));					break;
+			case 0xA003: mImageSize.setHeight((int)toUInt(type, val));				break;
+			}
+		}
+
+		// jpg data of IFD0 (e.g. CR2 previews), the thumbnail IFD and the SubIFDs (e.g. NEF previews)
+		if (ifd != ifd_exif) {
+
+			switch (tag) {
+			case 0x0201: thumbOffset = toUInt(type, val);	break;
+			case 0x0202: thumbLength = toUInt(type, val);	break;
+			case 0x0103: compression = toUInt(type, val);	break;
+			case 0x0106: photometric = toUInt(type, val);	break;
+			case 0x0111: if (count == 1) stripOffset = toUInt(type, val);	break;
+			case 0x0117: if (count == 1) stripLength = toUInt(type, val);	break;
+			}
+		}
+	}
+
+	if (nextIfdOffset && entries.size() >= numEntries*12+4)
+		*nextIfdOffset = toUInt32(entries.constData() + numEntries*12);
+
+	if (exifOffset)
+		scanIfd(tiffOffset, exifOffset, ifd_exif);
+
+	for (quint32 o : subIfdOffsets)
+		scanIfd(tiffOffset, o, ifd_preview);
+
+	if (thumbOffset && thumbLength) {
+		Region r;
+		r.offset = tiffOffset+thumbOffset;
+		r.size = thumbLength;
+		mPreviews << r;
+	}
+
+	// jpg compressed strips - but not the (lossless jpg) CFA or linear raw data
+	if (stripOffset && stripLength && (compression == 6 || compression == 7) && 
+		photometric != 32803 && photometric != 34892) {
+		Region r;
+		r.offset = tiffOffset+stripOffset;
+		r.size = stripLength;
+		mPreviews << r;
+	}
+
+	if (ifd == ifd_thumbnail && thumbOffset && thumbLength && thumbLength <= max_value_size)
+		mThumbnail = bytes(tiffOffset+thumbOffset, thumbLength);
+}
+
+void DkExifScanner::scanXmp(const QByteArray& xmp) {
+
+	// xmp:Rating="3" or <xmp:Rating>3</xmp:Rating>
+	QRegExp exp("xmp:Rating(?:=\"|>)(-?\\d+)");
+
+	if (exp.indexIn(QString::fromUtf8(xmp)) == -1) {
+		exp = QRegExp("MicrosoftPhoto:Rating(?:=\"|>)(-?\\d+)");
+
+		if (exp.indexIn(QString::fromUtf8(xmp)) == -1)
+			return;
+	}
+
+	mXmpRating = exp.cap(1).toInt();
+}
+
+/**
+ * Returns bytes of the file.
+ * They are taken from the header if possible - otherwise they are read from the file.
+ * @param offset the offset w.r.t. the file start
+ * @param size the number of bytes
+ * @return QByteArray the bytes - might be shorter than size if the file ends
+ **/ 
+QByteArray DkExifScanner::bytes(qint64 offset, qint64 size) {
+
+	if (offset < 0 || size <= 0)
+		return QByteArray();
+
+	if (offset + size <= mData.size() || !mFile.isOpen())
+		return mData.mid((int)qMin(offset, (qint64)mData.size()), (int)size);
+
+	if (!mFile.seek(offset))
+		return QByteArray();
+
+	return mFile.read(size);
+}
+
+quint16 DkExifScanner::toUInt16(const char* data) const {
+
+	return mBigEndian ? qFromBigEndian<quint16>((const uchar*)data) : qFromLittleEndian<quint16>((const uchar*)data);
+}
+
+quint32 DkExifScanner::toUInt32(const char* data) const {
+
+	return mBigEndian ? qFromBigEndian<quint32>((const uchar*)data) : qFromLittleEndian<quint32>((const uchar*)data);
+}
+
+quint32 DkExifScanner::toUInt(quint16 type, const QByteArray& data) const {
+
+	if ((type == 3 || type == 8) && data.size() >= 2)
+		return toUInt16(data.constData());
+	if ((type == 4 || type == 9 || type == 13) && data.size() >= 4)
+		return toUInt32(data.constData());
+	if ((type == 1 || type == 7) && data.size() >= 1)
+		return (uchar)data[0];
+
+	return 0;
+}
+
+QString DkExifScanner::toString(const QByteArray& data) const {
+
+	int end = data.indexOf('\0');
+	return QString::fromLatin1(data.constData(), end == -1 ? data.size() : end).trimmed();
+}
+
+// DkMetaDataRecord --------------------------------------------------------------------
+DkMetaDataRecord::DkMetaDataRecord(const DkMetaDataT& metaData, const QString& filePath) {
+
+	mFilePath = filePath;
+	mHasMetaData = metaData.hasMetaData();
+
+	if (!mHasMetaData)
+		return;
+
+	try {
+		mOrientation = metaData.getOrientationDegree();
+		mRating = metaData.getRating();
+		mImageSize = metaData.getImageSize();
+		mDescription = metaData.getDescription();
+		mThumbnail = metaData.getThumbnailData();
+
+		for (const QString& key : exifKeys()) {
+
+			QString val = metaData.getNativeExifValue(key);
+
+			if (!val.isEmpty())
+				mExifValues.insert(key, val);
+		}
+	}
+	catch (...) {
+		qWarning() << "[DkMetaDataRecord] could not summarize the metadata of" << filePath;
+	}
+
+	mDateTaken = QDateTime::fromString(exifValue("Exif.Photo.DateTimeOriginal"), "yyyy:MM:dd hh:mm:ss");
+}
+
+/**
+ * Creates a record from the file header.
+ * Values that are not scanned (e.g. the description) are empty.
+ * @param scanner a scanner that scanned the file
+ * @param filePath the file path
+ **/ 
+DkMetaDataRecord::DkMetaDataRecord(const DkExifScanner& scanner, const QString& filePath) {
+
+	mFilePath = filePath;
+	mComplete = false;
+	mOrientation = scanner.orientation();
+	mRating = scanner.rating();
+	mImageSize = scanner.imageSize();
+	mThumbnail = scanner.thumbnail();
+
+	for (const QString& key : exifKeys()) {
+
+		QString val = scanner.value(key);
+
+		if (!val.isEmpty())
+			mExifValues.insert(key, val);
+	}
+
+	mHasMetaData = !mExifValues.isEmpty() || !mThumbnail.isEmpty() || mRating != -1;
+	mDateTaken = QDateTime::fromString(exifValue("Exif.Photo.DateTimeOriginal"), "yyyy:MM:dd hh:mm:ss");
+}
+
+/**
+ * The exif keys that are kept by a record.
+ * @return QStringList the native exif keys
+ **/ 
+QStringList DkMetaDataRecord::exifKeys() {
+
+	static QStringList keys = QStringList()
+		<< "Exif.Image.Make"
+		<< "Exif.Image.Model"
+		<< "Exif.Image.DateTime"
+		<< "Exif.Photo.DateTimeOriginal"
+		<< "Exif.Photo.ExposureTime"
+		<< "Exif.Photo.FNumber"
+		<< "Exif.Photo.FocalLength"
+		<< "Exif.Photo.ISOSpeedRatings"
+		<< "Exif.Photo.Flash"
+		<< "Exif.GPSInfo.GPSLatitude"
+		<< "Exif.GPSInfo.GPSLatitudeRef"
+		<< "Exif.GPSInfo.GPSLongitude"
+		<< "Exif.GPSInfo.GPSLongitudeRef"
+		<< "Exif.GPSInfo.GPSAltitude";
+
+	return keys;
+}
+
+QString DkMetaDataRecord::filePath() const {
+
+	return mFilePath;
+}
+
+/**
+ * Returns false if the record was scanned from the file header only.
+ * @return bool true if exiv2 parsed the file
+ **/ 
+bool DkMetaDataRecord::isComplete() const {
+
+	return mComplete;
+}
+
+bool DkMetaDataRecord::hasMetaData() const {
+
+	return mHasMetaData;
+}
+
+int DkMetaDataRecord::orientation() const {
+
+	return mOrientation;
+}
+
+int DkMetaDataRecord::rating() const {
+
+	return mRating;
+}
+
+QSize DkMetaDataRecord::imageSize() const {
+
+	return mImageSize;
+}
+
+QDateTime DkMetaDataRecord::dateTaken() const {
+
+	return mDateTaken;
+}
+
+QString DkMetaDataRecord::description() const {
+
+	return mDescription;
+}
+
+QString DkMetaDataRecord::exifValue(const QString& key) const {
+
+	return mExifValues.value(key);
+}
+
+bool DkMetaDataRecord::hasGps() const {
+
+	return mExifValues.contains("Exif.GPSInfo.GPSLatitude") && mExifValues.contains("Exif.GPSInfo.GPSLongitude");
+}
+
+QImage DkMetaDataRecord::thumbnail() const {
+
+	QImage thumb;
+
+	if (!mThumbnail.isEmpty())
+		thumb.loadFromData(mThumbnail);
+
+	return thumb;
+}
+
+bool DkMetaDataRecord::isTiff() const {
+
+	return QFileInfo(mFilePath).suffix().contains(QRegExp("(tif|tiff)", Qt::CaseInsensitive));
+}
+
+bool DkMetaDataRecord::isJpg() const {
+
+	return QFileInfo(mFilePath).suffix().contains(QRegExp("(jpg|jpeg)", Qt::CaseInsensitive));
+}
+
+bool DkMetaDataRecord::isRaw() const {
+
+	return QFileInfo(mFilePath).suffix().contains(QRegExp("(nef|crw|cr2|arw)", Qt::CaseInsensitive));
+}
+
+/**
+ * Returns the approximate memory needed by this record.
+ * @return int the number of bytes
+ **/ 
+int DkMetaDataRecord::memoryUsage() const {
+
+	int bytes = sizeof(*this) + mThumbnail.size() + (mFilePath.size() + mDescription.size())*(int)sizeof(QChar);
+
+	for (auto it = mExifValues.constBegin(); it != mExifValues.constEnd(); it++)
+		bytes += (it.key().size() + it.value().size())*(int)sizeof(QChar);
+
+	return bytes;
+}
+
+/**
+ * Writes a record - the exif thumbnail is not written.
+ **/ 
+QDataStream& operator<<(QDataStream& ds, const DkMetaDataRecord& record) {
+
+	ds << record.mFilePath << record.mHasMetaData << (qint32)record.mOrientation << (qint32)record.mRating
+		<< record.mImageSize << record.mDateTaken << record.mDescription << record.mExifValues;
+
+	return ds;
+}
+
+/**
+ * Reads a record written by operator<<.
+ * Such records are incomplete since the thumbnail is missing.
+ **/ 
+QDataStream& operator>>(QDataStream& ds, DkMetaDataRecord& record) {
+
+	qint32 orientation = 0, rating = -1;
+
+	ds >> record.mFilePath >> record.mHasMetaData >> orientation >> rating
+		>> record.mImageSize >> record.mDateTaken >> record.mDescription >> record.mExifValues;
+
+	record.mOrientation = orientation;
+	record.mRating = rating;
+	record.mComplete = false;
+	record.mThumbnail.clear();
+
+	return ds;
+}
+
+// DkMetaDataCache --------------------------------------------------------------------
+DkMetaDataCache& DkMetaDataCache::instance() {
+
+	static DkMetaDataCache inst;
+	return inst;
+}
+
+/**
+ * Returns the metadata record of a file.
+ * The file is parsed only if the cache has no record of its current version.
+ * @param filePath the file path
+ * @param ba the file's content (optional)
+ * @return QSharedPointer<DkMetaDataRecord> the record (never NULL)
+ **/ 
+QSharedPointer<DkMetaDataRecord> DkMetaDataCache::record(const QString& filePath, QSharedPointer<QByteArray> ba) {
+
+	QSharedPointer<DkMetaDataRecord> r = find(filePath);
+
+	if (r && r->isComplete())
+		return r;
+
+	DkMetaDataT metaData;
+
+	try {
+		metaData.readMetaData(filePath, ba);
+	}
+	catch (...) {
+		// we keep an empty record - otherwise we parse broken files over & over
+	}
+
+	r = QSharedPointer<DkMetaDataRecord>(new DkMetaDataRecord(metaData, filePath));
+	insert(filePath, r);
+
+	return r;
+}
+
+/**
+ * Returns the metadata record of a file - scanned from the header if possible.
+ * Use this if orientation, rating, capture date, size or the exif thumbnail
+ * are needed. Files that cannot be scanned are parsed by exiv2.
+ * @param filePath the file path
+ * @param ba the file's content (optional)
+ * @return QSharedPointer<DkMetaDataRecord> the record (never NULL)
+ **/ 
+QSharedPointer<DkMetaDataRecord> DkMetaDataCache::header(const QString& filePath, QSharedPointer<QByteArray> ba) {
+
+	QSharedPointer<DkMetaDataRecord> r = find(filePath);
+
+	if (r)
+		return r;
+
+	DkExifScanner scanner;
+	bool scanned = (ba && !ba->isEmpty()) ? scanner.scan(*ba) : scanner.scan(filePath);
+
+	if (!scanned)
+		return record(filePath, ba);
+
+	r = QSharedPointer<DkMetaDataRecord>(new DkMetaDataRecord(scanner, filePath));
+	insert(filePath, r);
+
+	return r;
+}
+
+QSharedPointer<DkMetaDataRecord> DkMetaDataCache::find(const QString& filePath) {
+
+	QString k = key(filePath);
+
+	QMutexLocker locker(&mMutex);
+
+	auto it = mEntries.find(k);
+	if (it == mEntries.end())
+		return QSharedPointer<DkMetaDataRecord>();
+
+	it->lastAccess = ++mNumAccesses;
+
+	return it->record;
+}
+
+/**
+ * Adds a record - e.g. if the metadata was parsed for loading the image.
+ * @param filePath the file path
+ * @param record the file's metadata record
+ **/ 
+void DkMetaDataCache::insert(const QString& filePath, QSharedPointer<DkMetaDataRecord> record) {
+
+	if (!record)
+		return;
+
+	QString k = key(filePath);
+
+	QMutexLocker locker(&mMutex);
+
+	auto it = mEntries.find(k);
+	if (it != mEntries.end())
+		mMemory -= it->record->memoryUsage();
+
+	Entry e;
+	e.record = record;
+	e.lastAccess = ++mNumAccesses;
+
+	mEntries.insert(k, e);
+	mMemory += record->memoryUsage();
+
+	if (mMemory > max_memory)
+		evict(max_memory*3/4);	// remove some more, so that we do not evict on every insert
+}
+
+void DkMetaDataCache::clear() {
+
+	QMutexLocker locker(&mMutex);
+	mEntries.clear();
+	mMemory = 0;
+}
+
+QString DkMetaDataCache::key(const QString& filePath) const {
+
+	QFileInfo fi(filePath);
+
+	return filePath + "|" + QString::number(fi.size()) + "|" + QString::number(fi.lastModified().toMSecsSinceEpoch());
+}
+
+/**
+ * Removes the least recently used records.
+ * The mutex must be locked.
+ * @param maxBytes the memory left
+ **/ 
+void DkMetaDataCache::evict(qint64 maxBytes) {
+
+	QVector<QPair<qint64, QString> > entries;
+	for (auto it = mEntries.constBegin(); it != mEntries.constEnd(); it++)
+		entries << qMakePair(it->lastAccess, it.key());
+
+	std::sort(entries.begin(), entries.end());
+
+	for (const QPair<qint64, QString>& e : entries) {
+
+		if (mMemory <= maxBytes)
+			break;
+
+		mMemory -= mEntries.value(e.second).record->memoryUsage();
+		mEntries.remove(e.second);
+	}
+}
+
+// DkMetaDataIndex --------------------------------------------------------------------
+DkMetaDataIndex::DkMetaDataIndex() {
+
+	mIndexDir = DkUtils::getAppDataPath() + QDir::separator() + "metadata";
+}
+
+DkMetaDataIndex::~DkMetaDataIndex() {
+
+	save();
+}
+
+DkMetaDataIndex& DkMetaDataIndex::instance() {
+
+	static DkMetaDataIndex inst;
+	return inst;
+}
+
+/**
+ * Returns the metadata record of a file.
+ * The record is taken from the index if it knows the file's current version.
+ * Otherwise the header is scanned (see DkMetaDataCache::header()) and indexed.
+ * @param filePath the file path
+ * @return QSharedPointer<DkMetaDataRecord> the record (never NULL) - indexed records have no thumbnail
+ **/ 
+QSharedPointer<DkMetaDataRecord> DkMetaDataIndex::record(const QString& filePath) {
+
+	QSharedPointer<DkMetaDataRecord> r = find(filePath);
+
+	if (r)
+		return r;
+
+	r = DkMetaDataCache::instance().header(filePath);
+
+	QFileInfo fInfo(filePath);
+
+	// e.g. files within zip archives
+	if (!fInfo.isFile())
+		return r;
+
+	Entry e;
+	e.size = fInfo.size();
+	e.modified = fInfo.lastModified().toMSecsSinceEpoch();
+	e.record = QSharedPointer<DkMetaDataRecord>(new DkMetaDataRecord(*r));
+	e.record->mThumbnail.clear();	// the thumbs have their own cache
+	e.record->mComplete = false;
+
+	QMutexLocker locker(&mMutex);
+	Folder& f = folder(fInfo.absolutePath());
+	f.entries.insert(fInfo.fileName(), e);
+	f.dirty = true;
+
+	return r;
+}
+
+/**
+ * Returns the indexed record of a file.
+ * @param filePath the file path
+ * @return QSharedPointer<DkMetaDataRecord> the record - NULL if the file's current version is not indexed
+ **/ 
+QSharedPointer<DkMetaDataRecord> DkMetaDataIndex::find(const QString& filePath) {
+
+	QFileInfo fInfo(filePath);
+
+	if (!fInfo.isFile())
+		return QSharedPointer<DkMetaDataRecord>();
+
+	qint64 size = fInfo.size();
+	qint64 modified = fInfo.lastModified().toMSecsSinceEpoch();
+
+	QMutexLocker locker(&mMutex);
+	const Folder& f = folder(fInfo.absolutePath());
+
+	auto it = f.entries.constFind(fInfo.fileName());
+	if (it == f.entries.constEnd() || it->size != size || it->modified != modified)
+		return QSharedPointer<DkMetaDataRecord>();
+
+	return it->record;
+}
+
+/**
+ * Updates the index of a folder if its content changed.
+ * Entries of modified or deleted files are removed - new files are indexed
+ * when their metadata is requested. Other folders are saved and unloaded.
+ * @param dirPath the folder
+ * @param files the folder's (filtered) files
+ **/ 
+void DkMetaDataIndex::update(const QString& dirPath, const QFileInfoList& files) {
+
+	DkTimer dt;
+	QString dir = QDir(dirPath).absolutePath();
+
+	QHash<QString, QPair<qint64, qint64> > listed;
+	for (const QFileInfo& fInfo : files) {
+		if (fInfo.absolutePath() == dir)
+			listed.insert(fInfo.fileName(), qMakePair(fInfo.size(), fInfo.lastModified().toMSecsSinceEpoch()));
+	}
+
+	QMutexLocker locker(&mMutex);
+
+	for (const QString& cDir : mFolders.keys()) {
+
+		if (cDir != dir) {
+			saveFolder(cDir, mFolders[cDir]);
+			mFolders.remove(cDir);
+		}
+	}
+
+	Folder& f = folder(dir);
+	int numRemoved = 0;
+
+	for (auto it = f.entries.begin(); it != f.entries.end();) {
+
+		bool valid = false;
+
+		if (listed.contains(it.key())) {
+			const QPair<qint64, qint64>& v = listed.value(it.key());
+			valid = v.first == it->size && v.second == it->modified;
+		}
+		else {
+			// the file might just be filtered
+			QFileInfo fInfo(dir, it.key());
+			valid = fInfo.isFile() && fInfo.size() == it->size && fInfo.lastModified().toMSecsSinceEpoch() == it->modified;
+		}
+
+		if (valid)
+			it++;
+		else {
+			it = f.entries.erase(it);
+			numRemoved++;
+		}
+	}
+
+	if (numRemoved > 0) {
+		f.dirty = true;
+		qDebug() << "[DkMetaDataIndex]" << numRemoved << "outdated entries removed in" << dt;
+	}
+}
+
+/**
+ * Filters file names by a query.
+ * A file matches if its name matches (see DkUtils::filterStringList()) or if
+ * its indexed metadata (camera, description, capture date) contains all words of the query.
+ * A word rating:N matches files that are rated with at least N stars.
+ * Files that are not indexed yet are indexed first (their headers are scanned in parallel).
+ * @param dirPath the files' folder
+ * @param query the query - words are separated by white spaces
+ * @param fileNames the file names
+ * @return QStringList the matching file names (in the order of fileNames)
+ **/ 
+QStringList DkMetaDataIndex::filter(const QString& dirPath, const QString& query, const QStringList& fileNames) {
+
+	QStringList nameMatches = DkUtils::filterStringList(query, fileNames);
+	QStringList words = query.split(" ", QString::SkipEmptyParts);
+
+	// rating:N words filter by the minimal rating
+	int minRating = -1;
+	for (int idx = words.size()-1; idx >= 0; idx--) {
+
+		if (words[idx].startsWith("rating:", Qt::CaseInsensitive)) {
+			bool ok = false;
+			int rating = words[idx].mid(7).toInt(&ok);
+
+			if (ok) {
+				minRating = qMax(minRating, rating);
+				words.removeAt(idx);
+			}
+		}
+	}
+
+	if (words.empty() && minRating < 0)
+		return nameMatches;
+
+	// the rating needs metadata - file names cannot match
+	if (minRating >= 0)
+		nameMatches.clear();
+
+	QDir dir(dirPath);
+	QStringList missing;
+
+	{
+		QMutexLocker locker(&mMutex);
+		const Folder& f = folder(dir.absolutePath());
+
+		for (const QString& name : fileNames) {
+			if (!f.entries.contains(name))
+				missing << dir.absoluteFilePath(name);
+		}
+	}
+
+	// e.g. the folder was never sorted by date
+	if (!missing.empty()) {
+		DkTimer dt;
+		QtConcurrent::blockingMap(missing, [this](const QString& filePath) { record(filePath); });
+		qDebug() << "[DkMetaDataIndex]" << missing.size() << "files indexed for searching in" << dt;
+	}
+
+	QSet<QString> metaMatches;
+
+	{
+		QMutexLocker locker(&mMutex);
+		const Folder& f = folder(dir.absolutePath());
+
+		for (auto it = f.entries.constBegin(); it != f.entries.constEnd(); it++) {
+
+			const QSharedPointer<DkMetaDataRecord>& r = it->record;
+
+			if (minRating >= 0 && r->rating() < minRating)
+				continue;
+
+			QString text = r->exifValue("Exif.Image.Make") + " " +
+				r->exifValue("Exif.Image.Model") + " " +
+				r->description() + " " +
+				r->dateTaken().toString("yyyy-MM-dd hh:mm");
+
+			bool match = true;
+			for (const QString& w : words) {
+				if (!text.contains(w, Qt::CaseInsensitive)) {
+					match = false;
+					break;
+				}
+			}
+
+			if (match)
+				metaMatches.insert(it.key());
+		}
+	}
+
+	if (metaMatches.empty())
+		return nameMatches;
+
+	QSet<QString> nameSet = nameMatches.toSet();
+	QStringList result;
+
+	for (const QString& name : fileNames) {
+		if (nameSet.contains(name) || metaMatches.contains(name))
+			result << name;
+	}
+
+	return result;
+}
+
+/**
+ * Writes all modified folder indexes.
+ **/ 
+void DkMetaDataIndex::save() {
+
+	QMutexLocker locker(&mMutex);
+
+	for (auto it = mFolders.begin(); it != mFolders.end(); it++)
+		saveFolder(it.key(), it.value());
+}
+
+/**
+ * Returns the index of a folder - it is loaded if needed.
+ * The mutex must be locked.
+ * @param dirPath the absolute folder path
+ * @return DkMetaDataIndex::Folder& the folder's index
+ **/ 
+DkMetaDataIndex::Folder& DkMetaDataIndex::folder(const QString& dirPath) {
+
+	auto it = mFolders.find(dirPath);
+	if (it != mFolders.end())
+		return it.value();
+
+	Folder& f = mFolders[dirPath];
+
+	QFile file(indexPath(dirPath));
+	if (!file.open(QIODevice::ReadOnly))
+		return f;
+
+	DkTimer dt;
+	QDataStream ds(&file);
+	quint32 magic = 0;
+	qint32 version = 0, numEntries = 0;
+	QString indexedDir;
+	ds >> magic >> version >> indexedDir >> numEntries;
+
+	// different folders might have the same hash
+	if (magic != 0x6e4d6449 || version != 1 || indexedDir != dirPath)
+		return f;
+
+	// each entry needs at least its name's length and the file size - don't trust corrupt counts
+	if (numEntries < 0 || numEntries > (file.size() - file.pos())/12) {
+		qWarning() << "[DkMetaDataIndex] corrupt index of" << dirPath << "- it will be rebuilt";
+		f.dirty = true;
+		return f;
+	}
+
+	f.entries.reserve(numEntries);
+
+	for (int idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+
+		QString name;
+		Entry e;
+		e.record = QSharedPointer<DkMetaDataRecord>(new DkMetaDataRecord());
+		ds >> name >> e.size >> e.modified >> *e.record;
+		f.entries.insert(name, e);
+	}
+
+	if (ds.status() != QDataStream::Ok) {
+		qWarning() << "[DkMetaDataIndex] corrupt index of" << dirPath << "- it will be rebuilt";
+		f.entries.clear();
+		f.dirty = true;
+	}
+	else
+		qDebug() << "[DkMetaDataIndex]" << f.entries.size() << "records of" << dirPath << "loaded in" << dt;
+
+	return f;
+}
+
+/**
+ * Writes a folder's index if it was modified.
+ * The mutex must be locked.
+ * @param dirPath the absolute folder path
+ * @param f the folder's index
+ **/ 
+void DkMetaDataIndex::saveFolder(const QString& dirPath, Folder& f) {
+
+	if (!f.dirty)
+		return;
+
+	QDir().mkpath(mIndexDir);
+
+	QSaveFile file(indexPath(dirPath));
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkMetaDataIndex] could not save index to" << mIndexDir;
+		return;
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)0x6e4d6449 << (qint32)1;	// magic (nMdI) + version
+	ds << dirPath << (qint32)f.entries.size();
+
+	for (auto it = f.entries.constBegin(); it != f.entries.constEnd(); it++)
+		ds << it.key() << it->size << it->modified << *it->record;
+
+	if (file.commit())
+		f.dirty = false;
+}
+
+QString DkMetaDataIndex::indexPath(const QString& dirPath) const {
+
+	QString name = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+	return QDir(mIndexDir).absoluteFilePath(name + ".dat");
+}
+
 // DkMetaDataHelper --------------------------------------------------------------------
 void DkMetaDataHelper::init() {
 
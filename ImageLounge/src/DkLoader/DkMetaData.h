@@ -31,6 +31,14 @@
 #include <QSharedPointer>
 #include <QStringList>
 #include <QMap>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QDateTime>
+#include <QSize>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
 
 //code for metadata crop:
 #include "DkMath.h"
@@ -83,6 +91,7 @@ public:
 	void readMetaData(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
 	bool saveMetaData(const QString& filePath, bool force = false);
 	bool saveMetaData(QSharedPointer<QByteArray>& ba, bool force = false);
+	bool insertJpgSegments(QSharedPointer<QByteArray>& ba);
 
 	int getOrientationDegree() const;
 	ExifOrientationState checkExifOrientation() const;
@@ -96,6 +105,7 @@ public:
 	QString getIptcValue(const QString& key) const;
 	QString getQtValue(const QString& key) const;
 	QImage getThumbnail() const;
+	QByteArray getThumbnailData() const;
 	QImage getPreviewImage(int minPreviewWidth = 0) const;
 	QStringList getExifKeys() const;
 	QStringList getExifValues() const;
@@ -136,6 +146,7 @@ public:
 
 protected:
 	Exiv2::Image::AutoPtr loadSidecar(const QString& filePath) const;
+	QByteArray jpgSegment(uchar marker, const QByteArray& payload) const;
 
 	enum {
 		not_loaded,
@@ -145,6 +156,7 @@ protected:
 	};
 
 	Exiv2::Image::AutoPtr mExifImg;
+	QSharedPointer<QByteArray> mExifBuffer;	// exiv2 reads from this memory (might be mapped) - keep it as long as mExifImg
 	QString mFilePath;
 	QStringList mQtKeys;
 	QStringList mQtValues;
@@ -153,6 +165,211 @@ protected:
 	bool mUseSidecar = false;
 };
 
+/**
+ * Reads a few exif tags straight from the file header.
+ * JPGs and TIFF based files (TIFF, DNG, NEF, CR2, ARW, ORF, RW2...) are
+ * supported. Only the header (and the exif values it points to) is read
+ * and no exiv2 objects are created - so it is cheap enough for scanning
+ * whole folders in parallel. If scan() returns false, the file needs
+ * to be parsed by exiv2 (DkMetaDataT).
+ * The scanner also locates embedded jpgs (see previews()) - their data is not read.
+ **/
+class DllLoaderExport DkExifScanner {
+
+public:
+	DkExifScanner() {};
+
+	struct Region {
+		qint64 offset = 0;	// w.r.t. the file start
+		qint64 size = 0;
+	};
+
+	bool scan(const QString& filePath);
+	bool scan(const QByteArray& data);
+
+	int orientation() const;
+	int rating() const;
+	QSize imageSize() const;
+	QString value(const QString& key) const;
+	QByteArray thumbnail() const;
+	QVector<Region> previews() const;
+
+protected:
+	enum {
+		max_sub_ifds = 8,
+		header_size = 64*1024,		// bytes read at once
+		max_header_size = 1024*1024,	// jpg segments beyond this are not scanned
+		max_entries = 1024,			// a broken IFD should not keep us busy
+		max_value_size = 1024*1024,	// thumbnails & xmp packets
+	};
+
+	enum Ifd {
+		ifd_image = 0,
+		ifd_thumbnail,
+		ifd_exif,
+		ifd_preview,	// SubIFDs of RAW files
+	};
+
+	bool scanJpg();
+	bool scanTiff(qint64 tiffOffset);
+	void scanIfd(qint64 tiffOffset, quint32 ifdOffset, Ifd ifd, quint32* nextIfdOffset = 0);
+	void scanXmp(const QByteArray& xmp);
+
+	QByteArray bytes(qint64 offset, qint64 size);
+	quint16 toUInt16(const char* data) const;
+	quint32 toUInt32(const char* data) const;
+	quint32 toUInt(quint16 type, const QByteArray& data) const;
+	QString toString(const QByteArray& data) const;
+
+	QFile mFile;
+	QByteArray mData;
+	bool mBigEndian = false;
+
+	int mOrientation = 0;
+	int mExifRating = -1;
+	int mXmpRating = -1;
+	QSize mImageSize;
+	QMap<QString, QString> mValues;
+	QByteArray mThumbnail;
+	QVector<Region> mPreviews;
+};
+
+/**
+ * Read-only summary of an image's metadata.
+ * It holds what thumbnails, sorting and info labels need, so
+ * a record is extracted once per file version (see DkMetaDataCache)
+ * and shared instead of parsing the file with exiv2 again.
+ **/
+class DllLoaderExport DkMetaDataRecord {
+
+public:
+	DkMetaDataRecord() {};
+	DkMetaDataRecord(const DkMetaDataT& metaData, const QString& filePath);
+	DkMetaDataRecord(const DkExifScanner& scanner, const QString& filePath);
+
+	static QStringList exifKeys();
+
+	QString filePath() const;
+	bool isComplete() const;
+	bool hasMetaData() const;
+	int orientation() const;
+	int rating() const;
+	QSize imageSize() const;
+	QDateTime dateTaken() const;
+	QString description() const;
+	QString exifValue(const QString& key) const;
+	bool hasGps() const;
+	QImage thumbnail() const;
+	bool isTiff() const;
+	bool isJpg() const;
+	bool isRaw() const;
+	int memoryUsage() const;
+
+	friend DllLoaderExport QDataStream& operator<<(QDataStream& ds, const DkMetaDataRecord& record);
+	friend DllLoaderExport QDataStream& operator>>(QDataStream& ds, DkMetaDataRecord& record);
+	friend class DkMetaDataIndex;
+
+protected:
+	QString mFilePath;
+	bool mComplete = true;		// false if the record was scanned from the header only
+	bool mHasMetaData = false;
+	int mOrientation = 0;
+	int mRating = -1;
+	QSize mImageSize;
+	QDateTime mDateTaken;
+	QString mDescription;
+	QMap<QString, QString> mExifValues;	// native values of exifKeys()
+	QByteArray mThumbnail;				// the encoded exif thumbnail
+};
+
+/**
+ * In-memory cache of metadata records.
+ * Records are keyed by the file path, its size and its modification date,
+ * so a modified file is parsed again. The least recently used records
+ * are removed if the cache exceeds max_memory bytes.
+ * All functions are thread-safe.
+ **/
+class DllLoaderExport DkMetaDataCache {
+
+public:
+	static DkMetaDataCache& instance();
+
+	QSharedPointer<DkMetaDataRecord> record(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	QSharedPointer<DkMetaDataRecord> header(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	QSharedPointer<DkMetaDataRecord> find(const QString& filePath);
+	void insert(const QString& filePath, QSharedPointer<DkMetaDataRecord> record);
+	void clear();
+
+protected:
+	DkMetaDataCache() {};
+	DkMetaDataCache(DkMetaDataCache const&);		// hide
+	void operator=(DkMetaDataCache const&);		// hide
+
+	enum {
+		max_memory = 32*1024*1024,
+	};
+
+	struct Entry {
+		QSharedPointer<DkMetaDataRecord> record;
+		qint64 lastAccess = 0;
+	};
+
+	QString key(const QString& filePath) const;
+	void evict(qint64 maxBytes);
+
+	QMutex mMutex;
+	QHash<QString, Entry> mEntries;
+	qint64 mMemory = 0;
+	qint64 mNumAccesses = 0;
+};
+
+/**
+ * Persistent metadata index.
+ * One index file per folder is stored in the app data folder. It keeps the
+ * header records (without thumbnails) keyed by the file name, its size and
+ * its modification date. Sorting by capture date and searching metadata
+ * read the index, so a folder that was indexed before needs no file access.
+ * Only the folder that was last updated (see update()) is kept in memory.
+ * All functions are thread-safe.
+ **/
+class DllLoaderExport DkMetaDataIndex {
+
+public:
+	static DkMetaDataIndex& instance();
+	~DkMetaDataIndex();
+
+	QSharedPointer<DkMetaDataRecord> record(const QString& filePath);
+	QSharedPointer<DkMetaDataRecord> find(const QString& filePath);
+	void update(const QString& dirPath, const QFileInfoList& files);
+	QStringList filter(const QString& dirPath, const QString& query, const QStringList& fileNames);
+	void save();
+
+protected:
+	DkMetaDataIndex();
+	DkMetaDataIndex(DkMetaDataIndex const&);		// hide
+	void operator=(DkMetaDataIndex const&);		// hide
+
+	struct Entry {
+		qint64 size = 0;
+		qint64 modified = 0;
+		QSharedPointer<DkMetaDataRecord> record;
+	};
+
+	struct Folder {
+		QHash<QString, Entry> entries;	// keyed by the file name
+		bool dirty = false;
+	};
+
+	// the mutex must be locked for these
+	Folder& folder(const QString& dirPath);
+	void saveFolder(const QString& dirPath, Folder& f);
+	QString indexPath(const QString& dirPath) const;
+
+	QMutex mMutex;
+	QString mIndexDir;
+	QHash<QString, Folder> mFolders;
+};
+
 class DllLoaderExport DkMetaDataHelper {
 
 public:
@@ -142,6 +142,38 @@ public:
 	virtual void saveSettings(QSettings&) const {};		// dummy
 };
 
+/**
+ * Optional interface for batch plugins that process images in horizontal strips.
+ * Implement it in addition to DkBatchPluginInterface if a pixel of the result
+ * only depends on a few rows of the input (filters, color transforms, etc.).
+ * Batch processing then runs the plugin strip by strip and chains it with
+ * other strip operations - so a worker does not need full copies of the image.
+ * Strips do not report DkBatchInfo, return -1 in stripBorder() if a run needs them.
+ **/
+class DkBatchStripInterface {
+
+public:
+	virtual ~DkBatchStripInterface() {}
+
+	/// <summary>
+	/// Number of rows above and below a strip the plugin needs to compute it (halo).
+	/// </summary>
+	/// <param name="runID">The run identifier.</param>
+	/// <returns>The border in rows or -1 if the run needs the whole image.</returns>
+	virtual int stripBorder(const QString& runID) const = 0;
+
+	/// <summary>
+	/// Processes a single strip.
+	/// NOTE: it needs to be const for we run it with multiple threads.
+	/// </summary>
+	/// <param name="runID">The run identifier.</param>
+	/// <param name="strip">The input strip including the border (which is cut at the image's top and bottom).</param>
+	/// <param name="roi">The rows of strip that need to be computed.</param>
+	/// <param name="result">The result with the size of roi.</param>
+	/// <returns>true on success</returns>
+	virtual bool runStrip(const QString& runID, const QImage& strip, const QRect& roi, QImage& result) const = 0;
+};
+
 class DkViewPortInterface : public DkPluginInterface {
 	
 public:
@@ -218,3 +250,4 @@ protected:
 Q_DECLARE_INTERFACE(nmc::DkPluginInterface, "com.nomacs.ImageLounge.DkPluginInterface/3.2")
 Q_DECLARE_INTERFACE(nmc::DkBatchPluginInterface, "com.nomacs.ImageLounge.DkBatchPluginInterface/3.3")
 Q_DECLARE_INTERFACE(nmc::DkViewPortInterface, "com.nomacs.ImageLounge.DkViewPortInterface/3.3")
+Q_DECLARE_INTERFACE(nmc::DkBatchStripInterface, "com.nomacs.ImageLounge.DkBatchStripInterface/3.3")
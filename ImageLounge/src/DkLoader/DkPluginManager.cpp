@@ -61,6 +61,7 @@
 #include <QNetworkProxyFactory>
 #include <QAction>
 #include <QMenu>
+#include <QApplication>
 #include <QJsonValue>
 #pragma warning(pop)		// no warnings from includes - end
 
@@ -250,7 +251,10 @@ bool DkPluginContainer::load() {
 	if (mType != type_unknown) {
 		// init actions
 		plugin()->createActions(DkUtils::getMainWindow());
-		createMenu();
+
+		// menus are widgets - headless batches only need the actions
+		if (qobject_cast<QApplication*>(qApp))
+			createMenu();
 	}
 
 	qInfo() << mPluginPath << "loaded in" << dt;
@@ -479,6 +483,15 @@ DkBatchPluginInterface* DkPluginContainer::batchPlugin() const {
 	return qobject_cast<DkBatchPluginInterface*>(mLoader->instance());
 }
 
+DkBatchStripInterface* DkPluginContainer::stripPlugin() const {
+
+	// is everything fine here??
+	if (!mLoader)
+		return 0;
+
+	return qobject_cast<DkBatchStripInterface*>(mLoader->instance());
+}
+
 DkViewPortInterface* DkPluginContainer::pluginViewPort() const {
 
 	// is everything fine here??
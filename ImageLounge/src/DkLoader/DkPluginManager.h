@@ -179,6 +179,7 @@ public:
 	QSharedPointer<QPluginLoader> loader() const;
 	DkPluginInterface* plugin() const;
 	DkBatchPluginInterface* batchPlugin() const;
+	DkBatchStripInterface* stripPlugin() const;
 	DkViewPortInterface* pluginViewPort() const;
 	QString actionNameToRunId(const QString& actionName) const;
 	
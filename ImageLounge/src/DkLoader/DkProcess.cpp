@@ -28,6 +28,8 @@
 #include "DkProcess.h"
 #include "DkUtils.h"
 #include "DkImageContainer.h"
+#include "DkBasicLoader.h"
+#include "DkMetaData.h"
 #include "DkImageStorage.h"
 #include "DkPluginManager.h"
 #include "DkSettings.h"
@@ -36,10 +38,27 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QFuture>
 #include <QFutureWatcher>
-#include <QtConcurrentMap>
+#include <QtConcurrentRun>
 #include <QWidget>
+#include <QThread>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QCryptographicHash>
+#include <QTemporaryFile>
+#include <QSettings>
+#include <QDateTime>
+
+#ifdef WITH_TURBOJPEG
+#include <turbojpeg.h>
+#endif
 #pragma warning(pop)		// no warnings from includes - end
 
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace nmc {
 
 /// <summary>
@@ -368,6 +387,177 @@ bool DkBatchTransform::compute(QSharedPointer<DkImageContainer> container, QStri
 	return true;
 }
 
+/**
+ * Transforms a jpg without decoding it.
+ * Rotations by multiples of 90 degrees, flips and crops that start at MCU boundaries
+ * are applied to the DCT coefficients which is faster and does not degrade the image.
+ * The exif orientation is applied too (as the loader would) and the image size,
+ * orientation and thumbnail are updated accordingly.
+ * @param filePath the jpg's file path (needed for the metadata)
+ * @param ba the jpg's data, it is replaced by the transformed jpg
+ * @param logStrings log strings
+ * @return bool false if the transform cannot be done losslessly - use compute() then
+ **/ 
+bool DkBatchTransform::computeLossless(const QString& filePath, QSharedPointer<QByteArray>& ba, QStringList& logStrings) const {
+
+#ifdef WITH_TURBOJPEG
+
+	if (!ba || ba->isEmpty() || mAngle % 90 != 0)
+		return false;
+
+	DkMetaDataT metaData;
+	metaData.readMetaData(filePath, ba);
+
+	// the loader rotates according to the exif orientation (see DkBasicLoader::loadGeneral)
+	int exifAngle = 0;
+	if (!metaData.isTiff() && !DkSettingsManager::param().metaData().ignoreExifOrientation) {
+		int orientation = metaData.getOrientationDegree();
+		if (orientation != -1)
+			exifAngle = orientation;
+	}
+
+	QTransform exifTransform;
+	exifTransform.rotate(exifAngle);
+
+	// compute() rotates first and then mirrors
+	QTransform userTransform;
+	userTransform.rotate(mAngle);
+	userTransform = userTransform * QTransform::fromScale(mHorizontalFlip ? -1 : 1, mVerticalFlip ? -1 : 1);
+
+	QTransform tForm = exifTransform * userTransform;
+	int m11 = qRound(tForm.m11());
+	int m12 = qRound(tForm.m12());
+	int m21 = qRound(tForm.m21());
+	int m22 = qRound(tForm.m22());
+
+	int op = TJXOP_NONE;
+	if (m11 == -1 && m22 == 1)			op = TJXOP_HFLIP;
+	else if (m11 == 1 && m22 == -1)		op = TJXOP_VFLIP;
+	else if (m11 == -1 && m22 == -1)	op = TJXOP_ROT180;
+	else if (m12 == 1 && m21 == 1)		op = TJXOP_TRANSPOSE;
+	else if (m12 == -1 && m21 == -1)	op = TJXOP_TRANSVERSE;
+	else if (m12 == 1 && m21 == -1)		op = TJXOP_ROT90;
+	else if (m12 == -1 && m21 == 1)		op = TJXOP_ROT270;
+
+	bool transposed = op == TJXOP_TRANSPOSE || op == TJXOP_TRANSVERSE || op == TJXOP_ROT90 || op == TJXOP_ROT270;
+
+	tjhandle handle = tjInitTransform();
+
+	if (!handle)
+		return false;
+
+	int width = 0, height = 0, subsamp = -1, colorspace = -1;
+	if (tjDecompressHeader3(handle, (unsigned char*)ba->constData(), (unsigned long)ba->size(), &width, &height, &subsamp, &colorspace) != 0 ||
+		subsamp < 0 || subsamp >= TJ_NUMSAMP) {
+		tjDestroy(handle);
+		return false;
+	}
+
+	tjtransform xForm = {};
+	xForm.op = op;
+	xForm.options = TJXOPT_PERFECT;	// fail instead of dropping partial MCUs at the borders
+
+	QSize fullSize = transposed ? QSize(height, width) : QSize(width, height);
+	QRect cropRect;
+
+	if (mCropFromMetadata) {
+
+		QSize orientedSize = qAbs(exifAngle) == 90 ? QSize(height, width) : QSize(width, height);
+		DkRotatingRect rect = metaData.getXMPRect(orientedSize);
+
+		if (!rect.isEmpty()) {
+
+			// rotated crops need to be resampled
+			double angle = DkMath::normAngleRad(rect.getAngle(), 0, 2*CV_PI);
+			if (qMin(angle, 2*CV_PI-angle) > FLT_EPSILON) {
+				tjDestroy(handle);
+				return false;
+			}
+
+			// crop rect in the coordinates of the transformed image
+			QRectF cr = userTransform.mapRect(rect.getPoly().boundingRect());
+			cr.translate(-userTransform.mapRect(QRectF(QPointF(), orientedSize)).topLeft());
+			cropRect = QRect(qRound(cr.x()), qRound(cr.y()), qRound(cr.width()), qRound(cr.height())).intersected(QRect(QPoint(), fullSize));
+
+			// crops must start at MCU boundaries of the transformed image
+			int mcuWidth = transposed ? tjMCUHeight[subsamp] : tjMCUWidth[subsamp];
+			int mcuHeight = transposed ? tjMCUWidth[subsamp] : tjMCUHeight[subsamp];
+
+			if (cropRect.isEmpty() || cropRect.x() % mcuWidth != 0 || cropRect.y() % mcuHeight != 0) {
+				tjDestroy(handle);
+				return false;
+			}
+
+			xForm.options |= TJXOPT_CROP;
+			xForm.r.x = cropRect.x();
+			xForm.r.y = cropRect.y();
+			xForm.r.w = cropRect.width();
+			xForm.r.h = cropRect.height();
+		}
+	}
+
+	unsigned char* dst = 0;
+	unsigned long dstSize = 0;
+	bool transformed = tjTransform(handle, (unsigned char*)ba->constData(), (unsigned long)ba->size(), 1, &dst, &dstSize, &xForm, 0) == 0;
+
+	QSharedPointer<QByteArray> tBa;
+	if (transformed)
+		tBa = QSharedPointer<QByteArray>(new QByteArray((const char*)dst, (int)dstSize));
+	else
+		qDebug() << "[DkBatchTransform] no lossless transform possible:" << tjGetErrorStr2(handle);
+
+	tjFree(dst);
+	tjDestroy(handle);
+
+	if (!transformed)
+		return false;
+
+	if (metaData.hasMetaData()) {
+
+		QSize size = cropRect.isNull() ? fullSize : cropRect.size();
+		QImage thumb = metaData.getThumbnail();
+
+		metaData.clearOrientation();
+		metaData.setExifValue("Exif.Image.ImageWidth", QString::number(size.width()));
+		metaData.setExifValue("Exif.Image.ImageLength", QString::number(size.height()));
+
+		if (!thumb.isNull()) {
+			thumb = thumb.transformed(tForm);
+
+			if (!cropRect.isNull()) {
+				double sx = (double)thumb.width()/fullSize.width();
+				double sy = (double)thumb.height()/fullSize.height();
+				thumb = thumb.copy(qRound(cropRect.x()*sx), qRound(cropRect.y()*sy), qRound(cropRect.width()*sx), qRound(cropRect.height()*sy));
+			}
+
+			metaData.setThumbnail(thumb);
+		}
+
+		if (!cropRect.isNull())
+			metaData.clearXMPRect();
+
+		// the old orientation would rotate the image twice
+		if (!metaData.saveMetaData(tBa, true) && exifAngle != 0)
+			return false;
+	}
+
+	ba = tBa;
+
+	if (cropRect.isNull())
+		logStrings.append(QObject::tr("%1 image transformed losslessly.").arg(name()));
+	else
+		logStrings.append(QObject::tr("%1 image transformed and cropped losslessly.").arg(name()));
+
+	return true;
+#else
+	Q_UNUSED(filePath);
+	Q_UNUSED(ba);
+	Q_UNUSED(logStrings);
+
+	return false;
+#endif
+}
+
 #ifdef WITH_PLUGINS
 // DkPluginBatch --------------------------------------------------------------------
 DkPluginBatch::DkPluginBatch() {
@@ -514,6 +704,38 @@ QStringList DkPluginBatch::pluginList() const {
 	return mPluginList;
 }
 
+/**
+ * Returns the borders of all plugins if they can process strips.
+ * @return QVector<int> one border per plugin or an empty vector if any plugin needs the whole image
+ **/ 
+QVector<int> DkPluginBatch::stripBorders() const {
+
+	QVector<int> borders;
+
+	for (int idx = 0; idx < mPlugins.size(); idx++) {
+
+		DkBatchStripInterface* plugin = mPlugins[idx] ? mPlugins[idx]->stripPlugin() : 0;
+		int border = plugin ? plugin->stripBorder(mRunIDs[idx]) : -1;
+
+		if (border < 0)
+			return QVector<int>();
+
+		borders << border;
+	}
+
+	return borders;
+}
+
+bool DkPluginBatch::computeStrip(int opIdx, const QImage& strip, const QRect& roi, QImage& result) const {
+
+	if (opIdx < 0 || opIdx >= mPlugins.size() || !mPlugins[opIdx])
+		return false;
+
+	DkBatchStripInterface* plugin = mPlugins[opIdx]->stripPlugin();
+
+	return plugin && plugin->runStrip(mRunIDs[opIdx], strip, roi, result);
+}
+
 void DkPluginBatch::loadAllPlugins() {
 
 	// already loaded?
@@ -566,6 +788,179 @@ void DkPluginBatch::loadPlugin(const QString & pluginString, QSharedPointer<DkPl
 }
 #endif
 
+// DkBatchStripChain --------------------------------------------------------------------
+DkBatchStripChain::DkBatchStripChain(int stripHeight) {
+
+	mStripHeight = qMax(stripHeight, 1);
+}
+
+/**
+ * Appends the strip operations of a batch function.
+ * @param batch a batch function with strip operations (see DkAbstractBatch::stripBorders)
+ **/ 
+void DkBatchStripChain::add(QSharedPointer<DkAbstractBatch> batch) {
+
+	QVector<int> borders = batch->stripBorders();
+
+	for (int idx = 0; idx < borders.size(); idx++) {
+		mOps << QPair<QSharedPointer<DkAbstractBatch>, int>(batch, idx);
+		mBorders << borders[idx];
+	}
+}
+
+void DkBatchStripChain::clear() {
+
+	mOps.clear();
+	mBorders.clear();
+}
+
+bool DkBatchStripChain::isEmpty() const {
+
+	return mOps.empty();
+}
+
+/**
+ * The number of rows that are needed above and below a strip.
+ * @return int the sum of all borders
+ **/ 
+int DkBatchStripChain::border() const {
+
+	int border = 0;
+	for (int b : mBorders)
+		border += b;
+
+	return border;
+}
+
+QStringList DkBatchStripChain::names() const {
+
+	QStringList names;
+	for (const QPair<QSharedPointer<DkAbstractBatch>, int>& op : mOps) {
+		if (!names.contains(op.first->name()))
+			names << op.first->name();
+	}
+
+	return names;
+}
+
+/**
+ * Runs all strip operations on the image.
+ * @param img the image which is processed in place - it should not be shared
+ * @param logStrings log strings
+ * @return bool false if an operation failed (the image is incomplete then)
+ **/ 
+bool DkBatchStripChain::compute(QImage& img, QStringList& logStrings) const {
+
+	if (mOps.empty() || img.isNull())
+		return true;
+
+	int border = this->border();
+	int width = img.width();
+	int height = img.height();
+	QImage upperHalo;	// unprocessed rows above the current strip
+
+	for (int top = 0; top < height; top += mStripHeight) {
+
+		int bottom = qMin(top + mStripHeight, height);
+		int sTop = qMax(top - border, 0);
+		int sBottom = qMin(bottom + border, height);
+
+		// rows above top are processed already - take them from the halo
+		QImage strip(width, sBottom - sTop, img.format());
+		strip.setColorTable(img.colorTable());
+		copyRows(upperHalo, 0, strip, 0, top - sTop);
+		copyRows(img, top, strip, top - sTop, sBottom - top);
+
+		// remember the rows the next strip needs before they get overwritten
+		int hTop = qMax(bottom - border, sTop);
+		upperHalo = strip.copy(0, hTop - sTop, width, bottom - hTop);
+
+		// each operation computes its input without the border (except for the image borders)
+		int vTop = sTop;
+		int vBottom = sBottom;
+
+		for (int idx = 0; idx < mOps.size(); idx++) {
+
+			int rTop = vTop > 0 ? vTop + mBorders[idx] : 0;
+			int rBottom = vBottom < height ? vBottom - mBorders[idx] : height;
+			QRect roi(0, rTop - vTop, width, rBottom - rTop);
+
+			QImage result;
+			if (!mOps[idx].first->computeStrip(mOps[idx].second, strip, roi, result) || result.size() != roi.size()) {
+				logStrings.append(QObject::tr("%1 could not process rows %2 - %3.").arg(mOps[idx].first->name()).arg(rTop).arg(rBottom));
+				return false;
+			}
+
+			if (result.format() != img.format())
+				result = result.convertToFormat(img.format());
+
+			strip = result;
+			vTop = rTop;
+			vBottom = rBottom;
+		}
+
+		copyRows(strip, top - vTop, img, top, bottom - top);
+	}
+
+	return true;
+}
+
+void DkBatchStripChain::copyRows(const QImage& src, int srcRow, QImage& dst, int dstRow, int numRows) {
+
+	int numBytes = qMin(src.bytesPerLine(), dst.bytesPerLine());
+
+	for (int idx = 0; idx < numRows; idx++)
+		memcpy(dst.scanLine(dstRow + idx), src.constScanLine(srcRow + idx), numBytes);
+}
+
+// DkBatchItemStats --------------------------------------------------------------------
+void DkBatchItemStats::addTime(const QString& key, int ms) {
+
+	for (QPair<QString, int>& t : mTimes) {
+		if (t.first == key) {
+			t.second += ms;
+			return;
+		}
+	}
+
+	mTimes << QPair<QString, int>(key, ms);
+}
+
+int DkBatchItemStats::time(const QString& key) const {
+
+	for (const QPair<QString, int>& t : mTimes) {
+		if (t.first == key)
+			return t.second;
+	}
+
+	return 0;
+}
+
+QStringList DkBatchItemStats::keys() const {
+
+	QStringList keys;
+	for (const QPair<QString, int>& t : mTimes)
+		keys << t.first;
+
+	return keys;
+}
+
+void DkBatchItemStats::setBytesIn(qint64 bytes) {
+	mBytesIn = bytes;
+}
+
+qint64 DkBatchItemStats::bytesIn() const {
+	return mBytesIn;
+}
+
+void DkBatchItemStats::setBytesOut(qint64 bytes) {
+	mBytesOut = bytes;
+}
+
+qint64 DkBatchItemStats::bytesOut() const {
+	return mBytesOut;
+}
+
 // DkBatchProcess --------------------------------------------------------------------
 DkBatchProcess::DkBatchProcess(const DkSaveInfo& saveInfo) {
 	mSaveInfo = saveInfo;
@@ -576,6 +971,52 @@ void DkBatchProcess::setProcessChain(const QVector<QSharedPointer<DkAbstractBatc
 	mProcessFunctions = processes;
 }
 
+void DkBatchProcess::setJournal(QSharedPointer<DkBatchJournal> journal) {
+
+	mJournal = journal;
+}
+
+/**
+ * A dry run computes the item without touching any file.
+ * @param dryRun if true, nothing is written, renamed or copied
+ **/ 
+void DkBatchProcess::setDryRun(bool dryRun) {
+
+	mDryRun = dryRun;
+}
+
+DkBatchItemStats& DkBatchProcess::stats() {
+
+	return mStats;
+}
+
+const DkBatchItemStats& DkBatchProcess::stats() const {
+
+	return mStats;
+}
+
+/**
+ * Returns the stats of this item including its additional outputs.
+ * The outputs' times are accumulated per key and their sizes are added to bytesOut.
+ * @return DkBatchItemStats the item's stats
+ **/ 
+DkBatchItemStats DkBatchProcess::totalStats() const {
+
+	DkBatchItemStats stats = mStats;
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+
+		DkBatchItemStats os = o->totalStats();
+
+		for (const QString& key : os.keys())
+			stats.addTime(key, os.time(key));
+
+		stats.setBytesOut(stats.bytesOut() + os.bytesOut());
+	}
+
+	return stats;
+}
+
 QString DkBatchProcess::inputFile() const {
 
 	return mSaveInfo.inputFilePath();
@@ -586,16 +1027,52 @@ QString DkBatchProcess::outputFile() const {
 	return mSaveInfo.outputFilePath();
 }
 
-QVector<QSharedPointer<DkBatchInfo> > DkBatchProcess::batchInfo() const {
+QStringList DkBatchProcess::additionalOutputFiles() const {
+
+	QStringList files;
+	for (QSharedPointer<DkBatchProcess> o : mOutputs)
+		files << o->outputFile() << o->additionalOutputFiles();
+
+	return files;
+}
+
+QVector<QSharedPointer<DkBatchInfo> > DkBatchProcess::batchInfo(bool withOutputs) const {
+
+	QVector<QSharedPointer<DkBatchInfo> > infos = mInfos;
+
+	if (withOutputs) {
+		for (QSharedPointer<DkBatchProcess> o : mOutputs)
+			infos << o->batchInfo();
+	}
+
+	return infos;
+}
 
-	return mInfos;
+QVector<QSharedPointer<DkBatchProcess> > DkBatchProcess::outputs() const {
+	return mOutputs;
 }
 
 bool DkBatchProcess::hasFailed() const {
 
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+		if (o->hasFailed())
+			return true;
+	}
+
 	return mFailure != 0;
 }
 
+/**
+ * Adds an output that is computed from this item's decoded image.
+ * The output has its own process chain & save info but is neither read nor decoded.
+ * @param output the additional output
+ **/ 
+void DkBatchProcess::addOutput(QSharedPointer<DkBatchProcess> output) {
+
+	output->mIsOutput = true;
+	mOutputs << output;
+}
+
 bool DkBatchProcess::wasProcessed() const {
 	
 	return mIsProcessed;
@@ -603,95 +1080,388 @@ bool DkBatchProcess::wasProcessed() const {
 
 bool DkBatchProcess::compute() {
 
-	mIsProcessed = true;
+	if (prepare() && read() && decode() && process() && encode() && write())
+		commit();
+
+	finish();
+
+	return !hasFailed();
+}
+
+/**
+ * Prepares this item's output and all additional outputs.
+ * @return bool true if the image needs to be decoded for any output
+ **/ 
+bool DkBatchProcess::prepare() {
+
+	mPending = prepareOutput();
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs)
+		o->mPending = o->prepareOutput();
+
+	return isPending();
+}
+
+/**
+ * Runs a stage for this item's output and all additional outputs.
+ * Outputs that failed or are done already are skipped.
+ * @param stage the stage (e.g. encodeOutput)
+ * @return bool true if any output needs the next stage
+ **/ 
+bool DkBatchProcess::computeOutputs(bool (DkBatchProcess::*stage)()) {
+
+	if (mPending)
+		mPending = (this->*stage)();
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+		if (o->mPending)
+			o->mPending = (o.data()->*stage)();
+	}
+
+	return isPending();
+}
+
+bool DkBatchProcess::isPending() const {
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+		if (o->mPending)
+			return true;
+	}
+
+	return mPending;
+}
+
+/**
+ * Marks all additional outputs as failed if the input cannot be loaded.
+ **/ 
+void DkBatchProcess::failOutputs() {
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+		if (o->mPending) {
+			o->mLogStrings.append(QObject::tr("Error while loading %1").arg(mSaveInfo.inputFilePath()));
+			o->mFailure++;
+			o->mPending = false;
+		}
+	}
+}
+
+/**
+ * Checks the item and handles everything that does not need the image's pixels.
+ * @return bool true if the image needs to be decoded, processed & encoded
+ **/ 
+bool DkBatchProcess::prepareOutput() {
 
 	QFileInfo fInfoIn(mSaveInfo.inputFilePath());
 	QFileInfo fInfoOut(mSaveInfo.outputFilePath());
 
+	if (fInfoIn.exists()) {
+		mInputSize = fInfoIn.size();
+		mInputModified = fInfoIn.lastModified().toMSecsSinceEpoch();
+		mStats.setBytesIn(mInputSize);
+	}
+
+	// finished by a previous run?
+	if (mJournal && mJournal->isDone(mSaveInfo.inputFilePath(), mInputSize, mInputModified, fInfoOut)) {
+		mLogStrings.append(QObject::tr("%1 is up to date -> skipping").arg(mSaveInfo.outputFilePath()));
+		mUpToDate = true;
+		return false;
+	}
+
 	// check errors
 	if (fInfoOut.exists() && mSaveInfo.mode() == DkSaveInfo::mode_skip_existing) {
 		mLogStrings.append(QObject::tr("%1 already exists -> skipping (check 'overwrite' if you want to overwrite the file)").arg(mSaveInfo.outputFilePath()));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	else if (!fInfoIn.exists()) {
 		mLogStrings.append(QObject::tr("Error: input file does not exist"));
 		mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	else if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && mProcessFunctions.empty()) {
 		mLogStrings.append(QObject::tr("Skipping: nothing to do here."));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	
+	// renaming & copying keeps the file as it is
+	if (mDryRun && mProcessFunctions.empty() && fInfoIn.suffix() == fInfoOut.suffix()) {
+		mStats.setBytesOut(mInputSize);
+		return false;
+	}
+
 	// do the work
 	if (mProcessFunctions.empty() && mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && fInfoIn.suffix() == fInfoOut.suffix()) {	// rename?
 		if (!renameFile())
 			mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	else if (mProcessFunctions.empty() && fInfoIn.suffix() == fInfoOut.suffix()) {	// copy?
 		if (!copyFile())
 			mFailure++;
 		else
-			deleteOriginalFile();
+			mCopied = true;	// the additional outputs might still need the original
 
-		return mFailure == 0;
+		return false;
 	}
 
-	process();
-
-	return mFailure == 0;
-}
-
-QStringList DkBatchProcess::getLog() const {
-
-	return mLogStrings;
+	return true;
 }
 
-bool DkBatchProcess::process() {
+/**
+ * Reads the input file into memory.
+ * The file is read entirely so that the decoder does not stall on disk I/O.
+ * @return bool true if the file was read
+ **/ 
+bool DkBatchProcess::read() {
 
 	mLogStrings.append(QObject::tr("processing %1").arg(mSaveInfo.inputFilePath()));
 
-	QSharedPointer<DkImageContainer> imgC(new DkImageContainer(mSaveInfo.inputFilePath()));
+	// psd files might be way larger than the part we need to read (see DkImageContainer::loadFileToBuffer)
+	if (QFileInfo(mSaveInfo.inputFilePath()).suffix().contains("psd"))
+		return true;
+
+	QFile file(mSaveInfo.inputFilePath());
 
-	if (!imgC->loadImage() || imgC->image().isNull()) {
+	if (!file.open(QIODevice::ReadOnly)) {
 		mLogStrings.append(QObject::tr("Error while loading..."));
+		mLogStrings.append(file.errorString());
 		mFailure++;
+		failOutputs();
 		return false;
 	}
 
-	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
+	mFileBuffer = QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
 
-		if (!batch) {
-			mLogStrings.append(QObject::tr("Error: cannot process a NULL function."));
-			continue;
-		}
+	return true;
+}
 
-		QVector<QSharedPointer<DkBatchInfo> > cInfos;
-		if (!batch->compute(imgC, mSaveInfo, mLogStrings, cInfos)) {
-			mLogStrings.append(QObject::tr("%1 failed").arg(batch->name()));
-			mFailure++;
-		}
+bool DkBatchProcess::decode() {
 
-		mInfos << cInfos;
-	}
+	// jpgs that are just rotated or cropped do not need the pixels
+	if (transformLossless())
+		return true;
+
+	mImage = QSharedPointer<DkImageContainer>(new DkImageContainer(mSaveInfo.inputFilePath()));
+	bool loaded = mImage->loadImage(mFileBuffer);
+	mFileBuffer.clear();	// the container keeps it as long as needed
 
-	// report we could not back-up & break here
-	if (!prepareDeleteExisting()) {
+	if (!loaded || mImage->image().isNull()) {
+		mLogStrings.append(QObject::tr("Error while loading..."));
+		mImage.clear();
 		mFailure++;
+		failOutputs();
 		return false;
 	}
 
-	// early break
-	if (mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output) {
-		mLogStrings.append(QObject::tr("%1 not saved - option 'Do not Save' is checked...").arg(mSaveInfo.outputFilePath()));
-		return true;
-	}
+	return true;
+}
+
+bool DkBatchProcess::process() {
+
+	// additional outputs start from the decoded image (the pixels are shared until they are changed)
+	for (QSharedPointer<DkBatchProcess> o : mOutputs) {
+
+		if (!o->mPending || !mImage)
+			continue;
+
+		QSharedPointer<DkImageContainer> img(new DkImageContainer(mSaveInfo.inputFilePath()));
+		img->getMetaData()->readMetaData(mSaveInfo.inputFilePath(), mImage->getFileBuffer());
+		img->setImage(mImage->image(), QObject::tr("Original Image"));
+		o->mImage = img;
+	}
+
+	// this item's output does not need the image
+	if (!mPending)
+		mImage.clear();
+
+	return computeOutputs(&DkBatchProcess::processOutput);
+}
+
+bool DkBatchProcess::processOutput() {
+
+	// already transformed in decode()
+	if (!mImage)
+		return true;
+
+	DkBatchStripChain strips(DkSettingsManager::param().resources().batchStripHeight);
+
+	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
+
+		if (!batch) {
+			mLogStrings.append(QObject::tr("Error: cannot process a NULL function."));
+			continue;
+		}
+
+		// consecutive strip operations are computed in a single pass
+		if (batch->isActive() && !batch->stripBorders().empty()) {
+			strips.add(batch);
+			continue;
+		}
+
+		computeStrips(strips);
+
+		DkTimer dt;
+		QVector<QSharedPointer<DkBatchInfo> > cInfos;
+		if (!batch->compute(mImage, mSaveInfo, mLogStrings, cInfos)) {
+			mLogStrings.append(QObject::tr("%1 failed").arg(batch->name()));
+			mFailure++;
+		}
+		mStats.addTime(batch->settingsName(), dt.elapsed());
+
+		mInfos << cInfos;
+	}
+
+	computeStrips(strips);
+
+	return true;
+}
+
+/**
+ * Computes the strip operations that were collected and clears them.
+ * @param strips the strip operations
+ * @return bool false if the operations failed
+ **/ 
+bool DkBatchProcess::computeStrips(DkBatchStripChain& strips) {
+
+	if (strips.isEmpty())
+		return true;
+
+	DkTimer dt;
+
+	// the edit history shares the image - drop it, otherwise the image is copied as soon as we process it in place
+	QImage img = mImage->image();
+	mImage->getLoader()->history()->clear();
+
+	bool computed = strips.compute(img, mLogStrings);
+	mImage->setImage(img, QObject::tr("Batch Strips"));
+
+	if (computed)
+		mLogStrings.append(QObject::tr("%1 computed in strips.").arg(strips.names().join(", ")));
+	else {
+		mLogStrings.append(QObject::tr("%1 failed").arg(strips.names().join(", ")));
+		mFailure++;
+	}
+
+	mStats.addTime("strips", dt.elapsed());
+	strips.clear();
+
+	return computed;
+}
+
+bool DkBatchProcess::encode() {
+
+	return computeOutputs(&DkBatchProcess::encodeOutput);
+}
+
+bool DkBatchProcess::encodeOutput() {
+
+	// nothing to encode
+	if (mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output || !mImage)
+		return true;
+
+	bool encoded = mImage->getLoader()->saveToBuffer(mSaveInfo.outputFilePath(), mImage->image(), mOutputBuffer, mSaveInfo.compression());
+	mImage.clear();	// free the pixels before the item waits for the writer
+
+	if (!encoded) {
+		mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
+		mOutputBuffer.clear();
+		mFailure++;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Writes the encoded image to a temporary file next to the output.
+ * The output is not touched before commit() replaces it.
+ * @return bool true if the item needs to be committed
+ **/ 
+bool DkBatchProcess::write() {
+
+	return computeOutputs(&DkBatchProcess::writeOutput);
+}
+
+bool DkBatchProcess::writeOutput() {
+
+	// early break
+	if (mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output) {
+		mLogStrings.append(QObject::tr("%1 not saved - option 'Do not Save' is checked...").arg(mSaveInfo.outputFilePath()));
+		return false;
+	}
+
+	mStats.setBytesOut(mOutputBuffer->size());
+
+	if (mDryRun) {
+		mLogStrings.append(QObject::tr("%1 not saved - dry run").arg(mSaveInfo.outputFilePath()));
+		return false;
+	}
+
+	QFileInfo outInfo(mSaveInfo.outputFilePath());
+	mTempFile = QSharedPointer<QTemporaryFile>(new QTemporaryFile(outInfo.absoluteDir().filePath("." + outInfo.fileName() + ".XXXXXX")));
+
+	if (!mTempFile->open() || mTempFile->write(*mOutputBuffer) != mOutputBuffer->size()) {
+		mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
+		mLogStrings.append(mTempFile->errorString());
+		mTempFile.clear();	// removes the temporary file
+		mOutputBuffer.clear();
+		mFailure++;
+		return false;
+	}
+
+	// QTemporaryFile is only accessible by its owner
+	if (outInfo.exists())
+		mTempFile->setPermissions(outInfo.permissions());
+	else
+		mTempFile->setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadUser | QFile::WriteUser | QFile::ReadGroup | QFile::ReadOther);
+
+	mOutputBuffer.clear();
+
+	return true;
+}
+
+/**
+ * Flushes the temporary file to the disk.
+ * This is separated from commit() so that DkBatchPipeline can flush groups of files.
+ **/ 
+bool DkBatchProcess::sync() {
+
+	return computeOutputs(&DkBatchProcess::syncOutput);
+}
+
+bool DkBatchProcess::syncOutput() {
 
-	if (imgC->saveImage(mSaveInfo.outputFilePath(), mSaveInfo.compression())) {
+	if (mTempFile && !DkUtils::flushToDisk(*mTempFile)) {
+		mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
+		mLogStrings.append(mTempFile->errorString());
+		mTempFile.clear();
+		mFailure++;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Replaces the output with the temporary file.
+ * Readers either see the old or the new file - but never a truncated one.
+ **/ 
+bool DkBatchProcess::commit() {
+
+	return computeOutputs(&DkBatchProcess::commitOutput);
+}
+
+bool DkBatchProcess::commitOutput() {
+
+	if (!mTempFile)
+		return false;
+
+	mTempFile->close();
+
+	if (DkUtils::renameOverwrite(mTempFile->fileName(), mSaveInfo.outputFilePath())) {
+		mTempFile->setAutoRemove(false);
 		mLogStrings.append(QObject::tr("%1 saved...").arg(mSaveInfo.outputFilePath()));
 	}
 	else {
@@ -699,171 +1469,896 @@ bool DkBatchProcess::process() {
 		mFailure++;
 	}
 
-	if (!deleteOrRestoreExisting()) {
-		mFailure++;
+	mTempFile.clear();
+
+	return mFailure == 0;
+}
+
+/**
+ * Marks the item as processed, releases all buffers
+ * and adds successful items to the journal.
+ **/ 
+void DkBatchProcess::finish() {
+
+	for (QSharedPointer<DkBatchProcess> o : mOutputs)
+		o->finish();
+
+	mPending = false;
+	mFileBuffer.clear();
+	mImage.clear();
+	mOutputBuffer.clear();
+	mTempFile.clear();
+
+	// all outputs are done with the original now
+	if (mCopied && !mIsOutput)
+		deleteOriginalFile();
+
+	if (mJournal && !mFailure && !mUpToDate && mSaveInfo.mode() != DkSaveInfo::mode_do_not_save_output) {
+
+		// in-place profiles rewrote the input - the journal needs its new stats
+		// otherwise the item is processed (e.g. rotated) a second time on resume
+		QFileInfo fInfoIn(mSaveInfo.inputFilePath());
+
+		if (fInfoIn.exists()) {
+			mInputSize = fInfoIn.size();
+			mInputModified = fInfoIn.lastModified().toMSecsSinceEpoch();
+		}
+
+		mJournal->add(mSaveInfo.inputFilePath(), mInputSize, mInputModified, mSaveInfo.outputFilePath());
+	}
+
+	mIsProcessed = true;
+}
+
+QStringList DkBatchProcess::getLog() const {
+
+	QStringList log = mLogStrings;
+	for (QSharedPointer<DkBatchProcess> o : mOutputs)
+		log << o->getLog();
+
+	return log;
+}
+
+bool DkBatchProcess::renameFile() {
+
+	if (QFileInfo(mSaveInfo.outputFilePath()).exists()) {
+		mLogStrings.append(QObject::tr("Error: could not rename file, the target file exists already."));
+		return false;
+	}
+
+	QFile file(mSaveInfo.inputFilePath());
+
+	// Note: if two images are renamed at the same time to the same name, one image is lost -> see Qt comment Race Condition
+	if (!file.rename(mSaveInfo.outputFilePath())) {
+		mLogStrings.append(QObject::tr("Error: could not rename file"));
+		mLogStrings.append(file.errorString());
+		return false;
+	}
+	else
+		mLogStrings.append(QObject::tr("Renaming: %1 -> %2").arg(mSaveInfo.inputFilePath()).arg(mSaveInfo.outputFilePath()));
+
+	return true;
+}
+
+/**
+ * Transforms jpgs in the DCT domain if the chain allows for it.
+ * This is only done if a DkBatchTransform is the only active function
+ * and a jpg is saved as jpg.
+ * @return bool true if mOutputBuffer holds the transformed image
+ **/ 
+bool DkBatchProcess::transformLossless() {
+
+	QRegExp jpgExp("(jpg|jpeg)", Qt::CaseInsensitive);
+
+	// additional outputs need the decoded image
+	if (!mFileBuffer || !mOutputs.empty() ||
+		mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output ||
+		!jpgExp.exactMatch(QFileInfo(mSaveInfo.inputFilePath()).suffix()) ||
+		!jpgExp.exactMatch(QFileInfo(mSaveInfo.outputFilePath()).suffix()))
+		return false;
+
+	QSharedPointer<DkBatchTransform> transform;
+
+	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
+
+		if (!batch || !batch->isActive())
+			continue;
+
+		// any other active function needs the pixels
+		if (transform)
+			return false;
+
+		transform = qSharedPointerDynamicCast<DkBatchTransform>(batch);
+
+		if (!transform)
+			return false;
+	}
+
+	if (!transform)
+		return false;
+
+	QSharedPointer<QByteArray> ba = mFileBuffer;
+	if (!transform->computeLossless(mSaveInfo.inputFilePath(), ba, mLogStrings))
+		return false;
+
+	mOutputBuffer = ba;
+	mFileBuffer.clear();
+
+	return true;
+}
+
+bool DkBatchProcess::copyFile() {
+
+	QFile file(mSaveInfo.inputFilePath());
+
+	if (mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output) {
+		mLogStrings.append(QObject::tr("I should copy the file, but 'Do not Save' is checked - so I will do nothing..."));
+		return false;
+	}
+
+	// existing outputs are replaced like encoded outputs (see commitOutput()):
+	// the file is copied next to the output and renamed - so the output is only touched if copying succeeded
+	QFileInfo outInfo(mSaveInfo.outputFilePath());
+	bool replace = outInfo.exists() && mSaveInfo.mode() == DkSaveInfo::mode_overwrite;
+	QString copyPath = replace ? outInfo.absoluteDir().filePath("." + outInfo.fileName() + ".copy") : mSaveInfo.outputFilePath();
+
+	if (replace && QFileInfo(copyPath).exists())
+		QFile::remove(copyPath);	// left over by a crashed run
+
+	if (!file.copy(copyPath) || (replace && !DkUtils::renameOverwrite(copyPath, mSaveInfo.outputFilePath()))) {
+		mLogStrings.append(QObject::tr("Error: could not copy file"));
+		mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
+		mLogStrings.append(QObject::tr("Output: %1").arg(mSaveInfo.outputFilePath()));
+		mLogStrings.append(file.errorString());
+
+		if (replace)
+			QFile::remove(copyPath);
+
+		return false;
+	}
+	else
+		mLogStrings.append(QObject::tr("Copying: %1 -> %2").arg(mSaveInfo.inputFilePath()).arg(mSaveInfo.outputFilePath()));
+
+	return true;
+}
+
+bool DkBatchProcess::deleteOriginalFile() {
+
+	if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath())
+		return true;
+
+	// failed outputs keep the original too
+	int numFailures = mFailure;
+	for (QSharedPointer<DkBatchProcess> o : mOutputs)
+		numFailures += o->mFailure;
+
+	if (!numFailures && mSaveInfo.isDeleteOriginal()) {
+		QFile oFile(mSaveInfo.inputFilePath());
+
+		if (oFile.remove())
+			mLogStrings.append(QObject::tr("%1 deleted.").arg(mSaveInfo.inputFilePath()));
+		else {
+			mFailure++;
+			mLogStrings.append(QObject::tr("I could not delete %1").arg(mSaveInfo.inputFilePath()));
+			return false;
+		}
+	}
+	else if (numFailures)
+		mLogStrings.append(QObject::tr("I did not delete the original because I detected %1 failure(s).").arg(numFailures));
+
+	return true;
+}
+
+// DkBatchOutputConfig --------------------------------------------------------------------
+DkBatchOutputConfig::DkBatchOutputConfig(const QString& outputDir, const QString& fileNamePattern) {
+
+	mOutputDirPath = outputDir;
+	mFileNamePattern = fileNamePattern;
+}
+
+/**
+ * Creates the save info of a single batch item.
+ * @param filePath the input file path
+ * @param idx the item's index (needed for the file name pattern)
+ * @return DkSaveInfo the save info with input and output file paths
+ **/ 
+DkSaveInfo DkBatchOutputConfig::createSaveInfo(const QString& filePath, int idx) const {
+
+	DkSaveInfo si = mSaveInfo;
+
+	QFileInfo cFileInfo = QFileInfo(filePath);
+	QString outDir = si.isInputDirOutputDir() ? cFileInfo.absolutePath() : mOutputDirPath;
+
+	DkFileNameConverter converter(cFileInfo.fileName(), mFileNamePattern, idx);
+	QString outputFilePath = QFileInfo(outDir, converter.getConvertedFileName()).absoluteFilePath();
+
+	// set input/output file path
+	si.setInputFilePath(filePath);
+	si.setOutputFilePath(outputFilePath);
+
+	return si;
+}
+
+void DkBatchOutputConfig::saveSettings(QSettings & settings) const {
+
+	settings.setValue("OutputDirPath", mOutputDirPath);
+	settings.setValue("FileNamePattern", mFileNamePattern);
+
+	mSaveInfo.saveSettings(settings);
+
+	for (auto pf : mProcessFunctions)
+		pf->saveSettings(settings);
+}
+
+void DkBatchOutputConfig::loadSettings(QSettings & settings) {
+
+	mOutputDirPath = settings.value("OutputDirPath", mOutputDirPath).toString();
+	mFileNamePattern = settings.value("FileNamePattern", mFileNamePattern).toString();
+
+	mSaveInfo.loadSettings(settings);
+
+	QStringList groups = settings.childGroups();
+	
+	for (const QString& name : groups) {
+
+		// known groups that are not batch processes
+		if (name == "SaveInfo" || name.startsWith("Output"))
+			continue;
+
+		QSharedPointer<DkAbstractBatch> batch = DkAbstractBatch::createFromName(name);
+
+		// if it is valid - append the process
+		if (batch) {
+			batch->loadSettings(settings);
+			mProcessFunctions << batch;
+		}
+	}
+
+	for (auto pf : mProcessFunctions)
+		pf->saveSettings(settings);
+}
+
+// DkBatchConfig --------------------------------------------------------------------
+DkBatchConfig::DkBatchConfig(const QStringList& fileList, const QString& outputDir, const QString& fileNamePattern) : DkBatchOutputConfig(outputDir, fileNamePattern) {
+
+	mFileList = fileList;
+};
+
+bool DkBatchConfig::isOk() const {
+
+	if (mOutputDirPath.isEmpty())
+		return false;
+
+	QDir oDir(mOutputDirPath);
+
+	if (!oDir.exists()) {
+		if (!oDir.mkpath("."))
+			return false;	// output dir does not exist & I cannot create it
+	}
+
+	if (mFileList.empty())
+		return false;
+
+	if (mFileNamePattern.isEmpty())
+		return false;
+
+	for (const DkBatchOutputConfig& o : mOutputs) {
+
+		if (o.getOutputDirPath().isEmpty() || o.getFileNamePattern().isEmpty())
+			return false;
+
+		if (!QDir(o.getOutputDirPath()).mkpath("."))
+			return false;
+	}
+
+	return true;
+}
+
+
+// DkBatchJournal --------------------------------------------------------------------
+DkBatchJournal::DkBatchJournal(const QString& filePath, const QString& profileHash) {
+
+	mFilePath = filePath;
+	mProfileHash = profileHash;
+}
+
+/**
+ * Loads the entries of previous runs and opens the journal for appending.
+ * Entries of other profiles and torn lines are ignored.
+ * @return bool true if the journal can be written
+ **/ 
+bool DkBatchJournal::load() {
+
+	mEntries.clear();
+
+	bool torn = false;
+
+	QFile file(mFilePath);
+	if (file.open(QIODevice::ReadOnly)) {
+
+		while (!file.atEnd()) {
+
+			QByteArray line = file.readLine();
+			torn = !line.endsWith('\n');
+
+			QJsonObject json = QJsonDocument::fromJson(line).object();
+
+			if (json.value("profile").toString() != mProfileHash)
+				continue;
+
+			Entry e;
+			e.inputSize = (qint64)json.value("inputSize").toDouble(-1);
+			e.inputModified = (qint64)json.value("inputModified").toDouble(-1);
+			e.outputSize = (qint64)json.value("outputSize").toDouble(-1);
+			e.outputPath = json.value("output").toString();
+
+			mEntries.insert(json.value("input").toString(), e);
+		}
+
+		qDebug() << "[DkBatchJournal]" << mEntries.size() << "finished items loaded from" << mFilePath;
+	}
+
+	mFile.setFileName(mFilePath);
+
+	if (!mFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		qWarning() << "[DkBatchJournal] cannot write to" << mFilePath;
+		return false;
+	}
+
+	// terminate a torn line - otherwise the next item would be appended to it
+	if (torn) {
+		mFile.write("\n");
+		mFile.flush();
+	}
+
+	return true;
+}
+
+/**
+ * Returns true if the item was finished by a previous run and nothing changed since.
+ * This only needs the file's stats - no file is read.
+ **/ 
+bool DkBatchJournal::isDone(const QString& inputPath, qint64 inputSize, qint64 inputModified, const QFileInfo& output) const {
+
+	auto e = mEntries.constFind(inputPath);
+
+	if (e == mEntries.constEnd())
+		return false;
+
+	return	e->inputSize == inputSize &&
+			e->inputModified == inputModified &&
+			e->outputPath == output.absoluteFilePath() &&
+			output.exists() &&
+			e->outputSize == output.size();
+}
+
+/**
+ * Appends a finished item.
+ * The line is flushed at once so that it survives if the batch is killed.
+ **/ 
+void DkBatchJournal::add(const QString& inputPath, qint64 inputSize, qint64 inputModified, const QString& outputPath) {
+
+	QFileInfo output(outputPath);
+
+	QJsonObject json;
+	json.insert("input", inputPath);
+	json.insert("inputSize", inputSize);
+	json.insert("inputModified", inputModified);
+	json.insert("profile", mProfileHash);
+	json.insert("output", output.absoluteFilePath());
+	json.insert("outputSize", output.size());
+
+	QByteArray line = QJsonDocument(json).toJson(QJsonDocument::Compact) + "\n";
+
+	QMutexLocker locker(&mMutex);
+
+	if (!mFile.isOpen())
+		return;
+
+	mFile.write(line);
+	mFile.flush();
+}
+
+/**
+ * Hashes everything that changes the outputs (but the file list).
+ **/ 
+QString DkBatchJournal::profileHash(const DkBatchConfig& config) {
+
+	DkBatchConfig c = config;
+	c.setFileList(QStringList());
+
+	QTemporaryFile file;
+	if (!file.open())
+		return QString();
+
+	{
+		QSettings settings(file.fileName(), QSettings::IniFormat);
+		c.saveSettings(settings);
+	}	// settings are written here
+
+	// QSettings might replace the file - so we open it again
+	QFile settingsFile(file.fileName());
+	if (!settingsFile.open(QIODevice::ReadOnly))
+		return QString();
+
+	return QCryptographicHash::hash(settingsFile.readAll(), QCryptographicHash::Md5).toHex();
+}
+
+QString DkBatchJournal::fileName() {
+
+	return "nomacs-batch.journal";
+}
+
+// DkBatchQueue --------------------------------------------------------------------
+DkBatchQueue::DkBatchQueue(int capacity) {
+
+	mCapacity = qMax(capacity, 1);
+}
+
+/**
+ * Appends an item and blocks as long as the queue is full.
+ * @param idx the item's index
+ **/ 
+void DkBatchQueue::push(int idx) {
+
+	QMutexLocker locker(&mMutex);
+
+	while (mItems.size() >= mCapacity)
+		mNotFull.wait(&mMutex);
+
+	mItems.enqueue(idx);
+	mNotEmpty.wakeOne();
+}
+
+/**
+ * Takes the next item and blocks as long as the queue is empty.
+ * @param idx the item's index
+ * @return bool false if the queue is closed and no items are left
+ **/ 
+bool DkBatchQueue::pop(int& idx) {
+
+	QMutexLocker locker(&mMutex);
+
+	while (mItems.empty() && !mClosed)
+		mNotEmpty.wait(&mMutex);
+
+	if (mItems.empty())
 		return false;
-	}
+
+	idx = mItems.dequeue();
+	mNotFull.wakeOne();
 
 	return true;
 }
 
-bool DkBatchProcess::renameFile() {
+bool DkBatchQueue::isEmpty() {
 
-	if (QFileInfo(mSaveInfo.outputFilePath()).exists()) {
-		mLogStrings.append(QObject::tr("Error: could not rename file, the target file exists already."));
-		return false;
+	QMutexLocker locker(&mMutex);
+	return mItems.empty();
+}
+
+/**
+ * Tells the consumers that no more items will be pushed.
+ **/ 
+void DkBatchQueue::close() {
+
+	QMutexLocker locker(&mMutex);
+	mClosed = true;
+	mNotEmpty.wakeAll();
+}
+
+// DkBatchPipeline --------------------------------------------------------------------
+DkBatchPipeline::DkBatchPipeline(QVector<DkBatchProcess>& items) {
+
+	// get the pointer here - the vector must not detach while we are computing
+	mItems = items.data();
+	mNumItems = items.size();
+
+	int numCores = QThread::idealThreadCount();
+
+	for (int idx = 0; idx < stage_end; idx++)
+		mNumThreads[idx] = qMax(numCores/2, 1);
+
+	// one reader & writer keeps the disk access sequential
+	mNumThreads[stage_read] = 1;
+	mNumThreads[stage_write] = 1;
+}
+
+/**
+ * Sets the number of workers of a stage.
+ * @param stage the pipeline stage
+ * @param numThreads the number of threads - values < 1 keep the default
+ **/ 
+void DkBatchPipeline::setNumThreads(Stage stage, int numThreads) {
+
+	if (numThreads > 0)
+		mNumThreads[stage] = numThreads;
+}
+
+int DkBatchPipeline::numThreads(Stage stage) const {
+
+	return mNumThreads[stage];
+}
+
+/**
+ * Sets the number of items that can wait between two stages.
+ * @param queueSize the queue size - if < 1, a stage can buffer one item per worker
+ **/ 
+void DkBatchPipeline::setQueueSize(int queueSize) {
+
+	mQueueSize = queueSize;
+}
+
+QFuture<int> DkBatchPipeline::start() {
+
+	int numThreads = 0;
+
+	for (int idx = 0; idx < stage_end; idx++) {
+
+		if (idx != stage_read)
+			mQueues[idx] = QSharedPointer<DkBatchQueue>(new DkBatchQueue(mQueueSize > 0 ? mQueueSize : mNumThreads[idx]));
+
+		mNumRunning[idx].store(mNumThreads[idx]);
+		numThreads += mNumThreads[idx];
 	}
 
-	QFile file(mSaveInfo.inputFilePath());
+	qDebug() << "[DkBatchPipeline] threads: read" << mNumThreads[stage_read] << "decode" << mNumThreads[stage_decode]
+		<< "process" << mNumThreads[stage_process] << "encode" << mNumThreads[stage_encode] << "write" << mNumThreads[stage_write];
 
-	// Note: if two images are renamed at the same time to the same name, one image is lost -> see Qt comment Race Condition
-	if (!file.rename(mSaveInfo.outputFilePath())) {
-		mLogStrings.append(QObject::tr("Error: could not rename file"));
-		mLogStrings.append(file.errorString());
-		return false;
+	mFutureInterface.reportStarted();
+	mFutureInterface.setProgressRange(0, mNumItems);
+
+	// we use our own pool since workers block on the queues
+	// and the process functions use the global pool
+	mPool.setMaxThreadCount(numThreads);
+
+	for (int idx = 0; idx < stage_end; idx++) {
+
+		for (int tIdx = 0; tIdx < mNumThreads[idx]; tIdx++)
+			QtConcurrent::run(&mPool, this, &DkBatchPipeline::runStage, (Stage)idx);
 	}
-	else
-		mLogStrings.append(QObject::tr("Renaming: %1 -> %2").arg(mSaveInfo.inputFilePath()).arg(mSaveInfo.outputFilePath()));
 
-	return true;
+	return mFutureInterface.future();
 }
 
-bool DkBatchProcess::copyFile() {
+void DkBatchPipeline::runStage(Stage stage) {
 
-	QFile file(mSaveInfo.inputFilePath());
+	// batches are background work - the viewer's loading (see DkTaskScheduler) comes first
+	QThread::currentThread()->setPriority(QThread::LowPriority);
 
-	if (mSaveInfo.mode() == DkSaveInfo::mode_do_not_save_output) {
-		mLogStrings.append(QObject::tr("I should copy the file, but 'Do not Save' is checked - so I will do nothing..."));
-		return false;
+	QVector<int> written;
+	int idx = 0;
+
+	while (nextItem(stage, idx)) {
+
+		// just drain the queue if the user canceled
+		if (mFutureInterface.isCanceled())
+			continue;
+
+		if (!computeStage(stage, mItems[idx]))
+			finishItem(idx);
+		else if (stage != stage_write)
+			mQueues[stage+1]->push(idx);
+		else {
+			written << idx;
+
+			// commit if the group is full or the writer would wait anyway
+			if (written.size() >= mCommitSize || mQueues[stage]->isEmpty())
+				commit(written);
+		}
 	}
 
-	if (QFileInfo(mSaveInfo.outputFilePath()).exists() && mSaveInfo.mode() == DkSaveInfo::mode_overwrite) {
-		if (!deleteOrRestoreExisting())
-			return false;	// early break
+	commit(written);
+
+	// the last worker of a stage closes its output
+	if (!mNumRunning[stage].deref()) {
+
+		if (stage != stage_write)
+			mQueues[stage+1]->close();
+		else
+			mFutureInterface.reportFinished();
 	}
+}
 
-	if (!file.copy(mSaveInfo.outputFilePath())) {
-		mLogStrings.append(QObject::tr("Error: could not copy file"));
-		mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
-		mLogStrings.append(QObject::tr("Output: %1").arg(mSaveInfo.outputFilePath()));
-		mLogStrings.append(file.errorString());
+bool DkBatchPipeline::nextItem(Stage stage, int& idx) {
+
+	if (stage != stage_read)
+		return mQueues[stage]->pop(idx);
+
+	if (mFutureInterface.isCanceled())
 		return false;
+
+	idx = mNextItem.fetchAndAddOrdered(1);
+
+	return idx < mNumItems;
+}
+
+bool DkBatchPipeline::computeStage(Stage stage, DkBatchProcess& item) const {
+
+	DkTimer dt;
+	bool success = false;
+
+	switch (stage) {
+	case stage_read:	success = item.prepare() && item.read();	break;
+	case stage_decode:	success = item.decode();					break;
+	case stage_process:	success = item.process();					break;
+	case stage_encode:	success = item.encode();					break;
+	case stage_write:	success = item.write();						break;
+	default:			return false;
 	}
-	else
-		mLogStrings.append(QObject::tr("Copying: %1 -> %2").arg(mSaveInfo.inputFilePath()).arg(mSaveInfo.outputFilePath()));
 
-	return true;
+	item.stats().addTime(stageName(stage), dt.elapsed());
+
+	return success;
 }
 
-bool DkBatchProcess::prepareDeleteExisting() {
+QString DkBatchPipeline::stageName(Stage stage) {
 
-	if (QFileInfo(mSaveInfo.outputFilePath()).exists() && mSaveInfo.mode() == DkSaveInfo::mode_overwrite) {
+	switch (stage) {
+	case stage_read:	return "read";
+	case stage_decode:	return "decode";
+	case stage_process:	return "process";
+	case stage_encode:	return "encode";
+	case stage_write:	return "write";
+	default:			return "";
+	}
+}
 
-		mSaveInfo.createBackupFilePath();
+/**
+ * Flushes a group of written files to the disk and replaces their outputs.
+ * All files of a group are flushed before the first one is renamed.
+ * @param items the items that were written - the vector is cleared
+ **/ 
+void DkBatchPipeline::commit(QVector<int>& items) {
 
-		// check the uniqueness : )
-		if (QFileInfo(mSaveInfo.backupFilePath()).exists()) {
-			mLogStrings.append(QObject::tr("Error: back-up (%1) file already exists").arg(mSaveInfo.backupFilePath()));
-			mSaveInfo.clearBackupFilePath();
-			return false;
-		}
+	QVector<int> synced;
 
-		QFile file(mSaveInfo.outputFilePath());
+	for (int idx : items) {
+		DkTimer dt;
+		bool ok = mItems[idx].sync();
+		mItems[idx].stats().addTime("commit", dt.elapsed());
 
-		if (!file.rename(mSaveInfo.backupFilePath())) {
-			mLogStrings.append(QObject::tr("Error: could not rename existing file to %1").arg(mSaveInfo.backupFilePath()));
-			mLogStrings.append(file.errorString());
-			mSaveInfo.clearBackupFilePath();
-			return false;
-		}
+		if (ok)
+			synced << idx;
+		else
+			finishItem(idx);
 	}
 
-	return true;
+	for (int idx : synced) {
+		DkTimer dt;
+		mItems[idx].commit();
+		mItems[idx].stats().addTime("commit", dt.elapsed());
+		finishItem(idx);
+	}
+
+	items.clear();
 }
 
-bool DkBatchProcess::deleteOrRestoreExisting() {
+void DkBatchPipeline::finishItem(int idx) {
 
-	QFileInfo outInfo(mSaveInfo.outputFilePath());
+	mItems[idx].finish();
+	mFutureInterface.reportResult(idx);
+	mFutureInterface.setProgressValue(mNumFinished.fetchAndAddOrdered(1) + 1);
+}
 
-	if (outInfo.exists() && !mSaveInfo.backupFilePath().isEmpty() && mSaveInfo.backupFileInfo().exists()) {
-		QFile file(mSaveInfo.backupFilePath());
+// DkBatchStats --------------------------------------------------------------------
+DkBatchStats::DkBatchStats(const QVector<DkBatchProcess>& items, int elapsed) {
 
-		if (!file.remove()) {
-			mLogStrings.append(QObject::tr("Error: could not delete existing file"));
-			mLogStrings.append(file.errorString());
-			return false;
-		}
+	// cancelled items have no stats
+	for (const DkBatchProcess& item : items) {
+		if (item.wasProcessed())
+			mItems << item;
 	}
-	// fall-back
-	else if (!outInfo.exists()) {
-		
-		QFile file(mSaveInfo.backupFilePath());
 
-		if (!file.rename(mSaveInfo.outputFilePath())) {
-			mLogStrings.append(QObject::tr("Ui - a lot of things went wrong sorry, your original file can be found here: %1").arg(mSaveInfo.backupFilePath()));
-			mLogStrings.append(file.errorString());
-			return false;
-		}
-		else {
-			mLogStrings.append(QObject::tr("I could not save to %1 so I restored the original file.").arg(mSaveInfo.outputFilePath()));
+	mElapsed = elapsed;
+}
+
+/**
+ * Returns all measured stages and batch functions.
+ * @return QStringList the keys in the order they were measured
+ **/ 
+QStringList DkBatchStats::keys() const {
+
+	QStringList keys;
+
+	for (const DkBatchProcess& item : mItems) {
+		for (const QString& key : item.totalStats().keys()) {
+			if (!keys.contains(key))
+				keys << key;
 		}
 	}
 
-	return true;
+	return keys;
 }
 
-bool DkBatchProcess::deleteOriginalFile() {
+QString DkBatchStats::toCsv() const {
 
-	if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath())
-		return true;
+	QStringList keys = this->keys();
 
-	if (!mFailure && mSaveInfo.isDeleteOriginal()) {
-		QFile oFile(mSaveInfo.inputFilePath());
+	QStringList header;
+	header << "input" << "output" << "additional_outputs" << "failed" << "bytes_in" << "bytes_out" << keys;
 
-		if (oFile.remove())
-			mLogStrings.append(QObject::tr("%1 deleted.").arg(mSaveInfo.inputFilePath()));
-		else {
-			mFailure++;
-			mLogStrings.append(QObject::tr("I could not delete %1").arg(mSaveInfo.inputFilePath()));
-			return false;
-		}
+	QString csv = header.join(",") + "\n";
+
+	for (const DkBatchProcess& item : mItems) {
+
+		DkBatchItemStats stats = item.totalStats();
+
+		QStringList row;
+		row << "\"" + QString(item.inputFile()).replace("\"", "\"\"") + "\"";
+		row << "\"" + QString(item.outputFile()).replace("\"", "\"\"") + "\"";
+		row << "\"" + item.additionalOutputFiles().join(";").replace("\"", "\"\"") + "\"";
+		row << QString::number(item.hasFailed() ? 1 : 0);
+		row << QString::number(stats.bytesIn());
+		row << QString::number(stats.bytesOut());
+
+		for (const QString& key : keys)
+			row << QString::number(stats.time(key));
+
+		csv += row.join(",") + "\n";
 	}
-	else if (mFailure)
-		mLogStrings.append(QObject::tr("I did not delete the original because I detected %1 failure(s).").arg(mFailure));
 
-	return true;
+	return csv;
 }
 
-// DkBatchConfig --------------------------------------------------------------------
-DkBatchConfig::DkBatchConfig(const QStringList& fileList, const QString& outputDir, const QString& fileNamePattern) {
+QJsonObject DkBatchStats::toJson() const {
 
-	mFileList = fileList;
-	mOutputDirPath = outputDir;
-	mFileNamePattern = fileNamePattern;
-	
-};
+	QStringList keys = this->keys();
 
-bool DkBatchConfig::isOk() const {
+	QJsonArray items;
+	for (const DkBatchProcess& item : mItems) {
 
-	if (mOutputDirPath.isEmpty())
-		return false;
+		DkBatchItemStats stats = item.totalStats();
 
-	QDir oDir(mOutputDirPath);
+		QJsonObject times;
+		for (const QString& key : stats.keys())
+			times[key] = stats.time(key);
 
-	if (!oDir.exists()) {
-		if (!oDir.mkpath("."))
-			return false;	// output dir does not exist & I cannot create it
+		QJsonObject jo;
+		jo["input"] = item.inputFile();
+		jo["output"] = item.outputFile();
+
+		if (!item.additionalOutputFiles().empty())
+			jo["additionalOutputs"] = QJsonArray::fromStringList(item.additionalOutputFiles());
+
+		jo["failed"] = item.hasFailed();
+		jo["bytesIn"] = (double)stats.bytesIn();
+		jo["bytesOut"] = (double)stats.bytesOut();
+		jo["times"] = times;
+
+		items.append(jo);
 	}
 
-	if (mFileList.empty())
-		return false;
+	QJsonObject summary;
+	for (const QString& key : keys)
+		summary[key] = keySummary(key);
 
-	if (mFileNamePattern.isEmpty())
+	QJsonObject json;
+	json["elapsed"] = mElapsed;
+	json["items"] = items;
+	json["summary"] = summary;
+
+	return json;
+}
+
+/**
+ * Saves the stats.
+ * @param filePath the stats are saved as CSV if the suffix is csv and as JSON otherwise
+ * @return bool true if the file was written
+ **/ 
+bool DkBatchStats::save(const QString& filePath) const {
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkBatchStats] could not write to" << filePath << file.errorString();
 		return false;
+	}
+
+	if (QFileInfo(filePath).suffix().toLower() == "csv")
+		file.write(toCsv().toUtf8());
+	else
+		file.write(QJsonDocument(toJson()).toJson());
 
 	return true;
 }
 
+/**
+ * Returns a human readable summary.
+ * @return QStringList one line per stage (percentiles & total time in ms)
+ **/ 
+QStringList DkBatchStats::summary() const {
+
+	QStringList lines;
+	for (const QString& key : keys()) {
+
+		QJsonObject jo = keySummary(key);
+
+		lines << QString("%1: p50 %2 ms | p90 %3 ms | p99 %4 ms | total %5 ms")
+			.arg(key)
+			.arg(jo["p50"].toInt())
+			.arg(jo["p90"].toInt())
+			.arg(jo["p99"].toInt())
+			.arg((qint64)jo["total"].toDouble());
+	}
+
+	return lines;
+}
+
+/**
+ * Aggregates the times of a single stage or batch function.
+ * @param key the stage
+ * @return QJsonObject the percentiles and the total time in ms
+ **/ 
+QJsonObject DkBatchStats::keySummary(const QString& key) const {
+
+	QVector<int> times;
+	qint64 total = 0;
+
+	for (const DkBatchProcess& item : mItems) {
+		times << item.totalStats().time(key);
+		total += times.last();
+	}
+
+	QJsonObject jo;
+	jo["p50"] = percentile(times, 0.5);
+	jo["p90"] = percentile(times, 0.9);
+	jo["p99"] = percentile(times, 0.99);
+	jo["total"] = (double)total;
+
+	return jo;
+}
+
+/**
+ * Extrapolates the runtime and output size of a batch from these stats.
+ * The runtime is scaled by the number of files since the wall time
+ * already accounts for the pipeline's parallelism. The output size
+ * is scaled by the input size.
+ * @param numFiles the number of files of the batch
+ * @param numBytes the total input size of the batch
+ * @return QJsonObject the estimate
+ **/ 
+QJsonObject DkBatchStats::estimate(int numFiles, qint64 numBytes) const {
+
+	qint64 bytesIn = 0;
+	qint64 bytesOut = 0;
+
+	for (const DkBatchProcess& item : mItems) {
+		DkBatchItemStats stats = item.totalStats();
+		bytesIn += stats.bytesIn();
+		bytesOut += stats.bytesOut();
+	}
+
+	QJsonObject json;
+	json["samples"] = mItems.size();
+	json["elapsed"] = mElapsed;
+	json["files"] = numFiles;
+	json["bytesIn"] = (double)numBytes;
+
+	if (!mItems.empty())
+		json["estimatedTime"] = (double)qRound64((double)mElapsed * numFiles / mItems.size());
+	if (bytesIn > 0)
+		json["estimatedBytesOut"] = (double)qRound64((double)bytesOut / bytesIn * numBytes);
+
+	return json;
+}
+
+/**
+ * Nearest rank percentile.
+ * @param values the values
+ * @param p the percentile in [0 1]
+ * @return int the percentile or 0 if values is empty
+ **/ 
+int DkBatchStats::percentile(QVector<int> values, double p) {
+
+	if (values.empty())
+		return 0;
+
+	std::sort(values.begin(), values.end());
+	int idx = (int)std::ceil(p * values.size()) - 1;
+
+	return values[qBound(0, idx, values.size()-1)];
+}
 
 // DkBatchProcessing --------------------------------------------------------------------
 DkBatchProcessing::DkBatchProcessing(const DkBatchConfig& config, QWidget* parent /*= 0*/) : QObject(parent) {
@@ -871,7 +2366,8 @@ DkBatchProcessing::DkBatchProcessing(const DkBatchConfig& config, QWidget* paren
 	mBatchConfig = config;
 
 	connect(&mBatchWatcher, SIGNAL(progressValueChanged(int)), this, SIGNAL(progressValueChanged(int)));
-	connect(&mBatchWatcher, SIGNAL(finished()), this, SIGNAL(finished()));
+	connect(&mBatchWatcher, SIGNAL(resultReadyAt(int)), this, SLOT(itemResultReady(int)));
+	connect(&mBatchWatcher, SIGNAL(finished()), this, SLOT(batchFinished()));
 }
 
 void DkBatchProcessing::init() {
@@ -879,39 +2375,86 @@ void DkBatchProcessing::init() {
 	mBatchItems.clear();
 	
 	QStringList fileList = mBatchConfig.getFileList();
+	QSharedPointer<DkBatchJournal> journal = mDryRun > 0 ? QSharedPointer<DkBatchJournal>() : createJournal();
+
+	// a dry run samples the files evenly
+	QVector<int> indexes;
+	if (mDryRun > 0) {
+		int numSamples = qMin(mDryRun, fileList.size());
+		for (int sIdx = 0; sIdx < numSamples; sIdx++)
+			indexes << (int)((qint64)sIdx * fileList.size() / numSamples);
+	}
+	else {
+		for (int idx = 0; idx < fileList.size(); idx++)
+			indexes << idx;
+	}
 
-	for (int idx = 0; idx < fileList.size(); idx++) {
-
-		DkSaveInfo si = mBatchConfig.saveInfo();
+	for (int idx : indexes) {
 
-		QFileInfo cFileInfo = QFileInfo(fileList.at(idx));
-		QString outDir = si.isInputDirOutputDir() ? cFileInfo.absolutePath() : mBatchConfig.getOutputDirPath();
+		DkBatchProcess cProcess(mBatchConfig.createSaveInfo(fileList.at(idx), idx));
+		cProcess.setProcessChain(mBatchConfig.getProcessFunctions());
+		cProcess.setJournal(journal);
+		cProcess.setDryRun(mDryRun > 0);
 
-		DkFileNameConverter converter(cFileInfo.fileName(), mBatchConfig.getFileNamePattern(), idx);
-		QString outputFilePath = QFileInfo(outDir, converter.getConvertedFileName()).absoluteFilePath();
+		// additional outputs share the decoded image
+		for (const DkBatchOutputConfig& o : mBatchConfig.getOutputs()) {
 
-		// set input/output file path
-		si.setInputFilePath(fileList.at(idx));
-		si.setOutputFilePath(outputFilePath);
+			DkSaveInfo si = o.createSaveInfo(fileList.at(idx), idx);
+			si.setDeleteOriginal(false);	// the main output decides
 
-		DkBatchProcess cProcess(si);
-		cProcess.setProcessChain(mBatchConfig.getProcessFunctions());
+			QSharedPointer<DkBatchProcess> output(new DkBatchProcess(si));
+			output->setProcessChain(o.getProcessFunctions());
+			output->setDryRun(mDryRun > 0);
+			cProcess.addOutput(output);
+		}
 
 		mBatchItems.push_back(cProcess);
 	}
 }
 
+/**
+ * Creates the journal that allows for resuming this batch.
+ * @return QSharedPointer<DkBatchJournal> the journal or NULL if items cannot be skipped
+ **/ 
+QSharedPointer<DkBatchJournal> DkBatchProcessing::createJournal() const {
+
+	// items with additional outputs are only done if all outputs are done - the journal just knows the main output
+	if (!DkSettingsManager::param().resources().batchJournal || 
+		mBatchConfig.getOutputDirPath().isEmpty() ||
+		mBatchConfig.saveInfo().mode() == DkSaveInfo::mode_do_not_save_output ||
+		!mBatchConfig.getOutputs().empty())
+		return QSharedPointer<DkBatchJournal>();
+
+#ifdef WITH_PLUGINS
+	// plugins might need all items in postLoad
+	for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions()) {
+		if (qSharedPointerDynamicCast<DkPluginBatch>(fun))
+			return QSharedPointer<DkBatchJournal>();
+	}
+#endif
+
+	QString filePath = QFileInfo(mBatchConfig.getOutputDirPath(), DkBatchJournal::fileName()).absoluteFilePath();
+	QSharedPointer<DkBatchJournal> journal(new DkBatchJournal(filePath, DkBatchJournal::profileHash(mBatchConfig)));
+
+	if (!journal->load())
+		return QSharedPointer<DkBatchJournal>();
+
+	return journal;
+}
+
 void DkBatchConfig::saveSettings(QSettings & settings) const {
 
 	settings.beginGroup("General");
 	settings.setValue("FileList", mFileList.join(";"));
-	settings.setValue("OutputDirPath", mOutputDirPath);
-	settings.setValue("FileNamePattern", mFileNamePattern);
 
-	mSaveInfo.saveSettings(settings);
+	DkBatchOutputConfig::saveSettings(settings);
 
-	for (auto pf : mProcessFunctions)
-		pf->saveSettings(settings);
+	// additional outputs are numbered from 1 - the main output is 0
+	for (int idx = 0; idx < mOutputs.size(); idx++) {
+		settings.beginGroup("Output" + QString::number(idx + 1));
+		mOutputs[idx].saveSettings(settings);
+		settings.endGroup();
+	}
 
 	settings.endGroup();
 }
@@ -920,64 +2463,72 @@ void DkBatchConfig::loadSettings(QSettings & settings) {
 
 	settings.beginGroup("General");
 	mFileList = settings.value("FileList", mFileList).toString().split(";");
-	mOutputDirPath = settings.value("OutputDirPath", mOutputDirPath).toString();
-	mFileNamePattern = settings.value("FileNamePattern", mFileNamePattern).toString();
-
-	mSaveInfo.loadSettings(settings);
 
-	QStringList groups = settings.childGroups();
-	
-	for (const QString& name : groups) {
+	DkBatchOutputConfig::loadSettings(settings);
 
-		// known groups that are not batch processes
-		if (name == "SaveInfo")
-			continue;
+	for (int idx = 1; settings.childGroups().contains("Output" + QString::number(idx)); idx++) {
 
-		QSharedPointer<DkAbstractBatch> batch = DkAbstractBatch::createFromName(name);
+		DkBatchOutputConfig output;
+		output.setSaveInfo(mSaveInfo);	// outputs inherit everything they do not overwrite
+		settings.beginGroup("Output" + QString::number(idx));
+		output.loadSettings(settings);
+		settings.endGroup();
 
-		// if it is valid - append the process
-		if (batch) {
-			batch->loadSettings(settings);
-			mProcessFunctions << batch;
-		}
+		mOutputs << output;
 	}
 
-	for (auto pf : mProcessFunctions)
-		pf->saveSettings(settings);
-
 	settings.endGroup();
 }
 
 void DkBatchProcessing::compute() {
 
+	if (mBatchWatcher.isRunning())
+		mBatchWatcher.waitForFinished();
+
 	init();
 
 	qDebug() << "computing...";
 
-	if (mBatchWatcher.isRunning())
-		mBatchWatcher.waitForFinished();
-
-	QFuture<void> future = QtConcurrent::map(mBatchItems, &nmc::DkBatchProcessing::computeItem);
-	mBatchWatcher.setFuture(future);
-}
+	const DkSettings::Resources& rs = DkSettingsManager::param().resources();
 
-bool DkBatchProcessing::computeItem(DkBatchProcess& item) {
+	mPipeline = QSharedPointer<DkBatchPipeline>(new DkBatchPipeline(mBatchItems));
+	mPipeline->setNumThreads(DkBatchPipeline::stage_read, rs.batchIoThreads);
+	mPipeline->setNumThreads(DkBatchPipeline::stage_decode, rs.batchDecodeThreads);
+	mPipeline->setNumThreads(DkBatchPipeline::stage_process, rs.batchProcessThreads);
+	mPipeline->setNumThreads(DkBatchPipeline::stage_encode, rs.batchEncodeThreads);
+	mPipeline->setNumThreads(DkBatchPipeline::stage_write, rs.batchIoThreads);
+	mPipeline->setQueueSize(rs.batchQueueSize);
 
-	return item.compute();
+	mElapsed = 0;
+	mTimer.start();
+	mBatchWatcher.setFuture(mPipeline->start());
 }
 
 void DkBatchProcessing::postLoad() {
 
-	// collect batch infos
+	QVector<DkBatchOutputConfig> outputs = mBatchConfig.getOutputs();
+
+	// collect batch infos - each chain only gets the infos of its own output
 	QVector<QSharedPointer<DkBatchInfo> > batchInfo;
+	QVector<QVector<QSharedPointer<DkBatchInfo> > > outputInfos(outputs.size());
 
 	for (DkBatchProcess batch : mBatchItems) {
-		batchInfo << batch.batchInfo();
+		batchInfo << batch.batchInfo(false);
+
+		QVector<QSharedPointer<DkBatchProcess> > bo = batch.outputs();
+		for (int idx = 0; idx < bo.size() && idx < outputInfos.size(); idx++)
+			outputInfos[idx] << bo[idx]->batchInfo();
 	}
 
 	for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions()) {
 		fun->postLoad(batchInfo);
 	}
+
+	// the strip chains of additional outputs need their finalisation too
+	for (int idx = 0; idx < outputs.size(); idx++) {
+		for (QSharedPointer<DkAbstractBatch> fun : outputs[idx].getProcessFunctions())
+			fun->postLoad(outputInfos[idx]);
+	}
 }
 
 QStringList DkBatchProcessing::getLog() const {
@@ -1082,6 +2633,99 @@ void DkBatchProcessing::cancel() {
 	mBatchWatcher.cancel();
 }
 
+void DkBatchProcessing::itemResultReady(int resultIdx) {
+
+	emit itemFinished(mBatchWatcher.resultAt(resultIdx));
+}
+
+DkBatchProcess DkBatchProcessing::batchItem(int idx) const {
+
+	return mBatchItems.at(idx);
+}
+
+void DkBatchProcessing::batchFinished() {
+
+	mElapsed = mTimer.elapsed();
+	emit finished();
+}
+
+/**
+ * Enables the dry run.
+ * A dry run computes a few files without saving them to estimate the batch.
+ * @param numSamples the number of files that are processed, 0 processes the whole batch
+ **/ 
+void DkBatchProcessing::setDryRun(int numSamples) {
+
+	mDryRun = numSamples;
+}
+
+int DkBatchProcessing::dryRun() const {
+
+	return mDryRun;
+}
+
+DkBatchStats DkBatchProcessing::stats() const {
+
+	return DkBatchStats(mBatchItems, mElapsed);
+}
+
+/**
+ * Extrapolates the runtime and output size of the whole batch from the computed items.
+ * @return QJsonObject the estimate (see DkBatchStats::estimate)
+ **/ 
+QJsonObject DkBatchProcessing::estimate() const {
+
+	QStringList fileList = mBatchConfig.getFileList();
+
+	qint64 numBytes = 0;
+	for (const QString& filePath : fileList)
+		numBytes += QFileInfo(filePath).size();
+
+	return stats().estimate(fileList.size(), numBytes);
+}
+
+// DkBatchJsonReporter --------------------------------------------------------------------
+DkBatchJsonReporter::DkBatchJsonReporter(DkBatchProcessing* batch, QObject* parent) : QObject(parent) {
+
+	mBatch = batch;
+
+	connect(batch, SIGNAL(itemFinished(int)), this, SLOT(itemFinished(int)));
+	connect(batch, SIGNAL(finished()), this, SLOT(batchFinished()));
+}
+
+void DkBatchJsonReporter::itemFinished(int idx) {
+
+	DkBatchProcess item = mBatch->batchItem(idx);
+	mNumFinished++;
+
+	QJsonObject json;
+	json.insert("event", "item");
+	json.insert("index", idx);
+	json.insert("input", item.inputFile());
+	json.insert("output", item.outputFile());
+	json.insert("status", item.hasFailed() ? "failed" : "ok");
+	json.insert("finished", mNumFinished);
+	json.insert("total", mBatch->getNumItems());
+
+	print(json);
+}
+
+void DkBatchJsonReporter::batchFinished() {
+
+	QJsonObject json;
+	json.insert("event", "finished");
+	json.insert("processed", mBatch->getNumProcessed());
+	json.insert("failed", mBatch->getNumFailures());
+	json.insert("total", mBatch->getNumItems());
+
+	print(json);
+}
+
+void DkBatchJsonReporter::print(const QJsonObject& json) const {
+
+	std::cout << QJsonDocument(json).toJson(QJsonDocument::Compact).constData() << std::endl;
+}
+
 // DkBatchProfile --------------------------------------------------------------------
 QString DkBatchProfile::ext = "pnm";	// profile file extension
 
@@ -34,9 +34,19 @@
 #include <QDir>
 #include <QStringList>
 #include <QUrl>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QHash>
+#include <QFile>
+#include <QTemporaryFile>
 #pragma warning(pop)		// no warnings from includes - end
 
 #include "DkBatchInfo.h"
+#include "DkTimer.h"
 
 #pragma warning(disable: 4251)	// TODO: remove
 
@@ -52,6 +62,8 @@
 
 // Qt defines
 class QImage;
+class QJsonObject;
+class QRect;
 class QSettings;
 
 namespace nmc {
@@ -59,6 +71,7 @@ namespace nmc {
 // nomacs defines
 class DkImageContainer;
 class DkPluginContainer;
+class DkBatchJournal;
 
 class DllLoaderExport DkAbstractBatch {
 
@@ -78,6 +91,10 @@ public:
 	virtual bool isActive() const { return false; };
 	virtual void postLoad(const QVector<QSharedPointer<DkBatchInfo> >&) const {};
 
+	// strip processing - see DkBatchStripChain
+	virtual QVector<int> stripBorders() const { return QVector<int>(); };	// one border per strip operation - empty if the whole image is needed
+	virtual bool computeStrip(int, const QImage&, const QRect&, QImage&) const { return false; };
+
 	virtual QString name() const {return "Abstract Batch";};
 	QString settingsName() const;
 
@@ -163,6 +180,9 @@ public:
 	virtual bool isActive() const override;
 	virtual QStringList pluginList() const;
 
+	virtual QVector<int> stripBorders() const override;
+	virtual bool computeStrip(int opIdx, const QImage& strip, const QRect& roi, QImage& result) const override;
+
 
 protected:
 	void loadAllPlugins();
@@ -187,6 +207,8 @@ public:
 	virtual QString name() const;
 	virtual bool isActive() const;
 
+	bool computeLossless(const QString& filePath, QSharedPointer<QByteArray>& ba, QStringList& logStrings) const;
+
 	int angle() const;
 	bool horizontalFlip() const;
 	bool verticalFlip() const;
@@ -200,28 +222,110 @@ protected:
 	bool mCropFromMetadata = false;
 };
 
+/**
+ * Runs strip operations of several batch functions in a single pass.
+ * The image is processed in place from top to bottom. Each strip is
+ * extended by the border (halo) of all operations and every operation
+ * shrinks the valid rows by its border. Hence, a worker holds the image,
+ * a few strips and the unprocessed rows above the current strip instead
+ * of a full copy per operation.
+ **/
+class DllLoaderExport DkBatchStripChain {
+
+public:
+	DkBatchStripChain(int stripHeight = 256);
+
+	void add(QSharedPointer<DkAbstractBatch> batch);
+	void clear();
+	bool isEmpty() const;
+	int border() const;
+	QStringList names() const;
+
+	bool compute(QImage& img, QStringList& logStrings) const;
+
+protected:
+	static void copyRows(const QImage& src, int srcRow, QImage& dst, int dstRow, int numRows);
+
+	QVector<QPair<QSharedPointer<DkAbstractBatch>, int> > mOps;	// batch function & its strip operation
+	QVector<int> mBorders;
+	int mStripHeight;
+};
+
+/**
+ * Timings and sizes of a single batch item.
+ * Times are measured in ms and accumulated per key (stage or batch function).
+ **/
+class DllLoaderExport DkBatchItemStats {
+
+public:
+	DkBatchItemStats() {};
+
+	void addTime(const QString& key, int ms);
+	int time(const QString& key) const;
+	QStringList keys() const;
+
+	void setBytesIn(qint64 bytes);
+	qint64 bytesIn() const;
+	void setBytesOut(qint64 bytes);
+	qint64 bytesOut() const;
+
+protected:
+	QVector<QPair<QString, int> > mTimes;	// keeps the order of the stages
+	qint64 mBytesIn = 0;
+	qint64 mBytesOut = 0;
+};
+
 class DllLoaderExport DkBatchProcess {
 
 public:
 	DkBatchProcess(const DkSaveInfo& saveInfo = DkSaveInfo());
 
 	void setProcessChain(const QVector<QSharedPointer<DkAbstractBatch> > processes);
+	void setJournal(QSharedPointer<DkBatchJournal> journal);
 	bool compute();	// do the work
 	QStringList getLog() const;
 	bool hasFailed() const;
 	bool wasProcessed() const;
 	QString inputFile() const;
 	QString outputFile() const;
+	QStringList additionalOutputFiles() const;
 
-	QVector<QSharedPointer<DkBatchInfo> > batchInfo() const;
+	QVector<QSharedPointer<DkBatchInfo> > batchInfo(bool withOutputs = true) const;
+	QVector<QSharedPointer<DkBatchProcess> > outputs() const;
 
-protected:
+	void setDryRun(bool dryRun);
+	void addOutput(QSharedPointer<DkBatchProcess> output);
+	DkBatchItemStats& stats();
+	const DkBatchItemStats& stats() const;
+	DkBatchItemStats totalStats() const;
+
+	// stages of compute() - see DkBatchPipeline
+	bool prepare();
+	bool read();
+	bool decode();
 	bool process();
-	bool prepareDeleteExisting();
-	bool deleteOrRestoreExisting();
+	bool encode();
+	bool write();
+	bool sync();
+	bool commit();
+	void finish();
+
+protected:
+	bool prepareOutput();
+	bool processOutput();
+	bool encodeOutput();
+	bool writeOutput();
+	bool syncOutput();
+	bool commitOutput();
+	bool computeOutputs(bool (DkBatchProcess::*stage)());
+	bool isPending() const;
+	void failOutputs();
+
 	bool deleteOriginalFile();
 	bool copyFile();
 	bool renameFile();
+	bool transformLossless();
+	bool computeStrips(DkBatchStripChain& strips);
 
 	DkSaveInfo mSaveInfo;
 	int mFailure = 0;
@@ -230,42 +334,224 @@ protected:
 	QVector<QSharedPointer<DkBatchInfo> > mInfos;
 	QVector<QSharedPointer<DkAbstractBatch> > mProcessFunctions;
 	QStringList mLogStrings;
+
+	// data passed between the stages
+	QSharedPointer<QByteArray> mFileBuffer;
+	QSharedPointer<DkImageContainer> mImage;
+	QSharedPointer<QByteArray> mOutputBuffer;
+	QSharedPointer<QTemporaryFile> mTempFile;
+
+	// resume
+	QSharedPointer<DkBatchJournal> mJournal;
+	qint64 mInputSize = -1;
+	qint64 mInputModified = -1;
+	bool mUpToDate = false;
+
+	// profiling
+	DkBatchItemStats mStats;
+	bool mDryRun = false;
+
+	// additional outputs computed from the same decoded image
+	QVector<QSharedPointer<DkBatchProcess> > mOutputs;
+	bool mPending = false;	// true while this item's output needs the next stage
+	bool mIsOutput = false;	// true if this is an additional output of another item
+	bool mCopied = false;		// the input was copied - it is deleted in finish() if requested
 };
 
-class DllLoaderExport DkBatchConfig {
+/**
+ * Aggregates the DkBatchItemStats of a batch.
+ * Additional outputs are accounted to the item they are computed from (see DkBatchProcess::totalStats()).
+ * The stats can be exported as CSV or JSON and are used to
+ * extrapolate the runtime of a batch from a (dry-run) sample.
+ **/
+class DllLoaderExport DkBatchStats {
 
 public:
-	DkBatchConfig() { };
-	DkBatchConfig(const QStringList& fileList, const QString& outputDir, const QString& fileNamePattern);
+	DkBatchStats(const QVector<DkBatchProcess>& items = QVector<DkBatchProcess>(), int elapsed = 0);
+
+	QStringList keys() const;
+	QString toCsv() const;
+	QJsonObject toJson() const;
+	bool save(const QString& filePath) const;
+	QStringList summary() const;
+	QJsonObject estimate(int numFiles, qint64 numBytes) const;
+
+	static int percentile(QVector<int> values, double p);
+
+protected:
+	QJsonObject keySummary(const QString& key) const;
+
+	QVector<DkBatchProcess> mItems;
+	int mElapsed = 0;	// wall time of the batch in ms
+};
+
+/**
+ * Bounded queue that connects two stages of the DkBatchPipeline.
+ * push() blocks while the queue is full which throttles fast stages.
+ **/
+class DllLoaderExport DkBatchQueue {
+
+public:
+	DkBatchQueue(int capacity = 1);
+
+	void push(int idx);
+	bool pop(int& idx);
+	bool isEmpty();
+	void close();
+
+protected:
+	QMutex mMutex;
+	QWaitCondition mNotEmpty;
+	QWaitCondition mNotFull;
+	QQueue<int> mItems;
+	int mCapacity;
+	bool mClosed = false;
+};
+
+/**
+ * Computes batch items in separate stages: read -> decode -> process -> encode -> write.
+ * Every stage has its own workers and stages are connected with bounded queues.
+ * Hence, disk I/O overlaps with decoding and encoding while the number
+ * of images in memory is limited by the threads and queue sizes.
+ **/
+class DllLoaderExport DkBatchPipeline {
+
+public:
+	enum Stage {
+		stage_read = 0,
+		stage_decode,
+		stage_process,
+		stage_encode,
+		stage_write,
+
+		stage_end
+	};
+
+	DkBatchPipeline(QVector<DkBatchProcess>& items);
+
+	void setNumThreads(Stage stage, int numThreads);
+	int numThreads(Stage stage) const;
+	void setQueueSize(int queueSize);
+
+	QFuture<int> start();
+
+	static QString stageName(Stage stage);
+
+protected:
+	void runStage(Stage stage);
+	bool nextItem(Stage stage, int& idx);
+	bool computeStage(Stage stage, DkBatchProcess& item) const;
+	void commit(QVector<int>& items);
+	void finishItem(int idx);
+
+	DkBatchProcess* mItems;
+	int mNumItems;
+	int mNumThreads[stage_end];
+	int mQueueSize = 0;
+	int mCommitSize = 16;	// number of files that are flushed to the disk at once
+
+	QSharedPointer<DkBatchQueue> mQueues[stage_end];	// input of each stage - the reader has none
+	QAtomicInt mNumRunning[stage_end];
+	QAtomicInt mNextItem;
+	QAtomicInt mNumFinished;
+
+	QFutureInterface<int> mFutureInterface;	// reports the indexes of finished items
+	QThreadPool mPool;
+};
+
+/**
+ * Where and how a batch saves its results.
+ * A DkBatchConfig has a main output and might declare additional
+ * outputs (e.g. a thumbnail next to a web image) which are computed
+ * from the same decoded image.
+ **/
+class DllLoaderExport DkBatchOutputConfig {
+
+public:
+	DkBatchOutputConfig(const QString& outputDir = QString(), const QString& fileNamePattern = QString());
+	virtual ~DkBatchOutputConfig() {};
 
 	virtual void saveSettings(QSettings& settings) const;
 	virtual void loadSettings(QSettings& settings);
 
-	bool isOk() const;
-
-	void setFileList(const QStringList& fileList) { mFileList = fileList; };
 	void setOutputDir(const QString& outputDir) { mOutputDirPath = outputDir; };
 	void setFileNamePattern(const QString& pattern) { mFileNamePattern = pattern; };
 	void setProcessFunctions(const QVector<QSharedPointer<DkAbstractBatch> >& processFunctions) { mProcessFunctions = processFunctions; };
 	void setSaveInfo(const DkSaveInfo& saveInfo) { mSaveInfo = saveInfo; };
 
-	QStringList getFileList() const { return mFileList; };
 	QString getOutputDirPath() const { return mOutputDirPath; };
 	QString getFileNamePattern() const { return mFileNamePattern; };
 	QVector<QSharedPointer<DkAbstractBatch> > getProcessFunctions() const { return mProcessFunctions; };
 	DkSaveInfo saveInfo() const { return mSaveInfo; };
 
+	DkSaveInfo createSaveInfo(const QString& filePath, int idx) const;
+
 protected:
 	
 	DkSaveInfo mSaveInfo;
 
-	QStringList mFileList;
 	QString mOutputDirPath;
 	QString mFileNamePattern;
 	
 	QVector<QSharedPointer<DkAbstractBatch> > mProcessFunctions;
 };
 
+class DllLoaderExport DkBatchConfig : public DkBatchOutputConfig {
+
+public:
+	DkBatchConfig() { };
+	DkBatchConfig(const QStringList& fileList, const QString& outputDir, const QString& fileNamePattern);
+
+	virtual void saveSettings(QSettings& settings) const override;
+	virtual void loadSettings(QSettings& settings) override;
+
+	bool isOk() const;
+
+	void setFileList(const QStringList& fileList) { mFileList = fileList; };
+	void setOutputs(const QVector<DkBatchOutputConfig>& outputs) { mOutputs = outputs; };
+
+	QStringList getFileList() const { return mFileList; };
+	QVector<DkBatchOutputConfig> getOutputs() const { return mOutputs; };
+
+protected:
+	QStringList mFileList;
+	QVector<DkBatchOutputConfig> mOutputs;	// additional outputs
+};
+
+/**
+ * Remembers finished batch items so that an interrupted batch can be resumed.
+ * Every item is appended as a single JSON line when it is finished. A crash
+ * can therefore only tear the last line which is ignored when loading.
+ * Items are done if the input's size & date, the profile and the output's size still match.
+ **/
+class DllLoaderExport DkBatchJournal {
+
+public:
+	DkBatchJournal(const QString& filePath, const QString& profileHash);
+
+	bool load();
+	bool isDone(const QString& inputPath, qint64 inputSize, qint64 inputModified, const QFileInfo& output) const;
+	void add(const QString& inputPath, qint64 inputSize, qint64 inputModified, const QString& outputPath);
+
+	static QString profileHash(const DkBatchConfig& config);
+	static QString fileName();
+
+protected:
+	struct Entry {
+		qint64 inputSize = -1;
+		qint64 inputModified = -1;
+		qint64 outputSize = -1;
+		QString outputPath;
+	};
+
+	QString mFilePath;
+	QString mProfileHash;
+	QHash<QString, Entry> mEntries;
+
+	QMutex mMutex;
+	QFile mFile;
+};
+
 class DllLoaderExport DkBatchProcessing : public QObject {
 	Q_OBJECT
 
@@ -282,7 +568,6 @@ public:
 	DkBatchProcessing(const DkBatchConfig& config = DkBatchConfig(), QWidget* parent = 0);
 
 	void compute();
-	static bool computeItem(DkBatchProcess& item);
 	
 	QStringList getLog() const;
 	int getNumFailures() const;
@@ -293,8 +578,14 @@ public:
 	QList<int> getCurrentResults();
 	QStringList getResultList() const;
 	QString getBatchSummary(const DkBatchProcess& batch) const;
+	DkBatchProcess batchItem(int idx) const;
 	void waitForFinished();
 
+	void setDryRun(int numSamples);
+	int dryRun() const;
+	DkBatchStats stats() const;
+	QJsonObject estimate() const;
+
 	// getter, setter
 	void setBatchConfig(const DkBatchConfig& config) { mBatchConfig = config; };
 	DkBatchConfig getBatchConfig() const { return mBatchConfig; };
@@ -305,8 +596,13 @@ public slots:
 	// user interaction
 	void cancel();
 
+protected slots:
+	void itemResultReady(int resultIdx);
+	void batchFinished();
+
 signals:
 	void progressValueChanged(int idx);
+	void itemFinished(int idx);
 	void finished();
 
 protected:
@@ -315,9 +611,37 @@ protected:
 	QList<int> mResList;
 	
 	// threading
-	QFutureWatcher<void> mBatchWatcher;
+	QFutureWatcher<int> mBatchWatcher;
+	QSharedPointer<DkBatchPipeline> mPipeline;
+
+	// profiling
+	DkTimer mTimer;
+	int mElapsed = 0;
+	int mDryRun = 0;	// number of sampled files - 0 processes all files
 	
 	void init();
+	QSharedPointer<DkBatchJournal> createJournal() const;
+};
+
+/**
+ * Prints the progress of a DkBatchProcessing as JSON lines to stdout.
+ * Each line is a single object so that schedulers can parse it while the batch is running.
+ **/
+class DllLoaderExport DkBatchJsonReporter : public QObject {
+	Q_OBJECT
+
+public:
+	DkBatchJsonReporter(DkBatchProcessing* batch, QObject* parent = 0);
+
+public slots:
+	void itemFinished(int idx);
+	void batchFinished();
+
+protected:
+	void print(const QJsonObject& json) const;
+
+	DkBatchProcessing* mBatch;
+	int mNumFinished = 0;
 };
 
 class DllLoaderExport DkBatchProfile {
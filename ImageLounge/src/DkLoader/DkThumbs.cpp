@@ -32,6 +32,7 @@
 #include "DkBasicLoader.h"
 #include "DkMetaData.h"
 #include "DkUtils.h"
+#include "DkTaskScheduler.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QFileInfo>
@@ -41,10 +42,302 @@
 #include <QtConcurrentRun>
 #include <QTimer>
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDirIterator>
+#include <QVector>
+#include <QPair>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
 
+// DkThumbCache --------------------------------------------------------------------
+DkThumbCache::DkThumbCache() {
+
+	mCacheDir = DkUtils::getAppDataPath() + QDir::separator() + "thumbs";
+}
+
+DkThumbCache::~DkThumbCache() {
+
+	save();
+}
+
+DkThumbCache& DkThumbCache::instance() {
+
+	static DkThumbCache inst;
+	return inst;
+}
+
+bool DkThumbCache::isEnabled() const {
+
+	return DkSettingsManager::param().resources().thumbCacheSize > 0;
+}
+
+/**
+ * Returns the cache key of a file.
+ * @param filePath the image's file path
+ * @param maxThumbSize the maximal thumbnail size requested
+ * @param minThumbSize the minimal thumbnail size requested
+ * @return QString the key - empty if the file cannot be cached (e.g. it does not exist)
+ **/ 
+QString DkThumbCache::key(const QString& filePath, int maxThumbSize, int minThumbSize) const {
+
+	if (!isEnabled())
+		return QString();
+
+	QFileInfo fInfo(filePath);
+	QFileInfo versionInfo = fInfo;
+
+#ifdef WITH_QUAZIP
+	// images within zip archives change with their archive
+	if (filePath.contains(DkZipContainer::zipMarker()))
+		versionInfo = QFileInfo(DkZipContainer::decodeZipFile(filePath));
+#endif
+
+	if (!versionInfo.isFile())
+		return QString();
+
+	QString keyStr = fInfo.absoluteFilePath() + "|" + 
+		QString::number(versionInfo.size()) + "|" + 
+		QString::number(versionInfo.lastModified().toMSecsSinceEpoch()) + "|" + 
+		QString::number(maxThumbSize) + "|" + 
+		QString::number(minThumbSize);
+
+	return QCryptographicHash::hash(keyStr.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+/**
+ * Returns the cached thumbnail.
+ * @param key the key (see key())
+ * @return QImage the thumbnail - null if it is not cached
+ **/ 
+QImage DkThumbCache::find(const QString& key) {
+
+	if (key.isEmpty())
+		return QImage();
+
+	{
+		QMutexLocker locker(&mMutex);
+		load();
+
+		QHash<QString, Entry>::iterator eIt = mEntries.find(key);
+		if (eIt == mEntries.end())
+			return QImage();
+
+		eIt->lastAccess = QDateTime::currentMSecsSinceEpoch();
+		mDirty = true;
+	}
+
+	QImage thumb(entryPath(key));
+
+	// somebody deleted our file?
+	if (thumb.isNull()) {
+		QMutexLocker locker(&mMutex);
+		mTotalSize -= mEntries.value(key).size;
+		mEntries.remove(key);
+	}
+
+	return thumb;
+}
+
+/**
+ * Adds a thumbnail to the cache.
+ * If the cache is full, the least recently used thumbnails are removed.
+ * @param key the key (see key())
+ * @param thumb the thumbnail
+ **/ 
+void DkThumbCache::insert(const QString& key, const QImage& thumb) {
+
+	if (key.isEmpty() || thumb.isNull())
+		return;
+
+	QString path = entryPath(key);
+	QDir().mkpath(QFileInfo(path).absolutePath());
+
+	// jpgs are much smaller - but they lose the alpha channel
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly) || 
+		!thumb.save(&file, thumb.hasAlphaChannel() ? "PNG" : "JPG", 90) || 
+		!file.commit()) {
+		qWarning() << "[DkThumbCache] could not write" << path;
+		return;
+	}
+
+	qint64 maxBytes = (qint64)DkSettingsManager::param().resources().thumbCacheSize*1024*1024;
+
+	QMutexLocker locker(&mMutex);
+	load();
+
+	Entry& e = mEntries[key];
+	mTotalSize -= e.size;
+	e.size = QFileInfo(path).size();
+	e.lastAccess = QDateTime::currentMSecsSinceEpoch();
+	mTotalSize += e.size;
+	mDirty = true;
+
+	// free 10% more so that we do not evict on every insert
+	if (mTotalSize > maxBytes)
+		evict(qRound64(maxBytes*0.9));
+
+	// keep the index on disk if we crash
+	if (++mNumInserts >= 100)
+		saveIntern();
+}
+
+/**
+ * Removes all cached thumbnails.
+ **/ 
+void DkThumbCache::clear() {
+
+	QMutexLocker locker(&mMutex);
+
+	QDir(mCacheDir).removeRecursively();
+	mEntries.clear();
+	mTotalSize = 0;
+	mLoaded = true;
+	mDirty = false;
+}
+
+/**
+ * Writes the cache index to disk.
+ **/ 
+void DkThumbCache::save() {
+
+	QMutexLocker locker(&mMutex);
+	saveIntern();
+}
+
+void DkThumbCache::saveIntern() {
+
+	mNumInserts = 0;
+
+	if (!mDirty)
+		return;
+
+	QDir().mkpath(mCacheDir);
+
+	QSaveFile file(QDir(mCacheDir).absoluteFilePath("index.dat"));
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkThumbCache] could not save index to" << mCacheDir;
+		return;
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)0x6e546843 << (qint32)1;	// magic (nThC) + version
+	ds << (qint32)mEntries.size();
+
+	for (QHash<QString, Entry>::const_iterator eIt = mEntries.constBegin(); eIt != mEntries.constEnd(); eIt++)
+		ds << eIt.key() << eIt->size << eIt->lastAccess;
+
+	if (file.commit())
+		mDirty = false;
+}
+
+/**
+ * Loads the cache index (lazily on first access).
+ * If the index is missing or corrupt, it is rebuilt from the cache folder.
+ **/ 
+void DkThumbCache::load() {
+
+	if (mLoaded)
+		return;
+
+	mLoaded = true;
+	mEntries.clear();
+	mTotalSize = 0;
+
+	DkTimer dt;
+	QFile file(QDir(mCacheDir).absoluteFilePath("index.dat"));
+
+	if (file.open(QIODevice::ReadOnly)) {
+
+		QDataStream ds(&file);
+		quint32 magic = 0;
+		qint32 version = 0, numEntries = 0;
+		ds >> magic >> version >> numEntries;
+
+		// each entry needs at least its key's length, size & access time - don't trust corrupt counts
+		if (magic == 0x6e546843 && version == 1 && 
+			numEntries >= 0 && numEntries <= (file.size() - file.pos())/20) {
+
+			mEntries.reserve(numEntries);
+
+			for (int idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+				QString key;
+				Entry e;
+				ds >> key >> e.size >> e.lastAccess;
+				mEntries.insert(key, e);
+				mTotalSize += e.size;
+			}
+		}
+
+		if (ds.status() == QDataStream::Ok && !mEntries.isEmpty()) {
+			qDebug() << "[DkThumbCache]" << mEntries.size() << "thumbnails indexed in" << dt;
+			return;
+		}
+
+		mEntries.clear();
+		mTotalSize = 0;
+	}
+
+	// rebuild the index
+	QDirIterator dIt(mCacheDir, QDir::Files, QDirIterator::Subdirectories);
+	while (dIt.hasNext()) {
+		dIt.next();
+
+		if (dIt.fileName() == "index.dat")
+			continue;
+
+		Entry e;
+		e.size = dIt.fileInfo().size();
+		e.lastAccess = dIt.fileInfo().lastModified().toMSecsSinceEpoch();
+		mEntries.insert(dIt.fileName(), e);
+		mTotalSize += e.size;
+	}
+
+	mDirty = !mEntries.isEmpty();
+	qDebug() << "[DkThumbCache] index rebuilt with" << mEntries.size() << "thumbnails in" << dt;
+}
+
+/**
+ * Removes the least recently used thumbnails.
+ * @param maxBytes the size of the cache after eviction.
+ **/ 
+void DkThumbCache::evict(qint64 maxBytes) {
+
+	QVector<QPair<qint64, QString> > entries;
+	entries.reserve(mEntries.size());
+
+	for (QHash<QString, Entry>::const_iterator eIt = mEntries.constBegin(); eIt != mEntries.constEnd(); eIt++)
+		entries << qMakePair(eIt->lastAccess, eIt.key());
+
+	// oldest first
+	std::sort(entries.begin(), entries.end());
+
+	int numRemoved = 0;
+	for (const QPair<qint64, QString>& e : entries) {
+
+		if (mTotalSize <= maxBytes)
+			break;
+
+		QFile::remove(entryPath(e.second));
+		mTotalSize -= mEntries.value(e.second).size;
+		mEntries.remove(e.second);
+		numRemoved++;
+	}
+
+	mDirty = true;
+	qDebug() << "[DkThumbCache]" << numRemoved << "thumbnails evicted";
+}
+
+QString DkThumbCache::entryPath(const QString& key) const {
+
+	// split into sub folders - otherwise explorers choke on the cache folder
+	return mCacheDir + QDir::separator() + key.left(2) + QDir::separator() + key;
+}
+
 /**
 * Default constructor.
 * @param file the corresponding file
@@ -89,31 +382,58 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	DkTimer dt;
 	//qDebug() << "[thumb] file: " << file.absoluteFilePath();
 
+	// check the persistent cache first - this does not touch the image file at all
+	QString cacheKey;
+	if (forceLoad == do_not_force || forceLoad == force_full_thumb)
+		cacheKey = DkThumbCache::instance().key(filePath, maxThumbSize, minThumbSize);
+
+	if (forceLoad == do_not_force) {
+		QImage cThumb = DkThumbCache::instance().find(cacheKey);
+
+		if (!cThumb.isNull()) {
+			qInfoClean() << "[thumb] " << QFileInfo(filePath).fileName() << " (" << cThumb.width() << " x " << cThumb.height() << ") loaded in " << dt << " from cache";
+			return cThumb;
+		}
+	}
+
 	// see if we can read the thumbnail from the exif data
 	QImage thumb;
-	DkMetaDataT metaData;
 
 	QSharedPointer<QByteArray> baZip = QSharedPointer<QByteArray>();
 #ifdef WITH_QUAZIP
 	if (QFileInfo(mFile).dir().path().contains(DkZipContainer::zipMarker())) 
 		baZip = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
-	try {
-		// [DIEM] READ  build crashed here 09.06.2016
-		if (baZip && !baZip->isEmpty())	
-			metaData.readMetaData(filePath, baZip);
-		else if (!ba || ba->isEmpty())
-			metaData.readMetaData(filePath);
-		else
-			metaData.readMetaData(filePath, ba);
-
-		// read the full image if we want to create new thumbnails
-		if (forceLoad != force_save_thumb)
-			thumb = metaData.getThumbnail();
-	}
-	catch(...) {
-		// do nothing - we'll load the full file
+
+	// map large files once - exiv2 and the image reader then share the same pages
+	QSharedPointer<QByteArray> fileBuffer = ba;
+	if ((!fileBuffer || fileBuffer->isEmpty()) && (!baZip || baZip->isEmpty()))
+		fileBuffer = DkFileBuffer::map(filePath);
+
+	// the metadata is read once per file version - the loader might have done it already
+	// exiv2 is only needed if the header cannot be scanned
+	// [DIEM] READ  build crashed here 09.06.2016
+	QSharedPointer<DkMetaDataRecord> metaData = DkMetaDataCache::instance().header(filePath, 
+		(baZip && !baZip->isEmpty()) ? baZip : fileBuffer);
+
+	// read the full image if we want to create new thumbnails
+	if (forceLoad != force_save_thumb)
+		thumb = metaData->thumbnail();
+
+	// the image plugins do not change at runtime - so we collect their formats once
+	static const QList<QByteArray> qtFormats = QImageReader::supportedImageFormats();
+
+	// RAW files: decode the embedded preview to the thumbnail size instead of developing the image
+	if (forceLoad != force_exif_thumb && (thumb.isNull() || (thumb.width() < minThumbSize && thumb.height() < minThumbSize)) &&
+		!qtFormats.contains(QFileInfo(filePath).suffix().toLower().toLatin1())) {
+
+		QImage preview = DkEmbeddedPreview::load(filePath, QSize(maxThumbSize, maxThumbSize), 0, 
+			(baZip && !baZip->isEmpty()) ? baZip : fileBuffer);
+
+		if (!preview.isNull())
+			thumb = preview;
 	}
+
 	removeBlackBorder(thumb);
 
 	if (thumb.isNull() && forceLoad == force_exif_thumb)
@@ -121,7 +441,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 
 	bool exifThumb = !thumb.isNull();
 
-	int orientation = metaData.getOrientationDegree();
+	int orientation = metaData->orientation();
 	int imgW = thumb.width();
 	int imgH = thumb.height();
 	int tS = minThumbSize;
@@ -132,15 +452,14 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	fInfo = lFilePath;
 
 	QImageReader* imageReader = 0;
+	QBuffer buffer;	// must live as long as the reader
 	
-	if (!ba || ba->isEmpty())
+	if (!fileBuffer || fileBuffer->isEmpty())
 		imageReader = new QImageReader(lFilePath);
 	else {
-		QBuffer buffer;
-		buffer.setData(ba->data());
+		buffer.setData(*fileBuffer);	// shallow copy
 		buffer.open(QIODevice::ReadOnly);
 		imageReader = new QImageReader(&buffer, fInfo.suffix().toStdString().c_str());
-		buffer.close();
 	}
 
 	if (thumb.isNull() || (thumb.width() < tS && thumb.height() < tS)) {
@@ -174,7 +493,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 			forceLoad == force_save_thumb)) { // braces
 		
 		// flip size if the image is rotated by 90
-		if (metaData.isTiff() && abs(orientation) == 90) {
+		if (metaData->isTiff() && abs(orientation) == 90) {
 			int tmpW = imgW;
 			imgW = imgH;
 			imgH = tmpW;
@@ -195,7 +514,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 				thumb = loader.image();
 			}
 			else {
-				if (loader.loadGeneral(lFilePath, ba, true, true))
+				if (loader.loadGeneral(lFilePath, fileBuffer, true, true))
 					thumb = loader.image();
 			}
 		}
@@ -234,7 +553,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	if (imageReader)
 		delete imageReader;
 
-	if (orientation != -1 && orientation != 0 && (metaData.isJpg() || metaData.isRaw())) {
+	if (orientation != -1 && orientation != 0 && (metaData->isJpg() || metaData->isRaw())) {
 		QTransform rotationMatrix;
 		rotationMatrix.rotate((double)orientation);
 		thumb = thumb.transformed(rotationMatrix);
@@ -252,12 +571,15 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 				sThumb = sThumb.transformed(rotationMatrix);
 			}
 
-			metaData.setThumbnail(sThumb);
+			// the record is read-only - writing needs exiv2's full metadata
+			DkMetaDataT fullMetaData;
+			fullMetaData.readMetaData(filePath, fileBuffer);
+			fullMetaData.setThumbnail(sThumb);
 
 			if (!ba || ba->isEmpty())
-				metaData.saveMetaData(lFilePath);
+				fullMetaData.saveMetaData(lFilePath);
 			else
-				metaData.saveMetaData(lFilePath, ba);
+				fullMetaData.saveMetaData(lFilePath, ba);
 
 			qDebug() << "[thumb] saved to exif data";
 		}
@@ -267,6 +589,8 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	}
 
 
+	DkThumbCache::instance().insert(cacheKey, thumb);
+
 	if (!thumb.isNull())
 		qInfoClean() << "[thumb] " << fInfo.fileName() << " (" << thumb.width() << " x " << thumb.height() << ") loaded in " << dt << ((exifThumb) ? " from EXIV" : " from File");
 
@@ -357,11 +681,9 @@ DkThumbNailT::~DkThumbNailT() {
 	//	qDebug() << "[WARNING]: thumb watcher is started but not running while releasing!";
 	//}
 
-	if (mFetching && DkSettingsManager::param().resources().numThumbsLoading > 0)
-		DkSettingsManager::param().resources().numThumbsLoading--;
-
 	thumbWatcher.blockSignals(true);
 	thumbWatcher.cancel();
+	DkTaskScheduler::instance().cancel(this);
 }
 
 bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba) {
@@ -377,11 +699,13 @@ bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByte
 	mFetching = true;
 	mForceLoad = forceLoad;
 
-	connect(&thumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()));
-	thumbWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkThumbNailT::computeCall, mFile, ba, forceLoad, mMaxThumbSize, mMinThumbSize));
+	// saving thumbnails is a background job
+	DkTaskScheduler::Priority priority = (forceLoad == force_save_thumb || forceLoad == save_thumb) ? 
+		DkTaskScheduler::priority_batch : DkTaskScheduler::priority_thumbs;
 
-	DkSettingsManager::param().resources().numThumbsLoading++;
+	connect(&thumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()));
+	thumbWatcher.setFuture(DkTaskScheduler::instance().run<QImage>(priority, this, 
+		std::bind(&nmc::DkThumbNailT::computeCall, this, mFile, ba, forceLoad, mMaxThumbSize, mMinThumbSize)));
 
 	return true;
 }
@@ -402,7 +726,6 @@ void DkThumbNailT::thumbLoaded() {
 		mImgExists = false;
 
 	mFetching = false;
-	DkSettingsManager::param().resources().numThumbsLoading--;
 	emit thumbLoadedSignal(!mImg.isNull());
 }
 
@@ -34,6 +34,8 @@
 #include <QDir>
 #include <QThread>
 #include <QImage>
+#include <QMutex>
+#include <QHash>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -52,6 +54,52 @@ namespace nmc {
 
 #define max_thumb_size 160
 
+/**
+ * Persistent thumbnail cache.
+ * Thumbnails are stored as small image files in the app data folder.
+ * Entries are keyed by the file path, its size, its modification date
+ * and the requested thumbnail size - so modified files are never served
+ * from the cache. If the cache exceeds resources().thumbCacheSize MB,
+ * the least recently used thumbnails are removed.
+ * All functions are thread-safe.
+ **/ 
+class DllLoaderExport DkThumbCache {
+
+public:
+	static DkThumbCache& instance();
+	~DkThumbCache();
+
+	QString key(const QString& filePath, int maxThumbSize, int minThumbSize) const;
+	QImage find(const QString& key);
+	void insert(const QString& key, const QImage& thumb);
+	void clear();
+	void save();
+
+protected:
+	DkThumbCache();
+	DkThumbCache(DkThumbCache const&);		// hide
+	void operator=(DkThumbCache const&);	// hide
+
+	struct Entry {
+		qint64 size = 0;
+		qint64 lastAccess = 0;
+	};
+
+	bool isEnabled() const;
+	void load();
+	void saveIntern();
+	void evict(qint64 maxBytes);
+	QString entryPath(const QString& key) const;
+
+	QMutex mMutex;
+	QString mCacheDir;
+	QHash<QString, Entry> mEntries;
+	qint64 mTotalSize = 0;
+	int mNumInserts = 0;
+	bool mLoaded = false;
+	bool mDirty = false;
+};
+
 /**
  * This class holds thumbnails.
  **/ 
@@ -53,6 +53,11 @@
 #include <QDesktopServices>
 #include <QCommandLineParser>
 #include <QMessageBox>
+#include <QEventLoop>
+#include <QScopedPointer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
 #pragma warning(pop)	// no warnings from includes - end
 
 #include "DkNoMacs.h"
@@ -72,8 +77,10 @@
 #include <shlobj.h>
 #endif
 
+QCoreApplication* createApplication(int& argc, char** argv);
+bool batchUsesPlugins(const QString& settingsPath);
 void createPluginsPath();
-void computeBatch(const QString& settingsPath, const QString& logPath = QString());
+void computeBatch(const QString& settingsPath, const QString& logPath = QString(), bool jsonProgress = false, const QString& profilePath = QString(), int dryRun = 0);
 
 #ifdef Q_OS_WIN
 int main(int argc, wchar_t *argv[]) {
@@ -96,7 +103,9 @@ int main(int argc, char *argv[]) {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
     QApplication::setAttribute(Qt::AA_DisableHighDpiScaling, true);
 #endif
-	QApplication a(argc, (char**)argv);
+	// batch processing runs without GUI - so no display server is needed
+	QScopedPointer<QCoreApplication> app(createApplication(argc, (char**)argv));
+	QCoreApplication& a = *app;
 
 	// init settings
 	nmc::DkSettingsManager::instance().init();
@@ -150,6 +159,25 @@ int main(int argc, char *argv[]) {
 		QObject::tr("log-path.txt"));
 	parser.addOption(batchLogOpt);
 
+	QCommandLineOption batchThreadsOpt(QStringList() << "batch-threads",
+		QObject::tr("Uses <threads> for decoding, processing and encoding each."),
+		QObject::tr("threads"));
+	parser.addOption(batchThreadsOpt);
+
+	QCommandLineOption batchProgressOpt(QStringList() << "batch-progress",
+		QObject::tr("Reports the batch progress as JSON lines."));
+	parser.addOption(batchProgressOpt);
+
+	QCommandLineOption batchProfileOpt(QStringList() << "batch-profile",
+		QObject::tr("Saves the timings of each batch stage to <profile-path.csv> or <profile-path.json>."),
+		QObject::tr("profile-path"));
+	parser.addOption(batchProfileOpt);
+
+	QCommandLineOption batchDryRunOpt(QStringList() << "batch-dry-run",
+		QObject::tr("Processes <samples> files without saving them and estimates the batch's runtime and output size."),
+		QObject::tr("samples"));
+	parser.addOption(batchDryRunOpt);
+
 	QCommandLineOption importSettingsOpt(QStringList() << "import-settings",
 		QObject::tr("Imports the settings from <settings-path.nfo> and saves them."),
 		QObject::tr("settings-path.nfo"));
@@ -167,8 +195,15 @@ int main(int argc, char *argv[]) {
 		if (!parser.value(batchLogOpt).isEmpty())
 			logPath = parser.value(batchLogOpt);
 
+		if (!parser.value(batchThreadsOpt).isEmpty()) {
+			int numThreads = parser.value(batchThreadsOpt).toInt();
+			nmc::DkSettingsManager::param().resources().batchDecodeThreads = numThreads;
+			nmc::DkSettingsManager::param().resources().batchProcessThreads = numThreads;
+			nmc::DkSettingsManager::param().resources().batchEncodeThreads = numThreads;
+		}
+
 		QString batchSettingsPath = parser.value(batchOpt);
-		computeBatch(batchSettingsPath, logPath);
+		computeBatch(batchSettingsPath, logPath, parser.isSet(batchProgressOpt), parser.value(batchProfileOpt), parser.value(batchDryRunOpt).toInt());
 		return 0;
 	}
 
@@ -310,21 +345,106 @@ int main(int argc, char *argv[]) {
 	return rVal;
 }
 
-void computeBatch(const QString& settingsPath, const QString& logPath) {
+/**
+ * Creates a QCoreApplication if nomacs is started for batch processing.
+ * The GUI (and its platform plugin) is only initialized if needed.
+ * Batches with plugins need a QApplication since plugins create their actions & menus when they are loaded.
+ **/
+QCoreApplication* createApplication(int& argc, char** argv) {
+
+	for (int idx = 1; idx < argc; idx++) {
+
+		QString settingsPath;
+
+		// --batch <settings> or --batch=<settings> (but not e.g. --batch-log)
+		if (!qstrcmp(argv[idx], "--batch")) {
+			if (idx + 1 < argc)
+				settingsPath = QString::fromLocal8Bit(argv[idx+1]);
+		}
+		else if (!qstrncmp(argv[idx], "--batch=", 8))
+			settingsPath = QString::fromLocal8Bit(argv[idx] + 8);
+		else
+			continue;
+
+		if (batchUsesPlugins(settingsPath))
+			break;
+
+		return new QCoreApplication(argc, argv);
+	}
+
+	return new QApplication(argc, argv);
+}
+
+/**
+ * Returns true if the batch settings contain plugin functions.
+ * This is checked before the application is created - so the ini file is read directly.
+ * @param settingsPath the batch settings (see DkBatchProfile)
+ **/
+bool batchUsesPlugins(const QString& settingsPath) {
+
+#ifdef WITH_PLUGINS
+	if (settingsPath.isEmpty())
+		return false;
+
+	QSettings settings(settingsPath, QSettings::IniFormat);
+
+	// additional outputs keep their functions in sub groups
+	for (const QString& key : settings.allKeys()) {
+		if (key.endsWith("pluginList") && !settings.value(key).toString().isEmpty())
+			return true;
+	}
+#else
+	Q_UNUSED(settingsPath);
+#endif
+
+	return false;
+}
+
+void computeBatch(const QString& settingsPath, const QString& logPath, bool jsonProgress, const QString& profilePath, int dryRun) {
 	
 	nmc::DkBatchConfig bc = nmc::DkBatchProfile::loadProfile(settingsPath);
 
 	// guarantee that the output path exists
-	if (!QDir().mkpath(bc.getOutputDirPath())) {
+	if (dryRun <= 0 && !QDir().mkpath(bc.getOutputDirPath())) {
 		qCritical() << "Could not create:" << bc.getOutputDirPath();
 		return;
 	}
 
+	for (const nmc::DkBatchOutputConfig& o : bc.getOutputs()) {
+		if (dryRun <= 0 && !QDir().mkpath(o.getOutputDirPath())) {
+			qCritical() << "Could not create:" << o.getOutputDirPath();
+			return;
+		}
+	}
+
 	QSharedPointer<nmc::DkBatchProcessing> process(new nmc::DkBatchProcessing());
 	process->setBatchConfig(bc);
+	process->setDryRun(dryRun);
+
+	QSharedPointer<nmc::DkBatchJsonReporter> reporter;
+	if (jsonProgress)
+		reporter = QSharedPointer<nmc::DkBatchJsonReporter>(new nmc::DkBatchJsonReporter(process.data()));
+
+	// we need an event loop for the progress signals
+	QEventLoop loop;
+	QObject::connect(process.data(), SIGNAL(finished()), &loop, SLOT(quit()));
+
 	process->compute();
+	loop.exec();	// block
+
+	if (dryRun > 0)
+		std::cout << QJsonDocument(process->estimate()).toJson(QJsonDocument::Compact).toStdString() << std::endl;
 
-	process->waitForFinished();	// block
+	if (!profilePath.isEmpty()) {
+
+		nmc::DkBatchStats stats = process->stats();
+
+		for (const QString& line : stats.summary())
+			qInfo() << qPrintable(line);
+
+		if (stats.save(profilePath))
+			qInfo() << "profile written to: " << profilePath;
+	}
 
 	if (!logPath.isEmpty()) {
 		